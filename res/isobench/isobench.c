@@ -0,0 +1,394 @@
+/*
+ * Rufus: The Reliable USB Formatting Utility
+ * ISO read path benchmark
+ * Copyright © 2026 Pete Batard <pete@akeo.ie>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Walks an ISO9660 or UDF image through our vendored libcdio, with the same
+ * extension selection and file naming rules as ExtractISO(), and either discards
+ * the file data or streams it to stdout as a tar archive. This lets us measure
+ * the read path in isolation, without having to write a drive.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DO_NOT_WANT_COMPATIBILITY
+#include <cdio/cdio.h>
+#include <cdio/iso9660.h>
+#include <cdio/udf.h>
+
+#define BUFFER_SIZE         (64 * 1024)	// Same as ISO_BUFFER_SIZE in Rufus
+#define TAR_BLOCKSIZE       512
+
+// Needed for UDF ISO access
+CdIo_t* cdio_open (const char* psz_source, driver_id_t driver_id) {return NULL;}
+void cdio_destroy (CdIo_t* p_cdio) {}
+
+typedef struct {
+	uint64_t nb_dirs;
+	uint64_t nb_files;
+	uint64_t nb_bytes;
+	double dir_time;
+	double data_time;
+} bench_stats_t;
+
+static bench_stats_t stats = { 0 };
+static FILE* tar_fd = NULL;
+static uint8_t* buf = NULL;
+static const uint8_t zero[2 * TAR_BLOCKSIZE] = { 0 };
+static uint8_t joliet_level = 0;
+static int enable_rockridge = 1;
+
+static double get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Same as sanitize_filename() from src/iso.c, for the names we output
+static void sanitize_filename(char* filename)
+{
+	size_t i, j;
+	const char unauthorized[] = { '*', '?', '<', '>', ':', '|' };
+
+	for (i = 0; filename[i] != 0; i++) {
+		for (j = 0; j < sizeof(unauthorized); j++) {
+			if (filename[i] == unauthorized[j])
+				filename[i] = '_';
+		}
+	}
+}
+
+static void tar_octal(char* field, size_t len, uint64_t val)
+{
+	// Use the GNU base-256 extension for values that don't fit in octal
+	if (len == 12 && val >= 077777777777ULL) {
+		memset(field, 0, len);
+		field[0] = (char)0x80;
+		for (len--; len > 0; len--, val >>= 8)
+			field[len] = (char)(val & 0xff);
+		return;
+	}
+	snprintf(field, len, "%0*llo", (int)len - 1, (unsigned long long)val);
+}
+
+static int tar_header(const char* name, char type, uint64_t size, time_t mtime, const char* link)
+{
+	char hdr[TAR_BLOCKSIZE];
+	unsigned int i, sum = 0;
+	size_t len = strlen(name) + 1;
+
+	// Use a GNU 'L' record for names that don't fit the header
+	if (len > 100 && (tar_header("././@LongLink", 'L', len, 0, NULL) != 0 ||
+		fwrite(name, 1, len, tar_fd) != len ||
+		fwrite(zero, 1, (TAR_BLOCKSIZE - len % TAR_BLOCKSIZE) % TAR_BLOCKSIZE, tar_fd) !=
+		(TAR_BLOCKSIZE - len % TAR_BLOCKSIZE) % TAR_BLOCKSIZE))
+		return -1;
+
+	memset(hdr, 0, sizeof(hdr));
+	strncpy(&hdr[0], name, 99);
+	tar_octal(&hdr[100], 8, (type == '5') ? 0755 : 0644);
+	tar_octal(&hdr[108], 8, 0);
+	tar_octal(&hdr[116], 8, 0);
+	tar_octal(&hdr[124], 12, size);
+	tar_octal(&hdr[136], 12, (mtime < 0) ? 0 : (uint64_t)mtime);
+	memset(&hdr[148], ' ', 8);
+	hdr[156] = type;
+	if (link != NULL)
+		strncpy(&hdr[157], link, 99);
+	memcpy(&hdr[257], "ustar  ", 8);
+	strcpy(&hdr[265], "root");
+	strcpy(&hdr[297], "root");
+	for (i = 0; i < sizeof(hdr); i++)
+		sum += (uint8_t)hdr[i];
+	snprintf(&hdr[148], 8, "%06o", sum);
+	return (fwrite(hdr, 1, sizeof(hdr), tar_fd) == sizeof(hdr)) ? 0 : -1;
+}
+
+// Called for each chunk of file data, with a final call of size 0 to pad the record
+static int tar_data(const uint8_t* data, size_t size, uint64_t total_size)
+{
+	size_t pad;
+
+	if (tar_fd == NULL)
+		return 0;
+	if (size != 0)
+		return (fwrite(data, 1, size, tar_fd) == size) ? 0 : -1;
+	pad = (size_t)((TAR_BLOCKSIZE - total_size % TAR_BLOCKSIZE) % TAR_BLOCKSIZE);
+	return (fwrite(zero, 1, pad, tar_fd) == pad) ? 0 : -1;
+}
+
+static int add_entry(const char* path, char type, uint64_t size, time_t mtime, const char* link)
+{
+	char name[4096];
+
+	if (type == '5')
+		stats.nb_dirs++;
+	else
+		stats.nb_files++;
+	if (tar_fd == NULL)
+		return 0;
+	// Our paths start with a slash
+	snprintf(name, sizeof(name), "%s%s", &path[1], (type == '5') ? "/" : "");
+	sanitize_filename(name);
+	return tar_header(name, type, size, mtime, link);
+}
+
+static int udf_walk(udf_dirent_t* p_udf_dirent, const char* psz_path)
+{
+	char path[4096];
+	const char* psz_basename;
+	udf_dirent_t* p_udf_dirent2;
+	uint64_t file_length, total_size;
+	ssize_t read;
+	size_t nb;
+	double t = get_time();
+
+	while ((p_udf_dirent = udf_readdir(p_udf_dirent)) != NULL) {
+		psz_basename = udf_get_filename(p_udf_dirent);
+		if (strlen(psz_basename) == 0)
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", psz_path, psz_basename);
+		if (udf_is_dir(p_udf_dirent)) {
+			if (add_entry(path, '5', 0, udf_get_modification_time(p_udf_dirent), NULL) != 0)
+				goto out;
+			p_udf_dirent2 = udf_opendir(p_udf_dirent);
+			stats.dir_time += get_time() - t;
+			if (p_udf_dirent2 != NULL && udf_walk(p_udf_dirent2, path) != 0)
+				goto out;
+			t = get_time();
+			continue;
+		}
+		stats.dir_time += get_time() - t;
+		t = get_time();
+		total_size = file_length = udf_get_file_length(p_udf_dirent);
+		if (add_entry(path, '0', file_length, udf_get_modification_time(p_udf_dirent), NULL) != 0)
+			goto out;
+		while (file_length > 0) {
+			nb = (size_t)((file_length + UDF_BLOCKSIZE - 1) / UDF_BLOCKSIZE);
+			if (nb > BUFFER_SIZE / UDF_BLOCKSIZE)
+				nb = BUFFER_SIZE / UDF_BLOCKSIZE;
+			read = udf_read_block(p_udf_dirent, buf, nb);
+			if (read <= 0) {
+				fprintf(stderr, "Error reading UDF file %s\n", path);
+				goto out;
+			}
+			if ((uint64_t)read > file_length)
+				read = (ssize_t)file_length;
+			if (tar_data(buf, (size_t)read, total_size) != 0)
+				goto out;
+			file_length -= read;
+			stats.nb_bytes += read;
+		}
+		if (tar_data(NULL, 0, total_size) != 0)
+			goto out;
+		stats.data_time += get_time() - t;
+		t = get_time();
+	}
+	stats.dir_time += get_time() - t;
+	return 0;
+
+out:
+	udf_dirent_free(p_udf_dirent);
+	return -1;
+}
+
+static int iso_walk(iso9660_t* p_iso, const char* psz_path)
+{
+	int r = -1;
+	char path[4096], link[4096];
+	size_t len, nb, i;
+	uint64_t file_length, rd;
+	lsn_t lsn;
+	CdioListNode_t* p_entnode;
+	iso9660_stat_t* p_statbuf;
+	CdioISO9660FileList_t* p_entlist;
+	double t = get_time();
+
+	p_entlist = iso9660_ifs_readdir(p_iso, psz_path);
+	stats.dir_time += get_time() - t;
+	if (p_entlist == NULL) {
+		fprintf(stderr, "Could not access directory %s\n", psz_path);
+		return -1;
+	}
+
+	_CDIO_LIST_FOREACH(p_entnode, p_entlist) {
+		p_statbuf = (iso9660_stat_t*)_cdio_list_node_data(p_entnode);
+		if (strcmp(p_statbuf->filename, ".") == 0 || strcmp(p_statbuf->filename, "..") == 0)
+			continue;
+		len = (size_t)snprintf(path, sizeof(path), "%s/", psz_path);
+		if (len >= sizeof(path))
+			goto out;
+		// Rock Ridge names are used as is, other names are translated
+		if (p_statbuf->rr.b3_rock == yep && enable_rockridge)
+			snprintf(&path[len], sizeof(path) - len, "%s", p_statbuf->filename);
+		else
+			iso9660_name_translate_ext(p_statbuf->filename, &path[len], joliet_level);
+		if (p_statbuf->type == _STAT_DIR) {
+			if (add_entry(path, '5', 0, mktime(&p_statbuf->tm), NULL) != 0 || iso_walk(p_iso, path) != 0)
+				goto out;
+			continue;
+		}
+		if (p_statbuf->rr.b3_rock == yep && enable_rockridge && p_statbuf->rr.psz_symlink != NULL) {
+			snprintf(link, sizeof(link), "%s", p_statbuf->rr.psz_symlink);
+			if (add_entry(path, '2', 0, mktime(&p_statbuf->tm), link) != 0)
+				goto out;
+			continue;
+		}
+		t = get_time();
+		file_length = p_statbuf->total_size;
+		if (add_entry(path, '0', file_length, mktime(&p_statbuf->tm), NULL) != 0)
+			goto out;
+		for (i = 0; file_length > 0; i += nb) {
+			lsn = p_statbuf->lsn + (lsn_t)i;
+			nb = (size_t)((file_length + ISO_BLOCKSIZE - 1) / ISO_BLOCKSIZE);
+			if (nb > BUFFER_SIZE / ISO_BLOCKSIZE)
+				nb = BUFFER_SIZE / ISO_BLOCKSIZE;
+			if (iso9660_iso_seek_read(p_iso, buf, lsn, (long)nb) != (long)(nb * ISO_BLOCKSIZE)) {
+				fprintf(stderr, "Error reading ISO9660 file %s at LSN %lu\n", path, (unsigned long)lsn);
+				goto out;
+			}
+			rd = (file_length < BUFFER_SIZE) ? file_length : BUFFER_SIZE;
+			if (tar_data(buf, (size_t)rd, p_statbuf->total_size) != 0)
+				goto out;
+			file_length -= rd;
+			stats.nb_bytes += rd;
+		}
+		if (tar_data(NULL, 0, p_statbuf->total_size) != 0)
+			goto out;
+		stats.data_time += get_time() - t;
+	}
+	r = 0;
+
+out:
+	iso9660_filelist_free(p_entlist);
+	return r;
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-t] [-i] [-j] [-r] IMAGE\n"
+		"  -t  Stream the image content to stdout as a tar archive (default: discard)\n"
+		"  -i  Use ISO9660 even if the image is UDF\n"
+		"  -j  Disable Joliet\n"
+		"  -r  Disable Rock Ridge\n", name);
+}
+
+int main(int argc, char** argv)
+{
+	int c, r = 1, force_iso = 0, enable_joliet = 1;
+	uint8_t iso_extension_mask = ISO_EXTENSION_ALL;
+	const char* type = "ISO9660";
+	iso9660_t* p_iso = NULL;
+	udf_t* p_udf = NULL;
+	udf_dirent_t* p_udf_root;
+	double t, total_time;
+
+	while ((c = getopt(argc, argv, "tijrh")) != -1) {
+		switch (c) {
+		case 't':
+			tar_fd = stdout;
+			break;
+		case 'i':
+			force_iso = 1;
+			break;
+		case 'j':
+			enable_joliet = 0;
+			break;
+		case 'r':
+			enable_rockridge = 0;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (tar_fd != NULL && isatty(fileno(tar_fd))) {
+		fprintf(stderr, "Not writing a tar archive to a terminal\n");
+		return 1;
+	}
+
+	buf = malloc(BUFFER_SIZE);
+	if (buf == NULL)
+		return 1;
+	if (tar_fd != NULL)
+		setvbuf(tar_fd, NULL, _IOFBF, 1024 * 1024);
+
+	t = get_time();
+	// Same order as ExtractISO(): try UDF first, then fall back to ISO9660
+	if (!force_iso)
+		p_udf = udf_open(argv[optind]);
+	if (p_udf != NULL) {
+		type = "UDF";
+		p_udf_root = udf_get_root(p_udf, true, 0);
+		if (p_udf_root == NULL) {
+			fprintf(stderr, "Could not locate UDF root directory\n");
+			goto out;
+		}
+		stats.dir_time += get_time() - t;
+		if (udf_walk(p_udf_root, "") != 0)
+			goto out;
+	} else {
+		// As with the Rufus scan, Rock Ridge takes precedence over Joliet
+		if (!enable_joliet || enable_rockridge)
+			iso_extension_mask &= ~ISO_EXTENSION_JOLIET;
+		if (!enable_rockridge)
+			iso_extension_mask &= ~ISO_EXTENSION_ROCK_RIDGE;
+		p_iso = iso9660_open_ext(argv[optind], iso_extension_mask);
+		if (p_iso == NULL) {
+			fprintf(stderr, "'%s' doesn't look like an ISO image\n", argv[optind]);
+			goto out;
+		}
+		joliet_level = iso9660_ifs_get_joliet_level(p_iso);
+		stats.dir_time += get_time() - t;
+		if (iso_walk(p_iso, "") != 0)
+			goto out;
+	}
+	if (tar_fd != NULL) {
+		// End of archive marker
+		if (fwrite(zero, 1, sizeof(zero), tar_fd) != sizeof(zero) || fflush(tar_fd) != 0) {
+			fprintf(stderr, "Could not write tar archive\n");
+			goto out;
+		}
+	}
+	r = 0;
+
+out:
+	total_time = get_time() - t;
+	fprintf(stderr, "%s image: %llu directories, %llu files, %.1f MB\n", type,
+		(unsigned long long)stats.nb_dirs, (unsigned long long)stats.nb_files, stats.nb_bytes / (1024.0 * 1024.0));
+	fprintf(stderr, "Directory parsing: %.3f s\n", stats.dir_time);
+	fprintf(stderr, "File data:         %.3f s\n", stats.data_time);
+	if (total_time > 0)
+		fprintf(stderr, "Total:             %.3f s (%.0f files/s, %.1f MB/s)\n", total_time,
+			stats.nb_files / total_time, stats.nb_bytes / (1024.0 * 1024.0) / total_time);
+	iso9660_close(p_iso);
+	udf_close(p_udf);
+	free(buf);
+	return r;
+}
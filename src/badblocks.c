@@ -231,6 +231,7 @@ static int cur_op;
 /* Abort test if more than this number of bad blocks has been encountered */
 static unsigned int max_bb = BB_BAD_BLOCKS_THRESHOLD;
 static blk64_t currently_testing = 0;
+static blk64_t currently_writing = 0, currently_reading = 0;
 static blk64_t num_blocks = 0;
 static uint32_t num_read_errors = 0;
 static uint32_t num_write_errors = 0;
@@ -310,7 +311,9 @@ static void print_status(void)
 				num_read_errors,
 				num_write_errors,
 				num_corruption_errors);
-	percent = (percent/2.0f) + ((cur_op==OP_READ)? 50.0f : 0.0f);
+	/* Writes and reads may be interleaved, so use both positions for the overall progress */
+	percent = (calc_percent((unsigned long) currently_writing, (unsigned long) num_blocks) +
+		   calc_percent((unsigned long) currently_reading, (unsigned long) num_blocks)) / 2.0f;
 	UpdateProgress(OP_BADBLOCKS, (((cur_pattern-1)*100.0f) + percent) / nr_pattern);
 }
 
@@ -349,17 +352,51 @@ static void pattern_fill(unsigned char *buffer, unsigned int pattern,
 			pattern = pattern >> 8;
 		}
 		nb = i ? (i-1) : 0;
-		for (ptr = buffer, i = nb; ptr < buffer + n; ptr++) {
-			*ptr = bpattern[i];
-			if (i == 0)
-				i = nb;
-			else
-				i--;
-		}
+		/* Lay down a single period, then let memcpy() double it up to the buffer size */
+		for (ptr = buffer, i = nb; ptr < buffer + min(n, nb + 1); ptr++)
+			*ptr = bpattern[i--];
+		for (i = nb + 1; i < n; i *= 2)
+			memcpy(buffer + i, buffer, min(i, n - i));
 		cur_pattern++;
 	}
 }
 
+/*
+ * Event for the synchronous requests we issue while others may still be queued,
+ * so that waiting for them doesn't depend on the device handle being signaled.
+ */
+static HANDLE sync_event = NULL;
+
+/*
+ * Synchronous positional I/O. Unlike read_sectors() and write_sectors(), which
+ * rely on the file pointer, this works with the overlapped handle we are given.
+ * Returns the number of bytes transferred or -1 on error.
+ */
+static int64_t bb_io(HANDLE hDrive, int op, unsigned char *buffer, uint64_t nb_blocks,
+		     uint64_t block_size, blk64_t block)
+{
+	OVERLAPPED overlapped = { 0 };
+	uint64_t offset = block * block_size;
+	DWORD size = 0;
+	BOOL r;
+
+	if (nb_blocks * block_size > 0xFFFFFFFFUL)
+		return -1;
+	overlapped.Offset = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	overlapped.hEvent = sync_event;
+	if (op == OP_WRITE)
+		r = WriteFile(hDrive, buffer, (DWORD)(nb_blocks * block_size), NULL, &overlapped);
+	else
+		r = ReadFile(hDrive, buffer, (DWORD)(nb_blocks * block_size), NULL, &overlapped);
+	if ((!r && (GetLastError() != ERROR_IO_PENDING)) || !GetOverlappedResult(hDrive, &overlapped, &size, TRUE)) {
+		uprintf("%s%s error at block %llu: %s\n", bb_prefix, (op == OP_WRITE) ? "Write" : "Read",
+			(unsigned long long)block, WindowsErrorString());
+		return -1;
+	}
+	return (int64_t)size;
+}
+
 /*
  * Perform a read of a sequence of blocks; return the number of blocks
  *    successfully sequentially read.
@@ -373,7 +410,7 @@ static int64_t do_read (HANDLE hDrive, unsigned char * buffer, uint64_t tryout,
 		print_status();
 
 	/* Try the read */
-	got = read_sectors(hDrive, block_size, current_block, tryout, buffer);
+	got = bb_io(hDrive, OP_READ, buffer, tryout, block_size, current_block);
 	if (got < 0)
 		got = 0;
 	if (got & 511)
@@ -395,7 +432,7 @@ static int64_t do_write(HANDLE hDrive, unsigned char * buffer, uint64_t tryout,
 		print_status();
 
 	/* Try the write */
-	got = write_sectors(hDrive, block_size, current_block, tryout, buffer);
+	got = bb_io(hDrive, OP_WRITE, buffer, tryout, block_size, current_block);
 	if (got < 0)
 		got = 0;
 	if (got & 511)
@@ -404,17 +441,96 @@ static int64_t do_write(HANDLE hDrive, unsigned char * buffer, uint64_t tryout,
 	return got;
 }
 
+/*
+ * Asynchronous I/O slot. Each slot owns an overlapped request and its buffers,
+ * so that up to BB_QUEUE_DEPTH reads and writes can be in flight at once.
+ */
+typedef struct {
+	OVERLAPPED overlapped;
+	unsigned char *write_buffer;
+	unsigned char *read_buffer;
+	blk64_t block;
+	blk64_t count;
+	int op;
+	BOOL queued;
+} bb_slot;
+
+static void bb_submit(HANDLE hDrive, BOOL queued_io, bb_slot *slot, int op,
+		      blk64_t block, blk64_t count, size_t block_size)
+{
+	HANDLE hEvent = slot->overlapped.hEvent;
+	uint64_t offset = block * block_size;
+
+	memset(&slot->overlapped, 0, sizeof(slot->overlapped));
+	slot->overlapped.hEvent = hEvent;
+	slot->overlapped.Offset = (DWORD)offset;
+	slot->overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	slot->op = op;
+	slot->block = block;
+	slot->count = count;
+
+	/* No queued I/O -> fall back to synchronous I/O */
+	if (!queued_io) {
+		slot->overlapped.InternalHigh = (ULONG_PTR)block_size * ((op == OP_WRITE) ?
+			do_write(hDrive, slot->write_buffer, count, block_size, block) :
+			do_read(hDrive, slot->read_buffer, count, block_size, block));
+		slot->queued = FALSE;
+		return;
+	}
+
+	if (op == OP_WRITE)
+		slot->queued = WriteFile(hDrive, slot->write_buffer, (DWORD)(count * block_size), NULL, &slot->overlapped);
+	else
+		slot->queued = ReadFile(hDrive, slot->read_buffer, (DWORD)(count * block_size), NULL, &slot->overlapped);
+	if (!slot->queued)
+		slot->queued = (GetLastError() == ERROR_IO_PENDING);
+	if (!slot->queued)
+		slot->overlapped.InternalHigh = 0;
+}
+
+/* Wait for a slot's I/O and return the number of blocks that were transferred */
+static blk64_t bb_complete(HANDLE hDrive, bb_slot *slot, size_t block_size)
+{
+	DWORD size = 0;
+
+	if (!slot->queued)
+		return (blk64_t)slot->overlapped.InternalHigh / block_size;
+	slot->queued = FALSE;
+	if (!GetOverlappedResult(hDrive, &slot->overlapped, &size, TRUE))
+		size = 0;
+	return size / block_size;
+}
+
+/* Set the data we expect to find on the media for a slot, into its write buffer */
+static void bb_set_expected(bb_slot *slot, const unsigned char *pattern_buffer, size_t block_size,
+			    blk64_t block, blk64_t count, BOOL stamp, size_t id_offset)
+{
+	blk64_t i, *blk_id;
+
+	if (!stamp)
+		return;
+	/* Add the block number at a fixed (random) offset during each pass to allow
+	   for the detection of 'fake' media (eg. 2GB USB masquerading as 16GB) */
+	memcpy(slot->write_buffer, pattern_buffer, (size_t)(count * block_size));
+	for (i = 0; i < count; i++) {
+		blk_id = (blk64_t*)(intptr_t)(slot->write_buffer + id_offset + i * block_size);
+		*blk_id = block + i;
+	}
+}
+
 static unsigned int test_rw(HANDLE hDrive, blk64_t last_block, size_t block_size, blk64_t first_block,
 							size_t blocks_at_once, int pattern_type, int nb_passes)
 {
 	const unsigned int pattern[BADLOCKS_PATTERN_TYPES][BADBLOCK_PATTERN_COUNT] =
 		{ BADBLOCK_PATTERN_ONE_PASS, BADBLOCK_PATTERN_TWO_PASSES, BADBLOCK_PATTERN_SLC,
 		  BADCLOCK_PATTERN_MLC, BADBLOCK_PATTERN_TLC };
-	unsigned char *buffer = NULL, *read_buffer;
-	int i, pat_idx;
+	unsigned char *buffer = NULL, *pattern_buffer;
+	int i, pat_idx, head, nr_queued = 0, depth = BB_QUEUE_DEPTH;
 	unsigned int bb_count = 0;
-	blk64_t got, tryout, recover_block = ~0, *blk_id;
-	size_t id_offset = 0;
+	blk64_t b, got, lag, slot_blocks, write_next, write_done, read_next, read_done;
+	size_t id_offset = 0, slot_size;
+	BOOL stamp, queued_io = TRUE;
+	bb_slot slot[BB_QUEUE_DEPTH] = { 0 }, *s;
 
 	if ((pattern_type < 0) || (pattern_type >= BADLOCKS_PATTERN_TYPES)) {
 		uprintf("%sInvalid pattern type\n", bb_prefix);
@@ -432,13 +548,37 @@ static unsigned int test_rw(HANDLE hDrive, blk64_t last_block, size_t block_size
 		return 0;
 	}
 
-	buffer = allocate_buffer(2 * blocks_at_once * block_size);
+	/*
+	 * The caller opens the drive for overlapped I/O, so that we can queue requests.
+	 * Each queued request needs its own event, and if we can't get these, we issue
+	 * one synchronous request at a time, of the full 'blocks_at_once' size.
+	 */
+	sync_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+	for (i = 0; i < BB_QUEUE_DEPTH; i++) {
+		slot[i].overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+		if (slot[i].overlapped.hEvent == NULL)
+			queued_io = FALSE;
+	}
+	if ((sync_event == NULL) || !queued_io) {
+		uprintf("%sCould not set up asynchronous I/O - falling back to synchronous\n", bb_prefix);
+		queued_io = FALSE;
+		depth = 1;
+	}
+
+	/* Split our usual buffer between the slots, so that we don't use more RAM */
+	slot_blocks = max(blocks_at_once / depth, 1);
+	slot_size = (size_t)(slot_blocks * block_size);
+	buffer = allocate_buffer((2 * depth + 1) * slot_size);
 	if (!buffer) {
 		uprintf("%sError while allocating buffers\n", bb_prefix);
 		cancel_ops = -1;
-		return 0;
+		goto out;
+	}
+	pattern_buffer = buffer + 2 * depth * slot_size;
+	for (i = 0; i < depth; i++) {
+		slot[i].write_buffer = buffer + 2 * i * slot_size;
+		slot[i].read_buffer = slot[i].write_buffer + slot_size;
 	}
-	read_buffer = buffer + blocks_at_once * block_size;
 
 	uprintf("%sChecking from block %lu to %lu (1 block = %s)\n", bb_prefix,
 		(unsigned long) first_block, (unsigned long) last_block - 1,
@@ -449,20 +589,32 @@ static unsigned int test_rw(HANDLE hDrive, blk64_t last_block, size_t block_size
 	for (pat_idx = 0; pat_idx < nb_passes; pat_idx++) {
 		if (cancel_ops)
 			goto out;
-		if (detect_fakes && (pat_idx == 0)) {
+		stamp = (detect_fakes && (pat_idx == 0));
+		if (stamp) {
 			srand((unsigned int)GetTickCount64());
 			id_offset = rand() * (block_size - sizeof(blk64_t)) / RAND_MAX;
 			uprintf("%sUsing offset %zu for fake device check\n", bb_prefix, id_offset);
 		}
 		// coverity[dont_call]
-		pattern_fill(buffer, pattern[pattern_type][pat_idx], blocks_at_once * block_size);
-		num_blocks = last_block - 1;
-		currently_testing = first_block;
+		pattern_fill(pattern_buffer, pattern[pattern_type][pat_idx], slot_size);
+		for (i = 0; i < depth; i++)
+			memcpy(slot[i].write_buffer, pattern_buffer, slot_size);
+		num_blocks = last_block;
+		currently_testing = currently_writing = currently_reading = first_block;
 		if (s_flag | v_flag)
-			uprintf("%sWriting test pattern 0x%02X\n", bb_prefix, pattern[pattern_type][pat_idx]);
+			uprintf("%sWriting and verifying test pattern 0x%02X\n", bb_prefix, pattern[pattern_type][pat_idx]);
 		cur_op = OP_WRITE;
-		tryout = blocks_at_once;
-		while (currently_testing < last_block) {
+
+		/*
+		 * Reads trail the writes by at least 'lag' blocks, so that the device is kept busy
+		 * with both, while making sure that what we read back comes from the media rather
+		 * than from a cache. For fake device detection, everything must have been written
+		 * before we start reading, so that wraparound of the address space can be caught.
+		 */
+		lag = stamp ? last_block : max(BB_VERIFY_LAG / block_size, depth * slot_blocks);
+		write_next = write_done = read_next = read_done = first_block;
+		head = 0;
+		while (read_done < last_block) {
 			if (cancel_ops)
 				goto out;
 			if (max_bb && bb_count >= max_bb) {
@@ -474,86 +626,68 @@ static unsigned int test_rw(HANDLE hDrive, blk64_t last_block, size_t block_size
 				cancel_ops = -1;
 				goto out;
 			}
-			if (currently_testing + tryout > last_block)
-				tryout = last_block - currently_testing;
-			if (detect_fakes && (pat_idx == 0)) {
-				/* Add the block number at a fixed (random) offset during each pass to
-				   allow for the detection of 'fake' media (eg. 2GB USB masquerading as 16GB) */
-				for (i=0; i<(int)blocks_at_once; i++) {
-					blk_id = (blk64_t*)(intptr_t)(buffer + id_offset+ i*block_size);
-					*blk_id = (blk64_t)(currently_testing + i);
-				}
-			}
-			got = do_write(hDrive, buffer, tryout, block_size, currently_testing);
-			if (v_flag > 1)
-				print_status();
 
-			if (got == 0 && tryout == 1)
-				bb_count += bb_output(currently_testing++, WRITE_ERROR);
-			currently_testing += got;
-			if (got != tryout) {
-				tryout = 1;
-				if (recover_block == ~0)
-					recover_block = currently_testing -
-						got + blocks_at_once;
-				continue;
-			} else if (currently_testing == recover_block) {
-				tryout = blocks_at_once;
-				recover_block = ~0;
+			/* Keep the queue full */
+			while (nr_queued < depth) {
+				s = &slot[(head + nr_queued) % depth];
+				if ((read_next < write_done) && ((write_done >= last_block) || (write_done - read_next >= lag))) {
+					got = min(slot_blocks, write_done - read_next);
+					bb_set_expected(s, pattern_buffer, block_size, read_next, got, stamp, id_offset);
+					bb_submit(hDrive, queued_io, s, OP_READ, read_next, got, block_size);
+					read_next += got;
+				} else if (write_next < last_block) {
+					got = min(slot_blocks, last_block - write_next);
+					bb_set_expected(s, pattern_buffer, block_size, write_next, got, stamp, id_offset);
+					bb_submit(hDrive, queued_io, s, OP_WRITE, write_next, got, block_size);
+					write_next += got;
+				} else {
+					break;
+				}
+				nr_queued++;
 			}
-		}
-
-		num_blocks = 0;
-		if (s_flag | v_flag)
-			uprintf("%sReading and comparing\n", bb_prefix);
-		cur_op = OP_READ;
-		num_blocks = last_block;
-		currently_testing = first_block;
+			if (nr_queued == 0)
+				break;
 
-		tryout = blocks_at_once;
-		while (currently_testing < last_block) {
-			if (cancel_ops) goto out;
-			if (max_bb && bb_count >= max_bb) {
-				if (s_flag || v_flag) {
-					uprintf(abort_msg);
-					fprintf(log_fd, "%s", abort_msg);
-					fflush(log_fd);
+			/* Requests are retired in submission order */
+			s = &slot[head];
+			got = bb_complete(hDrive, s, block_size);
+			head = (head + 1) % depth;
+			nr_queued--;
+
+			if (s->op == OP_WRITE) {
+				/* Retry whatever didn't make it, one block at a time */
+				for (b = s->block + got; b < s->block + s->count; b++) {
+					if (do_write(hDrive, s->write_buffer + (b - s->block) * block_size, 1, block_size, b) == 0)
+						bb_count += bb_output(b, WRITE_ERROR);
 				}
-				cancel_ops = -1;
-				goto out;
-			}
-			if (currently_testing + tryout > last_block)
-				tryout = last_block - currently_testing;
-			if (detect_fakes && (pat_idx == 0)) {
-				for (i=0; i<(int)blocks_at_once; i++) {
-					blk_id = (blk64_t*)(intptr_t)(buffer + id_offset+ i*block_size);
-					*blk_id = (blk64_t)(currently_testing + i);
+				write_done = s->block + s->count;
+				currently_writing = write_done;
+				if (cur_op == OP_WRITE)
+					currently_testing = write_done;
+			} else {
+				for (b = s->block + got; b < s->block + s->count; b++) {
+					if (do_read(hDrive, s->read_buffer + (b - s->block) * block_size, 1, block_size, b) == 0) {
+						bb_count += bb_output(b, READ_ERROR);
+						/* Don't report the same block as corrupted */
+						memcpy(s->read_buffer + (b - s->block) * block_size,
+						       (stamp ? s->write_buffer : pattern_buffer) + (b - s->block) * block_size, block_size);
+					}
 				}
-			}
-			got = do_read(hDrive, read_buffer, tryout, block_size,
-				       currently_testing);
-			if (got == 0 && tryout == 1)
-				bb_count += bb_output(currently_testing++, READ_ERROR);
-			currently_testing += got;
-			if (got != tryout) {
-				tryout = 1;
-				if (recover_block == ~0)
-					recover_block = currently_testing -
-						got + blocks_at_once;
-				continue;
-			} else if (currently_testing == recover_block) {
-				tryout = blocks_at_once;
-				recover_block = ~0;
-			}
-			for (i=0; i < got; i++) {
-				if (memcmp(read_buffer + i * block_size,
-					   buffer + i * block_size,
-					   block_size)) {
-					if_not_assert(currently_testing * block_size < 1 * PB) 
-						goto out;
-					// coverity[overflow_const]
-					bb_count += bb_output(currently_testing+i-got, CORRUPTION_ERROR);
+				/* Compare the whole request at once, and only look at individual blocks on mismatch */
+				if (memcmp(s->read_buffer, stamp ? s->write_buffer : pattern_buffer, (size_t)(s->count * block_size)) != 0) {
+					for (b = 0; b < s->count; b++) {
+						if (memcmp(s->read_buffer + b * block_size,
+							   (stamp ? s->write_buffer : pattern_buffer) + b * block_size, block_size)) {
+							if_not_assert((s->block + b) * block_size < 1 * PB)
+								goto out;
+							bb_count += bb_output(s->block + b, CORRUPTION_ERROR);
+						}
+					}
 				}
+				read_done = s->block + s->count;
+				currently_reading = read_done;
+				cur_op = OP_READ;
+				currently_testing = read_done;
 			}
 			if (v_flag > 1)
 				print_status();
@@ -562,7 +696,17 @@ static unsigned int test_rw(HANDLE hDrive, blk64_t last_block, size_t block_size
 		num_blocks = 0;
 	}
 out:
-	free_buffer(buffer);
+	/* Don't release buffers the device may still be writing to */
+	if (nr_queued > 0)
+		CancelIoEx(hDrive, NULL);
+	for (i = 0; i < BB_QUEUE_DEPTH; i++) {
+		if (slot[i].queued)
+			bb_complete(hDrive, &slot[i], block_size);
+		safe_closehandle(slot[i].overlapped.hEvent);
+	}
+	safe_closehandle(sync_event);
+	if (buffer != NULL)
+		free_buffer(buffer);
 	return bb_count;
 }
 
@@ -36,6 +36,8 @@ typedef struct bb_struct_u64_iterate      *bb_u64_iterate;
 #define BB_BAD_BLOCKS_THRESHOLD           256
 #define BB_BLOCKS_AT_ONCE                 64
 #define BB_SYS_PAGE_SIZE                  4096
+#define BB_QUEUE_DEPTH                    4
+#define BB_VERIFY_LAG                     (1 * GB)
 
 enum error_types { READ_ERROR, WRITE_ERROR, CORRUPTION_ERROR };
 enum op_type { OP_READ, OP_WRITE };
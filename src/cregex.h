@@ -125,6 +125,25 @@ int cregex_program_run(const cregex_program_t *program,
                        const char **matches,
                        int nmatches);
 
+/* Reusable match context for a program, which avoids allocating memory on
+ * every run and only runs the VM to resolve captures once a match has been
+ * found through a lazily built DFA. nmatches may be 0 if no captures are
+ * needed. The program must outlive the context.
+ */
+typedef struct cregex_context cregex_context_t;
+
+/* Create a match context for program */
+cregex_context_t *cregex_context_create(const cregex_program_t *program);
+
+/* Run program on string, using context */
+int cregex_context_run(cregex_context_t *context,
+                       const char *string,
+                       const char **matches,
+                       int nmatches);
+
+/* Free a match context */
+void cregex_context_free(cregex_context_t *context);
+
 /* Compile a parsed pattern */
 cregex_program_t *cregex_compile_node(const cregex_node_t *root);
 
@@ -34,6 +34,23 @@ typedef struct {
     vm_thread *threads;
 } vm_thread_list;
 
+/* Whether a character instruction accepts ch */
+static inline int vm_instr_matches(const cregex_program_instr_t *pc, char ch)
+{
+    switch (pc->opcode) {
+    case REGEX_PROGRAM_OPCODE_CHARACTER:
+        return ch == pc->ch;
+    case REGEX_PROGRAM_OPCODE_ANY_CHARACTER:
+        return ch != 0;
+    case REGEX_PROGRAM_OPCODE_CHARACTER_CLASS:
+        return cregex_char_class_contains(pc->klass, ch);
+    case REGEX_PROGRAM_OPCODE_CHARACTER_CLASS_NEGATED:
+        return !cregex_char_class_contains(pc->klass, ch);
+    default:
+        return 0;
+    }
+}
+
 static void vm_add_thread(vm_thread_list *list,
                           const cregex_program_t *program,
                           const cregex_program_instr_t *pc,
@@ -152,19 +169,10 @@ static int vm_run_with_threads(const cregex_program_t *program,
 
             /* Characters */
             case REGEX_PROGRAM_OPCODE_CHARACTER:
-                if (*sp == thread->pc->ch)
-                    break;
-                continue;
             case REGEX_PROGRAM_OPCODE_ANY_CHARACTER:
-                if (*sp)
-                    break;
-                continue;
             case REGEX_PROGRAM_OPCODE_CHARACTER_CLASS:
-                if (cregex_char_class_contains(thread->pc->klass, *sp))
-                    break;
-                continue;
             case REGEX_PROGRAM_OPCODE_CHARACTER_CLASS_NEGATED:
-                if (!cregex_char_class_contains(thread->pc->klass, *sp))
+                if (vm_instr_matches(thread->pc, *sp))
                     break;
                 continue;
 
@@ -209,3 +217,260 @@ int cregex_program_run(const cregex_program_t *program,
 {
     return vm_run(program, string, matches, nmatches);
 }
+
+/* A match context caches, for a given program, the thread lists of the VM as
+ * well as a lazily built DFA. Each DFA state is the set of character (and
+ * match/end assertion) instructions that the VM threads can be waiting on,
+ * which is all we need to tell whether a string matches, without tracking
+ * captures. The VM is then only run on strings that we know do match, to
+ * resolve the capture groups.
+ */
+#define DFA_MAX_STATES 64
+
+#define DFA_STATE_MATCH     0x01 /* state contains a match instruction */
+#define DFA_STATE_END_MATCH 0x02 /* state matches if at end of string */
+
+typedef struct {
+    int npcs;
+    int *pcs; /* sorted instruction indexes */
+    int at_begin; /* start state, where begin assertions hold */
+    int flags;
+    int next[UCHAR_MAX + 1]; /* -1 if not computed yet */
+} dfa_state;
+
+struct cregex_context {
+    const cregex_program_t *program;
+    vm_thread *threads;
+    int nstates;
+    dfa_state *states;
+    int *pcs;   /* DFA_MAX_STATES * ninstructions, for the state sets */
+    int *stack; /* 3 * ninstructions, used to compute closures */
+    int *seeds; /* ninstructions, copy of the initial closure stack */
+    int *set;   /* ninstructions, closure at the end of string */
+    int *mark;  /* ninstructions, last generation an instruction was added */
+    int generation;
+};
+
+/* Add the instructions reachable from the ones on the stack (without consuming
+ * any character) to set, and return the new size of set.
+ */
+static int dfa_closure(cregex_context_t *context,
+                       int nstack,
+                       int at_begin,
+                       int at_end,
+                       int *set)
+{
+    const cregex_program_instr_t *instructions =
+        context->program->instructions;
+    int nset = 0;
+
+    while (nstack > 0) {
+        int pc = context->stack[--nstack];
+        int next[2], nnext = 0;
+
+        if (context->mark[pc] == context->generation)
+            continue;
+        context->mark[pc] = context->generation;
+
+        switch (instructions[pc].opcode) {
+        case REGEX_PROGRAM_OPCODE_MATCH:
+        case REGEX_PROGRAM_OPCODE_CHARACTER:
+        case REGEX_PROGRAM_OPCODE_ANY_CHARACTER:
+        case REGEX_PROGRAM_OPCODE_CHARACTER_CLASS:
+        case REGEX_PROGRAM_OPCODE_CHARACTER_CLASS_NEGATED:
+            set[nset++] = pc;
+            break;
+        case REGEX_PROGRAM_OPCODE_SPLIT:
+            next[nnext++] = (int)(instructions[pc].second - instructions);
+            next[nnext++] = (int)(instructions[pc].first - instructions);
+            break;
+        case REGEX_PROGRAM_OPCODE_JUMP:
+            next[nnext++] = (int)(instructions[pc].target - instructions);
+            break;
+        case REGEX_PROGRAM_OPCODE_ASSERT_BEGIN:
+            if (at_begin)
+                next[nnext++] = pc + 1;
+            break;
+        case REGEX_PROGRAM_OPCODE_ASSERT_END:
+            if (at_end)
+                next[nnext++] = pc + 1;
+            else
+                set[nset++] = pc;
+            break;
+        case REGEX_PROGRAM_OPCODE_SAVE:
+            next[nnext++] = pc + 1;
+            break;
+        }
+        while (nnext > 0)
+            context->stack[nstack++] = next[--nnext];
+    }
+    return nset;
+}
+
+static int dfa_compare_pcs(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/* Return the index of the state for the instructions on the stack, adding it
+ * to the cache as needed, or -1 if the cache is full.
+ */
+static int dfa_get_state(cregex_context_t *context, int nstack, int at_begin)
+{
+    int ninstructions = context->program->ninstructions;
+    int *set = context->pcs + context->nstates * ninstructions;
+    dfa_state *state;
+    int nset, i;
+
+    if (context->nstates >= DFA_MAX_STATES)
+        return -1;
+
+    /* keep a copy of the stack to check for a match at the end of string */
+    memcpy(context->seeds, context->stack, sizeof(int) * nstack);
+
+    context->generation++;
+    nset = dfa_closure(context, nstack, at_begin, 0, set);
+    qsort(set, nset, sizeof(int), dfa_compare_pcs);
+
+    for (i = 0; i < context->nstates; i++) {
+        if (context->states[i].at_begin == at_begin &&
+            context->states[i].npcs == nset &&
+            memcmp(context->states[i].pcs, set, sizeof(int) * nset) == 0)
+            return i;
+    }
+
+    state = &context->states[context->nstates];
+    state->npcs = nset;
+    state->pcs = set;
+    state->at_begin = at_begin;
+    state->flags = 0;
+    memset(state->next, -1, sizeof(state->next));
+    for (i = 0; i < nset; i++) {
+        if (context->program->instructions[set[i]].opcode ==
+            REGEX_PROGRAM_OPCODE_MATCH)
+            state->flags |= DFA_STATE_MATCH;
+    }
+
+    /* the closure at the end of string lets end assertions through */
+    memcpy(context->stack, context->seeds, sizeof(int) * nstack);
+    context->generation++;
+    nset = dfa_closure(context, nstack, at_begin, 1, context->set);
+    for (i = 0; i < nset; i++) {
+        if (context->program->instructions[context->set[i]].opcode ==
+            REGEX_PROGRAM_OPCODE_MATCH)
+            state->flags |= DFA_STATE_END_MATCH;
+    }
+
+    return context->nstates++;
+}
+
+/* Compute the transition from state on ch */
+static int dfa_get_next(cregex_context_t *context, int state, char ch)
+{
+    const cregex_program_instr_t *instructions =
+        context->program->instructions;
+    int nstack = 0;
+
+    for (int i = 0; i < context->states[state].npcs; i++) {
+        int pc = context->states[state].pcs[i];
+        if (vm_instr_matches(&instructions[pc], ch))
+            context->stack[nstack++] = pc + 1;
+    }
+    return dfa_get_state(context, nstack, 0);
+}
+
+static void dfa_reset(cregex_context_t *context)
+{
+    context->nstates = 0;
+    context->stack[0] = 0;
+    dfa_get_state(context, 1, 1);
+}
+
+/* Returns 1 if string matches, 0 if not, or -1 if the DFA cache is too small
+ * for this program and string.
+ */
+static int dfa_run(cregex_context_t *context, const char *string)
+{
+    int state = 0, next;
+
+    for (const char *sp = string;; ++sp) {
+        if (context->states[state].flags & DFA_STATE_MATCH)
+            return 1;
+        if (!*sp)
+            return (context->states[state].flags & DFA_STATE_END_MATCH) ? 1 : 0;
+        if (context->states[state].npcs == 0)
+            return 0;
+        next = context->states[state].next[(unsigned char)*sp];
+        if (next < 0) {
+            next = dfa_get_next(context, state, *sp);
+            if (next < 0) {
+                /* start over with an empty cache on the next run */
+                dfa_reset(context);
+                return -1;
+            }
+            context->states[state].next[(unsigned char)*sp] = next;
+        }
+        state = next;
+    }
+}
+
+cregex_context_t *cregex_context_create(const cregex_program_t *program)
+{
+    cregex_context_t *context = calloc(1, sizeof(cregex_context_t));
+    int ninstructions = program->ninstructions;
+
+    if (!context)
+        return NULL;
+    context->program = program;
+    context->threads = malloc(sizeof(vm_thread) * vm_estimate_threads(program));
+    context->states = malloc(sizeof(dfa_state) * DFA_MAX_STATES);
+    context->pcs = malloc(sizeof(int) * DFA_MAX_STATES * ninstructions);
+    /* each instruction is processed once, and pushes at most two others */
+    context->stack = malloc(sizeof(int) * 3 * ninstructions);
+    context->seeds = malloc(sizeof(int) * ninstructions);
+    context->set = malloc(sizeof(int) * ninstructions);
+    context->mark = calloc(ninstructions, sizeof(int));
+    if (!context->threads || !context->states || !context->pcs ||
+        !context->stack || !context->seeds || !context->set ||
+        !context->mark) {
+        cregex_context_free(context);
+        return NULL;
+    }
+    dfa_reset(context);
+    return context;
+}
+
+int cregex_context_run(cregex_context_t *context,
+                       const char *string,
+                       const char **matches,
+                       int nmatches)
+{
+    const char *unused[1];
+    int matched = dfa_run(context, string);
+
+    if (matched == 0 && nmatches > 0)
+        memset(matches, 0, sizeof(char *) * nmatches);
+    if (matched == 0 || (matched > 0 && nmatches <= 0))
+        return matched;
+    /* the DFA could not tell, so the VM still needs somewhere to save to */
+    if (nmatches <= 0) {
+        matches = unused;
+        nmatches = 1;
+    }
+    return vm_run_with_threads(context->program, string, matches, nmatches,
+                               context->threads);
+}
+
+void cregex_context_free(cregex_context_t *context)
+{
+    if (!context)
+        return;
+    free(context->threads);
+    free(context->states);
+    free(context->pcs);
+    free(context->stack);
+    free(context->seeds);
+    free(context->set);
+    free(context->mark);
+    free(context);
+}
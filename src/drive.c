@@ -131,7 +131,7 @@ BOOL GetAutoMount(BOOL* enabled)
  * Open a drive or volume with optional write and lock access
  * Return INVALID_HANDLE_VALUE (/!\ which is DIFFERENT from NULL /!\) on failure.
  */
-static HANDLE GetHandle(char* Path, BOOL bLockDrive, BOOL bWriteAccess, BOOL bWriteShare)
+static HANDLE GetHandle(char* Path, BOOL bLockDrive, BOOL bWriteAccess, BOOL bWriteShare, DWORD dwFlags)
 {
 	int i;
 	BYTE access_mask = 0;
@@ -156,7 +156,7 @@ static HANDLE GetHandle(char* Path, BOOL bLockDrive, BOOL bWriteAccess, BOOL bWr
 		// required for enumeration.
 		hDrive = CreateFileA(Path, GENERIC_READ|(bWriteAccess?GENERIC_WRITE:0),
 			FILE_SHARE_READ|(bWriteShare?FILE_SHARE_WRITE:0),
-			NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | dwFlags, NULL);
 		if (hDrive != INVALID_HANDLE_VALUE)
 			break;
 		if ((GetLastError() != ERROR_SHARING_VIOLATION) && (GetLastError() != ERROR_ACCESS_DENIED))
@@ -227,12 +227,13 @@ out:
 
 /*
  * Return a handle to the physical drive identified by DriveIndex
+ * dwFlags are extra CreateFile() flags, such as FILE_FLAG_OVERLAPPED.
  */
-HANDLE GetPhysicalHandle(DWORD DriveIndex, BOOL bLockDrive, BOOL bWriteAccess, BOOL bWriteShare)
+HANDLE GetPhysicalHandleEx(DWORD DriveIndex, BOOL bLockDrive, BOOL bWriteAccess, BOOL bWriteShare, DWORD dwFlags)
 {
 	HANDLE hPhysical = INVALID_HANDLE_VALUE;
 	char* PhysicalPath = GetPhysicalName(DriveIndex);
-	hPhysical = GetHandle(PhysicalPath, bLockDrive, bWriteAccess, bWriteShare);
+	hPhysical = GetHandle(PhysicalPath, bLockDrive, bWriteAccess, bWriteShare, dwFlags);
 	safe_free(PhysicalPath);
 	return hPhysical;
 }
@@ -1028,7 +1029,7 @@ HANDLE GetLogicalHandle(DWORD DriveIndex, uint64_t PartitionOffset, BOOL bLockDr
 		return NULL;
 	}
 
-	hLogical = GetHandle(LogicalPath, bLockDrive, bWriteAccess, bWriteShare);
+	hLogical = GetHandle(LogicalPath, bLockDrive, bWriteAccess, bWriteShare, 0);
 	free(LogicalPath);
 	return hLogical;
 }
@@ -1044,7 +1045,7 @@ HANDLE AltGetLogicalHandle(DWORD DriveIndex, uint64_t PartitionOffset, BOOL bLoc
 		return NULL;
 	}
 
-	hLogical = GetHandle(LogicalPath, bLockDrive, bWriteAccess, bWriteShare);
+	hLogical = GetHandle(LogicalPath, bLockDrive, bWriteAccess, bWriteShare, 0);
 	free(LogicalPath);
 	return hLogical;
 }
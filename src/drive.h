@@ -371,7 +371,9 @@ BOOL DeletePartition(DWORD DriveIndex, ULONGLONG PartitionOffset, BOOL bSilent);
 BOOL IsVdsAvailable(BOOL bSilent);
 BOOL ListVdsVolumes(BOOL bSilent);
 BOOL VdsRescan(DWORD dwRescanType, DWORD dwSleepTime, BOOL bSilent);
-HANDLE GetPhysicalHandle(DWORD DriveIndex, BOOL bLockDrive, BOOL bWriteAccess, BOOL bWriteShare);
+HANDLE GetPhysicalHandleEx(DWORD DriveIndex, BOOL bLockDrive, BOOL bWriteAccess, BOOL bWriteShare, DWORD dwFlags);
+#define GetPhysicalHandle(DriveIndex, bLockDrive, bWriteAccess, bWriteShare) \
+	GetPhysicalHandleEx(DriveIndex, bLockDrive, bWriteAccess, bWriteShare, 0)
 char* GetLogicalName(DWORD DriveIndex, uint64_t PartitionOffset, BOOL bKeepTrailingBackslash, BOOL bSilent);
 char* AltGetLogicalName(DWORD DriveIndex, uint64_t PartitionOffset, BOOL bKeepTrailingBackslash, BOOL bSilent);
 char* GetExtPartitionName(DWORD DriveIndex, uint64_t PartitionOffset);
@@ -1598,6 +1598,7 @@ DWORD WINAPI FormatThread(void* param)
 	if (IsChecked(IDC_BAD_BLOCKS)) {
 		do {
 			FILE* log_fd;
+			char bb_val[4][12];
 			int sel = ComboBox_GetCurSel(hNBPasses);
 			// create a log file for bad blocks report. Since %USERPROFILE% may
 			// have localized characters, we use the UTF-8 API.
@@ -1618,7 +1619,26 @@ DWORD WINAPI FormatThread(void* param)
 				fflush(log_fd);
 			}
 
-			if (!BadBlocks(hPhysicalDrive, SelectedDrive.DiskSize, (sel >= 2) ? 4 : sel +1, sel, &report, log_fd)) {
+			// The bad blocks check queues its I/O, so it needs an overlapped handle. We
+			// must then get a regular one back, as the sector read/write calls need it.
+			safe_unlockclose(hPhysicalDrive);
+			hPhysicalDrive = GetPhysicalHandleEx(DriveIndex, actual_lock_drive, TRUE, !actual_lock_drive,
+				FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH);
+			if (hPhysicalDrive == INVALID_HANDLE_VALUE) {
+				ErrorStatus = RUFUS_ERROR(ERROR_OPEN_FAILED);
+				fclose(log_fd);
+				DeleteFileU(logfile);
+				goto out;
+			}
+			ret = BadBlocks(hPhysicalDrive, SelectedDrive.DiskSize, (sel >= 2) ? 4 : sel +1, sel, &report, log_fd);
+			safe_unlockclose(hPhysicalDrive);
+			hPhysicalDrive = GetPhysicalHandle(DriveIndex, actual_lock_drive, TRUE, !actual_lock_drive);
+			if (hPhysicalDrive == INVALID_HANDLE_VALUE) {
+				ErrorStatus = RUFUS_ERROR(ERROR_OPEN_FAILED);
+				fclose(log_fd);
+				goto out;
+			}
+			if (!ret) {
 				uprintf("Bad blocks: Check failed.");
 				if (!IS_ERROR(ErrorStatus))
 					ErrorStatus = RUFUS_ERROR(APPERR(ERROR_BADBLOCKS_FAILURE));
@@ -1627,9 +1647,12 @@ DWORD WINAPI FormatThread(void* param)
 				DeleteFileU(logfile);
 				goto out;
 			}
-			uprintf("Bad Blocks: Check completed, %d bad block%s found. (%d/%d/%d errors)",
-				report.bb_count, (report.bb_count==1)?"":"s",
-				report.num_read_errors, report.num_write_errors, report.num_corruption_errors);
+			static_sprintf(bb_val[0], "%u", report.bb_count);
+			static_sprintf(bb_val[1], "%u", report.num_read_errors);
+			static_sprintf(bb_val[2], "%u", report.num_write_errors);
+			static_sprintf(bb_val[3], "%u", report.num_corruption_errors);
+			uprintkv("Bad Blocks: Check completed", "bad_blocks", bb_val[0], "read_errors", bb_val[1],
+				"write_errors", bb_val[2], "corruption_errors", bb_val[3], NULL);
 			r = IDOK;
 			if (report.bb_count) {
 				bb_msg = lmprintf(MSG_011, report.bb_count, report.num_read_errors, report.num_write_errors,
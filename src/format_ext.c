@@ -236,6 +236,7 @@ BOOL FormatExtFs(DWORD DriveIndex, uint64_t PartitionOffset, DWORD BlockSize, LP
 	io_manager manager = nt_io_manager;
 	blk_t journal_size;
 	blk64_t size = 0, cur;
+	uint64_t start_time;
 	ext2_filsys ext2fs = NULL;
 	errcode_t r;
 	uint8_t* buf = NULL;
@@ -437,8 +438,13 @@ BOOL FormatExtFs(DWORD DriveIndex, uint64_t PartitionOffset, DWORD BlockSize, LP
 		uprintf("Creating %d journal blocks: [1 marker = %0.1f block(s)]", journal_size,
 			max((float)journal_size / MAX_MARKER, 1.0f));
 		// Even with EXT2_MKJOURNAL_LAZYINIT, this call is absolutely dreadful in terms of speed...
+		start_time = GetTickCount64();
 		r = ext2fs_add_journal_inode(ext2fs, journal_size, EXT2_MKJOURNAL_NO_MNT_CHECK | ((Flags & FP_QUICK) ? EXT2_MKJOURNAL_LAZYINIT : 0));
 		uprintfs("\r\n");
+		start_time = GetTickCount64() - start_time;
+		if (r == 0)
+			uprintf("Created %d KB journal in %0.1f s", journal_size * (EXT2_BLOCK_SIZE(ext2fs->super) / KB),
+				start_time / 1000.0f);
 		if (r != 0) {
 			SET_EXT2_FORMAT_ERROR(ERROR_WRITE_FAULT);
 			uprintf("Could not create %s journal: %s", FSName, error_message(r));
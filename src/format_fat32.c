@@ -35,11 +35,18 @@
 #include "format.h"
 #include "missing.h"
 #include "resource.h"
+#include "settings.h"
 #include "msapi_utf8.h"
 #include "localization.h"
 
 #define die(msg, err) do { uprintf(msg); ErrorStatus = RUFUS_ERROR(err); goto out; } while(0)
 
+// Default and bounds for the size of the I/O we use to clear the system area.
+// Can be overridden through the LargeFat32IoSize setting (in KB).
+#define FAT32_IO_SIZE_DEFAULT   (4 * MB)
+#define FAT32_IO_SIZE_MIN       (64 * KB)
+#define FAT32_IO_SIZE_MAX       (64 * MB)
+
 extern BOOL write_as_esp;
 
 /* Large FAT32 */
@@ -145,6 +152,21 @@ static DWORD GetFATSizeSectors(DWORD DskSize, DWORD ReservedSecCnt, DWORD SecPer
 	return (DWORD)FatSz;
 }
 
+/*
+ * Try to have the storage stack zero a range for us, which only file system backed
+ * targets (such as image files) will honour. Returns FALSE if the caller must write
+ * the zeroes itself.
+ */
+static BOOL ZeroRange(HANDLE hDrive, uint64_t Offset, uint64_t Size)
+{
+	FILE_ZERO_DATA_INFORMATION fzdi;
+	DWORD cbRet;
+
+	fzdi.FileOffset.QuadPart = Offset;
+	fzdi.BeyondFinalZero.QuadPart = Offset + Size;
+	return DeviceIoControl(hDrive, FSCTL_SET_ZERO_DATA, &fzdi, sizeof(fzdi), NULL, 0, &cbRet, NULL);
+}
+
 /*
  * Large FAT32 volume formatting from fat32format by Tom Thornhill
  * http://www.ridgecrop.demon.co.uk/index.htm?fat32format.htm
@@ -166,7 +188,7 @@ BOOL FormatLargeFAT32(DWORD DriveIndex, uint64_t PartitionOffset, DWORD ClusterS
 	DWORD BackupBootSect = 6;
 	DWORD VolumeId = 0; // calculated before format
 	char* VolumeName = NULL;
-	DWORD BurstSize = 128; // Zero in blocks of 64K typically
+	DWORD BurstSize = 0; // Number of sectors we write at once
 
 	// Calculated later
 	DWORD FatSize = 0;
@@ -176,6 +198,8 @@ BOOL FormatLargeFAT32(DWORD DriveIndex, uint64_t PartitionOffset, DWORD ClusterS
 	DWORD AlignSectors = 0;
 	DWORD SystemAreaSize = 0;
 	DWORD UserAreaSize = 0;
+	DWORD IoSize, Count, NumSpecial, SpecialSect[6];
+	void* SpecialData[6];
 	ULONGLONG qTotalSectors = 0;
 
 	// Structures to be written to the disk
@@ -416,36 +440,60 @@ BOOL FormatLargeFAT32(DWORD DriveIndex, uint64_t PartitionOffset, DWORD ClusterS
 
 	// First zero out ReservedSect + FatSize * NumFats + SectorsPerCluster
 	SystemAreaSize = ReservedSectCount + (NumFATs * FatSize) + SectorsPerCluster;
-	uprintf("Clearing out %d sectors for reserved sectors, FATs and root cluster...", SystemAreaSize);
-
-	// Not the most effective, but easy on RAM
-	pZeroSect = (BYTE*)calloc(BytesPerSect, BurstSize);
-	if (!pZeroSect) {
+	uprintf("Initializing %d sectors for reserved sectors, FATs and root cluster...", SystemAreaSize);
+
+	// Use large aligned bursts, so that we issue as few write requests as possible
+	IoSize = ReadSetting32(SETTING_LARGE_FAT32_IO_SIZE) * KB;
+	if (IoSize == 0)
+		IoSize = FAT32_IO_SIZE_DEFAULT;
+	IoSize = min(max(IoSize, FAT32_IO_SIZE_MIN), FAT32_IO_SIZE_MAX);
+	BurstSize = max(IoSize / BytesPerSect, 1);
+	pZeroSect = (BYTE*)_mm_malloc((size_t)BytesPerSect * BurstSize, BytesPerSect);
+	if (pZeroSect == NULL)
 		die("Failed to allocate memory", ERROR_NOT_ENOUGH_MEMORY);
-	}
+	memset(pZeroSect, 0, (size_t)BytesPerSect * BurstSize);
 
-	for (i = 0; i < (SystemAreaSize + BurstSize - 1); i += BurstSize) {
-		if (!(Flags & FP_NO_PROGRESS))
-			UpdateProgressWithInfo(OP_FORMAT, MSG_217, (uint64_t)i, (uint64_t)SystemAreaSize + BurstSize);
-		CHECK_FOR_USER_CANCEL;
-		if (write_sectors(hLogicalVolume, BytesPerSect, i, BurstSize, pZeroSect) != (BytesPerSect * BurstSize)) {
-			die("Error clearing reserved sectors", ERROR_WRITE_FAULT);
-		}
-	}
-
-	uprintf ("Initializing reserved sectors and FATs...");
-	// Now we should write the boot sector and fsinfo twice, once at 0 and once at the backup boot sect position
+	// The sectors that are not zero: boot sector and FSInfo (and their backups), and the
+	// first sector of each FAT. They get patched into the burst they belong to, so that
+	// the whole system area, including all the FAT copies, is written in a single pass.
+	assert(NumFATs <= ARRAYSIZE(SpecialSect) - 4);
+	NumSpecial = 0;
 	for (i = 0; i < 2; i++) {
-		int SectorStart = (i == 0) ? 0 : BackupBootSect;
-		write_sectors(hLogicalVolume, BytesPerSect, SectorStart, 1, pFAT32BootSect);
-		write_sectors(hLogicalVolume, BytesPerSect, SectorStart + 1, 1, pFAT32FsInfo);
+		SpecialSect[NumSpecial] = (i == 0) ? 0 : BackupBootSect;
+		SpecialData[NumSpecial++] = pFAT32BootSect;
+		SpecialSect[NumSpecial] = SpecialSect[NumSpecial - 1] + 1;
+		SpecialData[NumSpecial++] = pFAT32FsInfo;
 	}
-
-	// Write the first fat sector in the right places
 	for (i = 0; i < NumFATs; i++) {
-		int SectorStart = ReservedSectCount + (i * FatSize);
-		uprintf("FAT #%d sector at address: %d", i, SectorStart);
-		write_sectors(hLogicalVolume, BytesPerSect, SectorStart, 1, pFirstSectOfFat);
+		SpecialSect[NumSpecial] = ReservedSectCount + (i * FatSize);
+		SpecialData[NumSpecial++] = pFirstSectOfFat;
+		uprintf("FAT #%d sector at address: %d", i, ReservedSectCount + (i * FatSize));
+	}
+
+	if (ZeroRange(hLogicalVolume, 0, (uint64_t)SystemAreaSize * BytesPerSect)) {
+		uprintf("Cleared using zero range request");
+		for (i = 0; i < NumSpecial; i++) {
+			if (write_sectors(hLogicalVolume, BytesPerSect, SpecialSect[i], 1, SpecialData[i]) != BytesPerSect)
+				die("Error initializing reserved sectors and FATs", ERROR_WRITE_FAULT);
+		}
+	} else {
+		for (i = 0; i < SystemAreaSize; i += Count) {
+			DWORD j;
+			Count = min(BurstSize, SystemAreaSize - i);
+			if (!(Flags & FP_NO_PROGRESS))
+				UpdateProgressWithInfo(OP_FORMAT, MSG_217, (uint64_t)i, (uint64_t)SystemAreaSize);
+			CHECK_FOR_USER_CANCEL;
+			for (j = 0; j < NumSpecial; j++) {
+				if ((SpecialSect[j] >= i) && (SpecialSect[j] < i + Count))
+					memcpy(&pZeroSect[(SpecialSect[j] - i) * BytesPerSect], SpecialData[j], BytesPerSect);
+			}
+			if (write_sectors(hLogicalVolume, BytesPerSect, i, Count, pZeroSect) != (int64_t)BytesPerSect * Count)
+				die("Error clearing reserved sectors and FATs", ERROR_WRITE_FAULT);
+			for (j = 0; j < NumSpecial; j++) {
+				if ((SpecialSect[j] >= i) && (SpecialSect[j] < i + Count))
+					memset(&pZeroSect[(SpecialSect[j] - i) * BytesPerSect], 0, BytesPerSect);
+			}
+		}
 	}
 
 	if (!(Flags & FP_NO_BOOT)) {
@@ -482,6 +530,6 @@ out:
 	safe_free(pFAT32BootSect);
 	safe_free(pFAT32FsInfo);
 	safe_free(pFirstSectOfFat);
-	safe_free(pZeroSect);
+	safe_mm_free(pZeroSect);
 	return r;
 }
@@ -79,6 +79,11 @@ typedef struct {
 	BOOLEAN is_old_c32[NB_OLD_C32];
 } EXTRACT_PROPS;
 
+typedef struct {
+	const char* path;
+	uint8_t md5[MD5_HASHSIZE];
+} md5sum_entry_t;
+
 RUFUS_IMG_REPORT img_report;
 FILE* fd_md5sum = NULL;
 int64_t iso_blocking_status = -1;
@@ -108,6 +113,8 @@ static const char* wininst_name[] = { "install.wim", "install.esd", "install.swm
 // If the disc was mastered properly, GRUB/EFI will take care of itself
 static const char* grub_dirname[] = { "/boot/grub/i386-pc", "/boot/grub2/i386-pc" };
 static const char* grub_cfg[] = { "grub.cfg", "loopback.cfg" };
+// NB: Must match the bits of img_report.has_grub2_fs
+static const char* grub_fs_name[] = { "fat", "exfat", "ntfs" };
 static const char* menu_cfg = "menu.cfg";
 // NB: Do not alter the order of the array below without validating hardcoded indexes in check_iso_props
 static const char* syslinux_cfg[] = { "isolinux.cfg", "syslinux.cfg", "extlinux.conf", "txt.cfg", "live.cfg" };
@@ -128,7 +135,9 @@ static uint8_t joliet_level = 0;
 static uint32_t md5sum_size = 0;
 static BOOL scan_only = FALSE;
 static StrArray config_path, isolinux_path, grub_filesystems;
-static char symlinked_syslinux[MAX_PATH], *md5sum_data = NULL, *md5sum_pos = NULL;
+static char symlinked_syslinux[MAX_PATH], *md5sum_data = NULL;
+static md5sum_entry_t* md5sum_table = NULL;
+static uint32_t md5sum_table_size = 0, md5sum_mismatches = 0;
 
 // Ensure filenames do not contain invalid FAT32 or NTFS characters
 static __inline char* sanitize_filename(char* filename, BOOL* is_identical)
@@ -161,57 +170,118 @@ static void log_handler (cdio_log_level_t level, const char *message)
 	uprintf("libcdio: %s", message);
 }
 
-// Returns TRUE if a path appears in md5sum.txt
-static BOOL is_in_md5sum(char* path)
+static __inline uint8_t hex_value(char c)
 {
-	BOOL found = FALSE;
-	char c[3], * p, * pos = md5sum_pos, * nul_pos;
+	return (uint8_t)((c <= '9') ? (c - '0') : ((c | 0x20) - 'a' + 0xa));
+}
 
-	// If we are creating the md5sum file from scratch, every file is in it.
-	if (fd_md5sum != NULL)
-		return TRUE;
+/*
+ * Index the md5sum.txt we read from the image, so that looking up a path doesn't
+ * require a string search through the whole file. This is an open addressing table
+ * (power of 2 size, linear probing) whose paths point into md5sum_data, which we
+ * NUL terminate in place.
+ */
+static uint32_t md5sum_hash(const char* path)
+{
+	uint32_t h = 2166136261U;	// FNV-1a
+
+	while (*path != 0)
+		h = (h ^ (uint8_t)*path++) * 16777619U;
+	return h;
+}
 
-	// If we don't have an existing file at this stage, then no file is in it.
+static void parse_md5sum(void)
+{
+	char *p, *eol, *path;
+	uint32_t i, j, nb_lines = 0, nb_entries = 0;
+	md5sum_entry_t* entry;
+
+	safe_free(md5sum_table);
+	md5sum_table_size = 0;
+	md5sum_mismatches = 0;
 	if (md5sum_size == 0 || md5sum_data == NULL)
-		return FALSE;
+		return;
+
+	for (i = 0; i < md5sum_size; i++)
+		if (md5sum_data[i] == '\n')
+			nb_lines++;
+	for (md5sum_table_size = 16; md5sum_table_size < 2 * (nb_lines + 1); md5sum_table_size <<= 1);
+	md5sum_table = calloc(md5sum_table_size, sizeof(md5sum_entry_t));
+	if (md5sum_table == NULL) {
+		uprintf("Could not allocate md5sum table");
+		md5sum_table_size = 0;
+		return;
+	}
+
+	// NB: md5sum_data is always NUL terminated.
+	for (p = md5sum_data; *p != 0; p = eol) {
+		eol = strchr(p, '\n');
+		if (eol == NULL)
+			eol = &p[strlen(p)];
+		else
+			*eol++ = 0;
+		// Expect "<MD5SUM> [*| ][./]<FILE_PATH>"
+		for (i = 0; i < 2 * MD5_HASHSIZE && IS_HEXASCII(p[i]); i++);
+		if (i != 2 * MD5_HASHSIZE || (p[i] != ' ' && p[i] != '\t'))
+			continue;
+		path = &p[i];
+		while (*path == ' ' || *path == '\t')
+			path++;
+		if (*path == '*')
+			path++;
+		if (path[0] == '.' && path[1] == '/')
+			path += 2;
+		i = (uint32_t)strlen(path);
+		while (i > 0 && (path[i - 1] == '\r' || path[i - 1] == ' '))
+			path[--i] = 0;
+		if (i == 0)
+			continue;
+		for (i = md5sum_hash(path) & (md5sum_table_size - 1); md5sum_table[i].path != NULL &&
+			strcmp(md5sum_table[i].path, path) != 0; i = (i + 1) & (md5sum_table_size - 1));
+		entry = &md5sum_table[i];
+		// Keep the first occurrence of a duplicated path
+		if (entry->path != NULL)
+			continue;
+		entry->path = path;
+		for (j = 0; j < MD5_HASHSIZE; j++)
+			entry->md5[j] = (hex_value(p[2 * j]) << 4) | hex_value(p[2 * j + 1]);
+		nb_entries++;
+	}
+	uprintf("Indexed %d entries from %s", nb_entries, md5sum_name[0]);
+}
+
+// Returns the md5sum.txt entry for a "X:/xyz" path, or NULL if none
+static md5sum_entry_t* md5sum_lookup(const char* path)
+{
+	uint32_t i;
 
+	if (md5sum_table == NULL)
+		return NULL;
 	// We should have a "X:/xyz" path
 	assert(path[1] == ':' && path[2] == '/');
+	path = &path[3];
+	for (i = md5sum_hash(path) & (md5sum_table_size - 1); md5sum_table[i].path != NULL;
+		i = (i + 1) & (md5sum_table_size - 1)) {
+		if (strcmp(md5sum_table[i].path, path) == 0)
+			return &md5sum_table[i];
+	}
+	return NULL;
+}
 
-	// Modify the path to have " ./xyz"
-	c[0] = path[0];
-	c[1] = path[1];
-	path[0] = ' ';
-	path[1] = '.';
+// Returns TRUE if a path appears in md5sum.txt
+static __inline BOOL is_in_md5sum(const char* path)
+{
+	// If we are creating the md5sum file from scratch, every file is in it.
+	return (fd_md5sum != NULL) || (md5sum_lookup(path) != NULL);
+}
 
-	// Search for the string in the remainder of the md5sum.txt
-	// NB: md5sum_data is always NUL terminated.
-	p = strstr(pos, path);
-	// Cater for the case where we matched a partial string and look for the full one
-	while (p != NULL && p[strlen(path)] != '\n' && p[strlen(path)] != '\r' && p[strlen(path)] != '\0') {
-		pos = p + strlen(path);
-		p = strstr(pos, path);
-	}
-	found = (p != NULL);
-	// If not found in remainder and we have a remainder, loop to search from beginning
-	if (!found && pos != md5sum_data) {
-		nul_pos = pos;
-		c[2] = *nul_pos;
-		*nul_pos = 0;
-		p = strstr(md5sum_data, path);
-		while (p != NULL && p[strlen(path)] != '\n' && p[strlen(path)] != '\r' && p[strlen(path)] != '\0') {
-			pos = p + strlen(path);
-			p = strstr(pos, path);
-		}
-		*nul_pos = c[2];
-		found = (p != NULL);
-	}
-
-	path[0] = c[0];
-	path[1] = c[1];
-	if (found)
-		md5sum_pos = p + strlen(path);
-	return found;
+// Compares the MD5 we computed while extracting with the one from md5sum.txt
+static void check_md5sum(const md5sum_entry_t* entry, const uint8_t* md5)
+{
+	if (memcmp(entry->md5, md5, MD5_HASHSIZE) != 0) {
+		uprintf("  WARNING: MD5 does not match the one from %s", md5sum_name[0]);
+		md5sum_mismatches++;
+	}
 }
 
 static void _print_extracted_file(char* psz_fullpath, uint64_t file_length, BOOL split)
@@ -612,14 +682,169 @@ static LPFILETIME __inline to_filetime(time_t t)
 	return r;
 }
 
-// Helper function to restore the timestamp on a directory
-static void __inline set_directory_timestamp(char* path, LPFILETIME creation, LPFILETIME last_access, LPFILETIME modify)
+/*
+ * Directory timestamps are restored in a single pass once extraction is complete,
+ * since writing files to a directory updates its modification time anyway, and
+ * since this avoids opening each directory again in between our data writes.
+ */
+typedef struct {
+	char* path;
+	FILETIME ft[3];		// Creation, last access and modification
+} dir_timestamp_t;
+static dir_timestamp_t* dir_timestamp = NULL;
+static uint32_t nb_dir_timestamps = 0, max_dir_timestamps = 0;
+
+static void set_directory_timestamp(const char* path, LPFILETIME creation, LPFILETIME last_access, LPFILETIME modify)
 {
-	HANDLE dir_handle = CreateFileU(path, GENERIC_READ | GENERIC_WRITE,
-		FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
-	if ((dir_handle == INVALID_HANDLE_VALUE) || (!SetFileTime(dir_handle, creation, last_access, modify)))
-		uprintf("  Could not set timestamp for directory '%s': %s", path, WindowsErrorString());
-	safe_closehandle(dir_handle);
+	dir_timestamp_t* new_dir_timestamp;
+
+	if (nb_dir_timestamps >= max_dir_timestamps) {
+		new_dir_timestamp = realloc(dir_timestamp, (max_dir_timestamps + 256) * sizeof(dir_timestamp_t));
+		if (new_dir_timestamp == NULL) {
+			uprintf("  Could not record timestamp for directory '%s'", path);
+			return;
+		}
+		dir_timestamp = new_dir_timestamp;
+		max_dir_timestamps += 256;
+	}
+	dir_timestamp[nb_dir_timestamps].path = safe_strdup(path);
+	if (dir_timestamp[nb_dir_timestamps].path == NULL)
+		return;
+	dir_timestamp[nb_dir_timestamps].ft[0] = *creation;
+	dir_timestamp[nb_dir_timestamps].ft[1] = *last_access;
+	dir_timestamp[nb_dir_timestamps].ft[2] = *modify;
+	nb_dir_timestamps++;
+}
+
+// Apply (if requested) and clear all the directory timestamps recorded above
+static void apply_directory_timestamps(BOOL apply)
+{
+	uint32_t i;
+	HANDLE dir_handle;
+
+	if (apply && nb_dir_timestamps != 0)
+		uprintf("Restoring timestamps for %d directories", nb_dir_timestamps);
+	for (i = 0; i < nb_dir_timestamps; i++) {
+		if (apply && !ErrorStatus) {
+			dir_handle = CreateFileU(dir_timestamp[i].path, FILE_WRITE_ATTRIBUTES,
+				FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+			if ((dir_handle == INVALID_HANDLE_VALUE) || (!SetFileTime(dir_handle,
+				&dir_timestamp[i].ft[0], &dir_timestamp[i].ft[1], &dir_timestamp[i].ft[2])))
+				uprintf("  Could not set timestamp for directory '%s': %s", dir_timestamp[i].path, WindowsErrorString());
+			safe_closehandle(dir_handle);
+		}
+		safe_free(dir_timestamp[i].path);
+	}
+	safe_free(dir_timestamp);
+	nb_dir_timestamps = 0;
+	max_dir_timestamps = 0;
+}
+
+/*
+ * Windows has no copy_file_range() or sendfile() for regular files, but we can get
+ * the same result by handing WriteFile() a read-only view of the image: the data then
+ * goes from the file cache of the source straight to the target, without being copied
+ * to a buffer of ours first. Since we never touch the view ourselves, read errors on
+ * the image are reported as WriteFile() errors. This is only used for contiguous files
+ * that we don't need to hash or modify, with the buffered copy used for everything else.
+ */
+#define ISO_MAP_VIEW_SIZE         (64 * MB)
+#define ISO_MAP_CHUNK_SIZE        (1 * MB)
+// Smaller files aren't worth the mapping of a new view
+#define ISO_MAP_MIN_SIZE          ISO_BUFFER_SIZE
+
+typedef struct {
+	HANDLE file;
+	HANDLE mapping;
+	uint8_t* view;
+	uint64_t view_offset;
+	uint64_t view_size;
+	uint64_t size;
+} iso_map_t;
+
+static iso_map_t iso_map = { INVALID_HANDLE_VALUE, NULL, NULL, 0, 0, 0 };
+
+static void iso_map_close(iso_map_t* map)
+{
+	if (map->view != NULL)
+		UnmapViewOfFile(map->view);
+	safe_closehandle(map->mapping);
+	safe_closehandle(map->file);
+	map->mapping = NULL;
+	map->view = NULL;
+	map->view_offset = 0;
+	map->view_size = 0;
+	map->size = 0;
+}
+
+static BOOL iso_map_open(iso_map_t* map, const char* src_iso)
+{
+	LARGE_INTEGER li;
+
+	map->file = CreateFileU(src_iso, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if ((map->file == INVALID_HANDLE_VALUE) || !GetFileSizeEx(map->file, &li) || (li.QuadPart == 0))
+		goto err;
+	map->size = li.QuadPart;
+	map->mapping = CreateFileMappingW(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (map->mapping == NULL)
+		goto err;
+	return TRUE;
+
+err:
+	iso_map_close(map);
+	return FALSE;
+}
+
+// Returns TRUE if the image range [offset, offset + length) can be copied from the map
+static __inline BOOL iso_map_can_copy(iso_map_t* map, uint64_t offset, uint64_t length)
+{
+	return (map->mapping != NULL) && (length >= ISO_MAP_MIN_SIZE) && (offset + length <= map->size);
+}
+
+// Write a range of the image to hFile, and update the extraction progress if requested
+static BOOL iso_map_write(iso_map_t* map, HANDLE hFile, uint64_t offset, uint64_t length, BOOL progress)
+{
+	BOOL r;
+	DWORD size, wr_size;
+	uint64_t base;
+
+	while (length > 0) {
+		if (progress && ErrorStatus)
+			return FALSE;
+		if ((map->view == NULL) || (offset < map->view_offset) || (offset >= map->view_offset + map->view_size)) {
+			if (map->view != NULL)
+				UnmapViewOfFile(map->view);
+			base = offset - (offset % ISO_MAP_VIEW_SIZE);
+			map->view_size = MIN(ISO_MAP_VIEW_SIZE, map->size - base);
+			map->view = MapViewOfFile(map->mapping, FILE_MAP_READ, (DWORD)(base >> 32), (DWORD)base, (SIZE_T)map->view_size);
+			if (map->view == NULL) {
+				uprintf("  Could not map image: %s", WindowsErrorString());
+				return FALSE;
+			}
+			map->view_offset = base;
+		}
+		size = (DWORD)MIN(MIN(length, ISO_MAP_CHUNK_SIZE), map->view_offset + map->view_size - offset);
+		if (progress)
+			ISO_BLOCKING(r = WriteFileWithRetry(hFile, &map->view[offset - map->view_offset], size, &wr_size, WRITE_RETRIES));
+		else
+			r = WriteFileWithRetry(hFile, &map->view[offset - map->view_offset], size, &wr_size, WRITE_RETRIES);
+		if (!r || (wr_size != size)) {
+			uprintf("  Error writing file: %s", r ? "Short write detected" : WindowsErrorString());
+			return FALSE;
+		}
+		offset += size;
+		length -= size;
+		if (progress) {
+			nb_blocks += (size + ISO_BLOCKSIZE - 1) / ISO_BLOCKSIZE;
+			if (nb_blocks - last_nb_blocks >= PROGRESS_THRESHOLD) {
+				UpdateProgressWithInfo(OP_FILE_COPY, MSG_231, nb_blocks, total_blocks +
+					((fs_type != FS_NTFS) ? extra_blocks : 0));
+				last_nb_blocks = nb_blocks;
+			}
+		}
+	}
+	return TRUE;
 }
 
 // Returns 0 on success, nonzero on error
@@ -629,8 +854,10 @@ static int udf_extract_files(udf_t *p_udf, udf_dirent_t *p_udf_dirent, const cha
 	DWORD buf_size, wr_size, err;
 	EXTRACT_PROPS props;
 	HASH_CONTEXT ctx;
-	BOOL r, is_identical;
+	BOOL r, is_identical, hash_file;
+	md5sum_entry_t* md5_entry;
 	int length;
+	uint32_t start, end;
 	size_t i, j, nb;
 	char tmp[128], *psz_fullpath = NULL, *psz_sanpath = NULL;
 	const char* psz_basename;
@@ -700,6 +927,8 @@ static int udf_extract_files(udf_t *p_udf, udf_dirent_t *p_udf_dirent, const cha
 			psz_sanpath = sanitize_filename(psz_fullpath, &is_identical);
 			if (!is_identical)
 				uprintf("  File name sanitized to '%s'", psz_sanpath);
+			md5_entry = (validate_md5sum && fd_md5sum == NULL) ? md5sum_lookup(psz_fullpath) : NULL;
+			hash_file = (fd_md5sum != NULL) || (md5_entry != NULL);
 			file_handle = CreatePreallocatedFile(psz_sanpath, GENERIC_READ | GENERIC_WRITE,
 				FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, file_length);
 			if (file_handle == INVALID_HANDLE_VALUE) {
@@ -710,8 +939,16 @@ static int udf_extract_files(udf_t *p_udf, udf_dirent_t *p_udf_dirent, const cha
 					uprintf(stupid_antivirus);
 				else
 					goto out;
+			} else if (!hash_file && !props.is_cfg && !props.is_conf &&
+				udf_get_lba(&p_udf_dirent->fe, &start, &end) &&
+				((uint64_t)(end - start + 1) * UDF_BLOCKSIZE >= (uint64_t)file_length) &&
+				iso_map_can_copy(&iso_map, (uint64_t)(p_udf_dirent->i_part_start + start) * UDF_BLOCKSIZE, file_length)) {
+				// Unmodified file with a single extent => copy straight from the image
+				if (!iso_map_write(&iso_map, file_handle, (uint64_t)(p_udf_dirent->i_part_start + start) * UDF_BLOCKSIZE,
+					file_length, TRUE))
+					goto out;
 			} else {
-				if (fd_md5sum != NULL)
+				if (hash_file)
 					hash_init[HASH_MD5](&ctx);
 				while (file_length > 0) {
 					if (ErrorStatus)
@@ -723,7 +960,7 @@ static int udf_extract_files(udf_t *p_udf, udf_dirent_t *p_udf_dirent, const cha
 						goto out;
 					}
 					buf_size = (DWORD)MIN(file_length, read);
-					if (fd_md5sum != NULL)
+					if (hash_file)
 						hash_write[HASH_MD5](&ctx, buf, buf_size);
 					ISO_BLOCKING(r = WriteFileWithRetry(file_handle, buf, buf_size, &wr_size, WRITE_RETRIES));
 					if (!r || (wr_size != buf_size)) {
@@ -737,8 +974,11 @@ static int udf_extract_files(udf_t *p_udf, udf_dirent_t *p_udf_dirent, const cha
 						last_nb_blocks = nb_blocks;
 					}
 				}
-				if (fd_md5sum != NULL) {
+				if (hash_file)
 					hash_final[HASH_MD5](&ctx);
+				if (md5_entry != NULL)
+					check_md5sum(md5_entry, ctx.buf);
+				if (fd_md5sum != NULL) {
 					for (j = 0; j < MD5_HASHSIZE; j++)
 						fprintf(fd_md5sum, "%02x", ctx.buf[j]);
 					fprintf(fd_md5sum, "  ./%s\n", &psz_fullpath[3]);
@@ -746,7 +986,7 @@ static int udf_extract_files(udf_t *p_udf, udf_dirent_t *p_udf_dirent, const cha
 			}
 			if ((preserve_timestamps) && (!SetFileTime(file_handle, to_filetime(udf_get_attribute_time(p_udf_dirent)),
 				to_filetime(udf_get_access_time(p_udf_dirent)), to_filetime(udf_get_modification_time(p_udf_dirent)))))
-				uprintf("  Could not set timestamp: %s", WindowsErrorString());
+				ruprintf(1000, "  Could not set timestamp: %s", WindowsErrorString());
 
 			// If you have a fast USB 3.0 device, the default Windows buffering does an
 			// excellent job at compensating for our small blocks read/writes to max out the
@@ -772,17 +1012,685 @@ out:
 	return 1;
 }
 
-// Returns 0 on success, >0 on error, <0 to ignore current dir
-static int iso_extract_files(iso9660_t* p_iso, const char *psz_path)
+// Create a directory from the ISO and restore its timestamp if needed
+static void iso_create_dir(const char* psz_fullpath, struct tm* tm)
+{
+	BOOL is_identical;
+	char* psz_sanpath = sanitize_filename((char*)psz_fullpath, &is_identical);
+
+	IGNORE_RETVAL(_mkdirU(psz_sanpath));
+	if (preserve_timestamps) {
+		LPFILETIME ft = to_filetime(mktime(tm));
+		set_directory_timestamp(psz_sanpath, ft, ft, ft);
+	}
+	safe_free(psz_sanpath);
+}
+
+// Scan or extract a single non-directory ISO9660 entry, where psz_fullpath is
+// a MAX_PATH buffer. Returns 0 on success, nonzero on error.
+static int iso_extract_file(iso9660_t* p_iso, const char* psz_path, char* psz_fullpath,
+	const char* psz_basename, iso9660_stat_t* p_statbuf, BOOL is_symlink, uint8_t* buf)
 {
 	HANDLE file_handle = NULL;
 	DWORD buf_size, wr_size, err;
 	EXTRACT_PROPS props;
 	HASH_CONTEXT ctx;
-	BOOL is_symlink, is_identical, create_file, free_p_statbuf = FALSE;
+	BOOL s, is_identical, create_file = TRUE, free_p_statbuf = FALSE, hash_file;
+	md5sum_entry_t* md5_entry;
+	int r = 1;
+	char *psz_sanpath = NULL, tmp[128], target_path[256];
+	const char *psz_iso_name = &psz_fullpath[strlen(psz_extract_dir)];
+	size_t i, j, nb;
+	lsn_t lsn;
+	int64_t file_length = p_statbuf->total_size;
+
+	if (check_iso_props(psz_path, file_length, psz_basename, psz_fullpath, &props)) {
+		if (is_symlink && (file_length == 0)) {
+			// Add symlink duplicated files to total_size at scantime
+			if ((strcmp(psz_path, "/firmware") == 0)) {
+				static_sprintf(target_path, "%s/%s", psz_path, p_statbuf->rr.psz_symlink);
+				iso9660_stat_t* p_statbuf2 = iso9660_ifs_stat_translate(p_iso, target_path);
+				if (p_statbuf2 != NULL) {
+					extra_blocks += (p_statbuf2->total_size + ISO_BLOCKSIZE - 1) / ISO_BLOCKSIZE;
+					iso9660_stat_free(p_statbuf2);
+				}
+			} else if ((strcmp(psz_basename, "live") == 0) &&
+				(strcmp(p_statbuf->rr.psz_symlink, "casper") == 0)) {
+				// Mint LMDE requires working symbolic links and therefore requires the use of NTFS
+				img_report.needs_ntfs = TRUE;
+			}
+		}
+		return 0;
+	}
+	if (!is_symlink)
+		print_extracted_file(psz_fullpath, file_length);
+	for (i = 0; i < NB_OLD_C32; i++) {
+		if (props.is_old_c32[i] && use_own_c32[i]) {
+			static_sprintf(tmp, "%s/syslinux-%s/%s", FILES_DIR, embedded_sl_version_str[0], old_c32_name[i]);
+			if (CopyFileU(tmp, psz_fullpath, FALSE)) {
+				uprintf("  Replaced with local version %s", IsFileInDB(tmp)?"✓":"✗");
+				break;
+			}
+			uprintf("  Could not replace file: %s", WindowsErrorString());
+		}
+	}
+	if (i < NB_OLD_C32)
+		return 0;
+	psz_sanpath = sanitize_filename(psz_fullpath, &is_identical);
+	if (!is_identical)
+		uprintf("  File name sanitized to '%s'", psz_sanpath);
+	if (is_symlink) {
+		if (fs_type == FS_NTFS) {
+			// Replicate symlinks if NTFS is being used
+			static_sprintf(target_path, "%s/%s", psz_path, p_statbuf->rr.psz_symlink);
+			iso9660_stat_t* p_statbuf2 = iso9660_ifs_stat_translate(p_iso, target_path);
+			if (p_statbuf2 != NULL) {
+				to_windows_path(psz_fullpath);
+				to_windows_path(p_statbuf->rr.psz_symlink);
+				uprintf("Symlinking: %s%s ➔ %s", psz_fullpath,
+					(p_statbuf2->type == _STAT_DIR) ? "\\" : "", p_statbuf->rr.psz_symlink);
+				if (!CreateSymbolicLinkU(psz_fullpath, p_statbuf->rr.psz_symlink,
+					(p_statbuf2->type == _STAT_DIR) ? SYMBOLIC_LINK_FLAG_DIRECTORY : 0))
+					uprintf("  Could not create symlink: %s", WindowsErrorString());
+				to_unix_path(p_statbuf->rr.psz_symlink);
+				to_unix_path(psz_fullpath);
+				iso9660_stat_free(p_statbuf2);
+				create_file = FALSE;
+			}
+		} else if (file_length == 0) {
+			if ((safe_stricmp(psz_basename, "syslinux") == 0) &&
+				// Special handling for ISOs that have a syslinux → isolinux symbolic link (e.g. Knoppix)
+				(safe_stricmp(p_statbuf->rr.psz_symlink, "isolinux") == 0)) {
+				static_strcpy(symlinked_syslinux, psz_fullpath);
+				print_extracted_file(psz_fullpath, file_length);
+				uprintf("  Found Rock Ridge symbolic link to '%s'", p_statbuf->rr.psz_symlink);
+			} else if (strcmp(psz_path, "/firmware") == 0) {
+				// Special handling for ISOs that use symlinks for /firmware/ (e.g. Debian non-free)
+				// TODO: Do we want to do this for all file symlinks?
+				static_sprintf(target_path, "%s/%s", psz_path, p_statbuf->rr.psz_symlink);
+				p_statbuf = iso9660_ifs_stat_translate(p_iso, target_path);
+				if (p_statbuf != NULL) {
+					// The original p_statbuf will be freed automatically, but not
+					// the new one so we need to force an explicit free.
+					free_p_statbuf = TRUE;
+					file_length = p_statbuf->total_size;
+					print_extracted_file(psz_fullpath, file_length);
+					uprintf("  Duplicated from '%s'", target_path);
+				} else {
+					uprintf("Could not resolve Rock Ridge Symlink - ABORTING!");
+					goto out;
+				}
+			} else {
+				print_extracted_file(psz_fullpath, safe_strlen(p_statbuf->rr.psz_symlink));
+				uprintf("  Ignoring Rock Ridge symbolic link to '%s'", p_statbuf->rr.psz_symlink);
+			}
+		} else {
+			uuprintf("Unexpected symlink length: %d", file_length);
+			create_file = FALSE;
+		}
+	}
+	if (create_file) {
+		md5_entry = (validate_md5sum && fd_md5sum == NULL && !is_symlink) ? md5sum_lookup(psz_fullpath) : NULL;
+		hash_file = (fd_md5sum != NULL) || (md5_entry != NULL);
+		file_handle = CreatePreallocatedFile(psz_sanpath, GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, file_length);
+		if (file_handle == INVALID_HANDLE_VALUE) {
+			err = GetLastError();
+			uprintf("  Unable to create file: %s", WindowsErrorString());
+			if (((err == ERROR_ACCESS_DENIED) || (err == ERROR_INVALID_HANDLE)) &&
+				(safe_strcmp(&psz_sanpath[3], autorun_name) == 0))
+				uprintf(stupid_antivirus);
+			else
+				goto out;
+		} else if (is_symlink) {
+			// Create a text file that contains the target link
+			ISO_BLOCKING(s = WriteFileWithRetry(file_handle, p_statbuf->rr.psz_symlink,
+				(DWORD)safe_strlen(p_statbuf->rr.psz_symlink), &wr_size, WRITE_RETRIES));
+			if (!s) {
+				uprintf("  Error writing file: %s", WindowsErrorString());
+				goto out;
+			}
+		} else if (!hash_file && !props.is_cfg && !props.is_conf &&
+			iso_map_can_copy(&iso_map, (uint64_t)p_statbuf->lsn * ISO_BLOCKSIZE, file_length)) {
+			// Unmodified file => copy straight from the image
+			if (!iso_map_write(&iso_map, file_handle, (uint64_t)p_statbuf->lsn * ISO_BLOCKSIZE, file_length, TRUE))
+				goto out;
+		} else {
+			if (hash_file)
+				hash_init[HASH_MD5](&ctx);
+			for (i = 0; file_length > 0; i += nb) {
+				if (ErrorStatus)
+					goto out;
+				lsn = p_statbuf->lsn + (lsn_t)i;
+				nb = (size_t)MIN(ISO_BUFFER_SIZE / ISO_BLOCKSIZE, (file_length + ISO_BLOCKSIZE - 1) / ISO_BLOCKSIZE);
+				if (iso9660_iso_seek_read(p_iso, buf, lsn, (long)nb) != (nb * ISO_BLOCKSIZE)) {
+					uprintf("  Error reading ISO9660 file %s at LSN %lu",
+						psz_iso_name, (long unsigned int)lsn);
+					goto out;
+				}
+				buf_size = (DWORD)MIN(file_length, ISO_BUFFER_SIZE);
+				if (hash_file)
+					hash_write[HASH_MD5](&ctx, buf, buf_size);
+				ISO_BLOCKING(s = WriteFileWithRetry(file_handle, buf, buf_size, &wr_size, WRITE_RETRIES));
+				if (!s || wr_size != buf_size) {
+					uprintf("  Error writing file: %s", s ? "Short write detected" : WindowsErrorString());
+					goto out;
+				}
+				file_length -= wr_size;
+				nb_blocks += nb;
+				if (nb_blocks - last_nb_blocks >= PROGRESS_THRESHOLD) {
+					UpdateProgressWithInfo(OP_FILE_COPY, MSG_231, nb_blocks, total_blocks +
+						((fs_type != FS_NTFS) ? extra_blocks : 0));
+					last_nb_blocks = nb_blocks;
+				}
+			}
+			if (hash_file)
+				hash_final[HASH_MD5](&ctx);
+			if (md5_entry != NULL)
+				check_md5sum(md5_entry, ctx.buf);
+			if (fd_md5sum != NULL) {
+				for (j = 0; j < MD5_HASHSIZE; j++)
+					fprintf(fd_md5sum, "%02x", ctx.buf[j]);
+				fprintf(fd_md5sum, "  ./%s\n", &psz_fullpath[3]);
+			}
+		}
+		if (preserve_timestamps) {
+			LPFILETIME ft = to_filetime(mktime(&p_statbuf->tm));
+			if (!SetFileTime(file_handle, ft, ft, ft))
+				ruprintf(1000, "  Could not set timestamp: %s", WindowsErrorString());
+		}
+	}
+	r = 0;
+
+out:
+	if (free_p_statbuf)
+		iso9660_stat_free(p_statbuf);
+	ISO_BLOCKING(safe_closehandle(file_handle));
+	if ((r == 0) && (props.is_cfg || props.is_conf))
+		fix_config(psz_sanpath, psz_path, psz_basename, &props);
+	safe_free(psz_sanpath);
+	return r;
+}
+
+/*
+ * ISO9660 extraction manifest.
+ *
+ * When scanning an ISO9660 image, we record every directory and file we come across,
+ * so that extraction doesn't have to walk (and read) the whole directory tree again.
+ * Entries only reference offsets into a string pool, so that the manifest can be
+ * saved as is. Since the names we get depend on the extensions that are enabled, the
+ * manifest can only be used if the image is extracted with the same extension mask.
+ */
+typedef struct {
+	uint32_t path;		// Offset of the path in the string pool (e.g. "/boot/grub/grub.cfg")
+	uint32_t symlink;	// Offset of the Rock Ridge symbolic link target, or 0 if none
+	uint16_t dir_len;	// Length of the parent directory part of the path
+	uint8_t type;		// _STAT_FILE or _STAT_DIR
+	lsn_t lsn;
+	uint64_t size;
+	struct tm tm;
+} iso_manifest_entry;
+
+static struct {
+	BOOL valid;
+	char iso_path[MAX_PATH];
+	int64_t iso_size;
+	int64_t iso_mtime;
+	iso_extension_mask_t mask;
+	iso_manifest_entry* entry;
+	size_t nb_entries, max_entries;
+	char* pool;
+	size_t pool_size, pool_max;
+} iso_manifest = { 0 };
+
+static void ClearIsoManifest(void)
+{
+	safe_free(iso_manifest.entry);
+	safe_free(iso_manifest.pool);
+	memset(&iso_manifest, 0, sizeof(iso_manifest));
+}
+
+// Returns the offset of the added string in the pool, or 0 on error
+static uint32_t AddIsoManifestString(const char* str)
+{
+	size_t len = strlen(str) + 1;
+	uint32_t offset;
+	char* new_pool;
+
+	if (iso_manifest.pool_size + len > iso_manifest.pool_max) {
+		size_t new_max = max(iso_manifest.pool_max * 2, iso_manifest.pool_size + len + (size_t)(64 * KB));
+		if (new_max > UINT32_MAX)
+			return 0;
+		new_pool = realloc(iso_manifest.pool, new_max);
+		if (new_pool == NULL)
+			return 0;
+		iso_manifest.pool = new_pool;
+		iso_manifest.pool_max = new_max;
+		// Offset 0 is reserved for "no string"
+		if (iso_manifest.pool_size == 0)
+			iso_manifest.pool[iso_manifest.pool_size++] = 0;
+	}
+	offset = (uint32_t)iso_manifest.pool_size;
+	memcpy(&iso_manifest.pool[offset], str, len);
+	iso_manifest.pool_size += len;
+	return offset;
+}
+
+static void AddIsoManifestEntry(const char* psz_path, const char* psz_iso_name,
+	iso9660_stat_t* p_statbuf, BOOL is_symlink)
+{
+	iso_manifest_entry* e;
+
+	if (!iso_manifest.valid)
+		return;
+	if (iso_manifest.nb_entries >= iso_manifest.max_entries) {
+		size_t new_max = max(iso_manifest.max_entries * 2, 1024);
+		e = realloc(iso_manifest.entry, new_max * sizeof(iso_manifest_entry));
+		if (e == NULL)
+			goto err;
+		iso_manifest.entry = e;
+		iso_manifest.max_entries = new_max;
+	}
+	e = &iso_manifest.entry[iso_manifest.nb_entries];
+	memset(e, 0, sizeof(*e));
+	e->path = AddIsoManifestString(psz_iso_name);
+	if (e->path == 0 || strlen(psz_path) > UINT16_MAX)
+		goto err;
+	if (is_symlink) {
+		e->symlink = AddIsoManifestString(p_statbuf->rr.psz_symlink);
+		if (e->symlink == 0)
+			goto err;
+	}
+	e->dir_len = (uint16_t)strlen(psz_path);
+	e->type = (uint8_t)p_statbuf->type;
+	e->lsn = p_statbuf->lsn;
+	e->size = p_statbuf->total_size;
+	e->tm = p_statbuf->tm;
+	iso_manifest.nb_entries++;
+	return;
+
+err:
+	uprintf("  Could not build extraction manifest - Extraction will rescan the image");
+	ClearIsoManifest();
+}
+
+static int lsn_cmp(const void* a, const void* b)
+{
+	lsn_t lsn_a = iso_manifest.entry[*(const uint32_t*)a].lsn;
+	lsn_t lsn_b = iso_manifest.entry[*(const uint32_t*)b].lsn;
+
+	return (lsn_a > lsn_b) - (lsn_a < lsn_b);
+}
+
+// Check that the manifest from the scan applies to the image we are about to extract
+static BOOL IsIsoManifestUsable(const char* src_iso, iso_extension_mask_t mask)
+{
+	struct __stat64 stat;
+
+	return iso_manifest.valid && (iso_manifest.mask == mask) &&
+		(strcmp(iso_manifest.iso_path, src_iso) == 0) && (_stat64U(src_iso, &stat) == 0) &&
+		(stat.st_size == iso_manifest.iso_size) && (stat.st_mtime == iso_manifest.iso_mtime);
+}
+
+// Extract the files listed in the manifest. Returns 0 on success, nonzero on error.
+static int iso_extract_manifest(iso9660_t* p_iso)
+{
+	char psz_fullpath[MAX_PATH], psz_path[MAX_PATH];
+	uint8_t* buf = malloc(ISO_BUFFER_SIZE);
+	uint32_t* order = NULL;
+	iso9660_stat_t* p_statbuf = calloc(1, sizeof(iso9660_stat_t) + 1);
+	iso_manifest_entry* e;
+	size_t i, nb_files = 0, base_len = strlen(psz_extract_dir);
+	int r = 1;
+
+	if ((buf == NULL) || (p_statbuf == NULL))
+		goto out;
+	order = malloc(iso_manifest.nb_entries * sizeof(uint32_t) + 1);
+	if (order == NULL)
+		goto out;
+
+	UpdateProgressWithInfoInit(NULL, TRUE);
+	// Directories are recorded before their content, so they can all be created upfront
+	for (i = 0; i < iso_manifest.nb_entries; i++) {
+		e = &iso_manifest.entry[i];
+		if (e->type == _STAT_DIR) {
+			static_sprintf(psz_fullpath, "%s%s", psz_extract_dir, &iso_manifest.pool[e->path]);
+			iso_create_dir(psz_fullpath, &e->tm);
+		} else {
+			order[nb_files++] = (uint32_t)i;
+		}
+	}
+
+	// Then extract the files in the order they are laid out on the disc
+	qsort(order, nb_files, sizeof(uint32_t), lsn_cmp);
+	for (i = 0; i < nb_files; i++) {
+		if (ErrorStatus)
+			goto out;
+		e = &iso_manifest.entry[order[i]];
+		if (_snprintf_s(psz_fullpath, sizeof(psz_fullpath), _TRUNCATE, "%s%s",
+			psz_extract_dir, &iso_manifest.pool[e->path]) < 0)
+			goto out;
+		memcpy(psz_path, &iso_manifest.pool[e->path], e->dir_len);
+		psz_path[e->dir_len] = 0;
+		p_statbuf->type = _STAT_FILE;
+		p_statbuf->lsn = e->lsn;
+		p_statbuf->total_size = e->size;
+		p_statbuf->tm = e->tm;
+		p_statbuf->rr.b3_rock = (e->symlink != 0) ? yep : nope;
+		p_statbuf->rr.psz_symlink = (e->symlink != 0) ? &iso_manifest.pool[e->symlink] : NULL;
+		if (iso_extract_file(p_iso, psz_path, psz_fullpath, &psz_fullpath[base_len + e->dir_len + 1],
+			p_statbuf, (e->symlink != 0), buf))
+			goto out;
+	}
+	r = 0;
+
+out:
+	safe_free(order);
+	safe_free(p_statbuf);
+	safe_free(buf);
+	return r;
+}
+
+/*
+ * ISO analysis cache.
+ *
+ * Scanning a large image, especially one that resides on network storage, can take
+ * a few seconds, so we save the outcome of the scan, along with the extraction
+ * manifest, under our app data directory. Entries are named after a fingerprint of
+ * the image that is cheap to compute: its size, modification time, and the content
+ * of its first and last MB (the former of which includes the PVD and its timestamps).
+ * Since the scan depends on the ISO options, these, as well as the version of the
+ * application, are also part of the fingerprint.
+ */
+#define ISO_CACHE_DIR             "iso_cache"
+#define ISO_CACHE_MAGIC           "RUFUSISO"
+#define ISO_CACHE_VERSION         1
+#define ISO_CACHE_SAMPLE_SIZE     (1 * MB)
+#define ISO_CACHE_MAX_ENTRIES     32
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t img_report_size;
+	uint8_t fingerprint[SHA1_HASHSIZE];
+	uint64_t total_blocks;
+	uint64_t extra_blocks;
+	uint32_t has_ldlinux_c32;
+	uint32_t manifest_mask;
+	uint64_t nb_entries;
+	uint64_t pool_size;
+} iso_cache_header;
+
+static BOOL GetIsoFingerprint(const char* src_iso, uint8_t* fingerprint, struct __stat64* stat)
+{
+	BOOL r = FALSE;
+	HANDLE h = INVALID_HANDLE_VALUE;
+	HASH_CONTEXT ctx;
+	LARGE_INTEGER li;
+	DWORD size, rs;
+	uint8_t options[2] = { (uint8_t)enable_joliet, (uint8_t)enable_rockridge };
+	uint8_t* buf = NULL;
+	int i;
+
+	if (_stat64U(src_iso, stat) != 0)
+		return FALSE;
+	buf = malloc(ISO_CACHE_SAMPLE_SIZE);
+	h = CreateFileU(src_iso, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if ((buf == NULL) || (h == INVALID_HANDLE_VALUE))
+		goto out;
+
+	hash_init[HASH_SHA1](&ctx);
+	hash_write[HASH_SHA1](&ctx, (uint8_t*)rufus_version, sizeof(rufus_version));
+	hash_write[HASH_SHA1](&ctx, options, sizeof(options));
+	hash_write[HASH_SHA1](&ctx, (uint8_t*)&stat->st_size, sizeof(stat->st_size));
+	hash_write[HASH_SHA1](&ctx, (uint8_t*)&stat->st_mtime, sizeof(stat->st_mtime));
+	for (i = 0; i < 2; i++) {
+		size = (DWORD)min(stat->st_size, ISO_CACHE_SAMPLE_SIZE);
+		li.QuadPart = (i == 0) ? 0 : stat->st_size - size;
+		if (!SetFilePointerEx(h, li, NULL, FILE_BEGIN) || !ReadFile(h, buf, size, &rs, NULL) || (rs != size))
+			goto out;
+		hash_write[HASH_SHA1](&ctx, buf, size);
+	}
+	hash_final[HASH_SHA1](&ctx);
+	memcpy(fingerprint, ctx.buf, SHA1_HASHSIZE);
+	r = TRUE;
+
+out:
+	safe_closehandle(h);
+	safe_free(buf);
+	return r;
+}
+
+static void GetIsoCachePath(const uint8_t* fingerprint, char* path, size_t path_size)
+{
+	int i;
+	char hex[2 * SHA1_HASHSIZE + 1];
+
+	for (i = 0; i < SHA1_HASHSIZE; i++)
+		sprintf(&hex[2 * i], "%02x", fingerprint[i]);
+	safe_sprintf(path, path_size, "%s\\%s\\%s\\%s.bin", app_data_dir, FILES_DIR, ISO_CACHE_DIR, hex);
+}
+
+// Remove the oldest entry if the cache is full
+static void TrimIsoCache(void)
+{
+	WIN32_FIND_DATAA fd = { 0 }, oldest = { 0 };
+	HANDLE h;
+	int count = 0;
+	char path[MAX_PATH];
+
+	static_sprintf(path, "%s\\%s\\%s\\*.bin", app_data_dir, FILES_DIR, ISO_CACHE_DIR);
+	h = FindFirstFileU(path, &fd);
+	if (h == INVALID_HANDLE_VALUE)
+		return;
+	do {
+		if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		if ((count++ == 0) || (CompareFileTime(&fd.ftLastWriteTime, &oldest.ftLastWriteTime) < 0))
+			oldest = fd;
+	} while (FindNextFileU(h, &fd));
+	FindClose(h);
+	if (count >= ISO_CACHE_MAX_ENTRIES) {
+		static_sprintf(path, "%s\\%s\\%s\\%s", app_data_dir, FILES_DIR, ISO_CACHE_DIR, oldest.cFileName);
+		DeleteFileU(path);
+	}
+}
+
+// Check that a report read from the cache cannot send any of its users out of bounds
+#define IS_NUL_TERMINATED(s) (memchr(s, 0, sizeof(s)) != NULL)
+static BOOL IsCachedImgReportValid(const RUFUS_IMG_REPORT* report)
+{
+	int i;
+
+	if (!IS_NUL_TERMINATED(report->label) || !IS_NUL_TERMINATED(report->usb_label) ||
+		!IS_NUL_TERMINATED(report->cfg_path) || !IS_NUL_TERMINATED(report->reactos_path) ||
+		!IS_NUL_TERMINATED(report->efi_img_path) || !IS_NUL_TERMINATED(report->sl_version_str) ||
+		!IS_NUL_TERMINATED(report->sl_version_ext) || !IS_NUL_TERMINATED(report->grub2_version))
+		return FALSE;
+	if (report->wininst_index > MAX_WININST)
+		return FALSE;
+	for (i = 0; i < MAX_WININST; i++) {
+		if (!IS_NUL_TERMINATED(report->wininst_path[i]))
+			return FALSE;
+		// Users skip the "?:" or "?:\" prefix of these paths
+		if ((i < report->wininst_index) && (strlen(report->wininst_path[i]) < 3))
+			return FALSE;
+	}
+	for (i = 0; i < ARRAYSIZE(report->efi_boot_entry); i++) {
+		if (!IS_NUL_TERMINATED(report->efi_boot_entry[i].path))
+			return FALSE;
+	}
+	return ((report->has_grub2 & 0x7f) <= ARRAYSIZE(grub_dirname));
+}
+
+// Check that a manifest read from the cache can be used by iso_extract_manifest()
+static BOOL IsCachedIsoManifestValid(void)
+{
+	size_t i, len;
+	iso_manifest_entry* e;
+
+	// Offset 0 is the empty string and every string must be terminated
+	if ((iso_manifest.pool_size < 2) || (iso_manifest.pool[0] != 0) ||
+		(iso_manifest.pool[iso_manifest.pool_size - 1] != 0))
+		return FALSE;
+	for (i = 0; i < iso_manifest.nb_entries; i++) {
+		e = &iso_manifest.entry[i];
+		if ((e->type != _STAT_FILE) && (e->type != _STAT_DIR))
+			return FALSE;
+		if ((e->path == 0) || (e->path >= iso_manifest.pool_size) || (e->symlink >= iso_manifest.pool_size))
+			return FALSE;
+		// The path must be the parent directory, followed by a '/' and a name
+		len = strlen(&iso_manifest.pool[e->path]);
+		if ((len >= MAX_PATH) || (e->dir_len >= len) || (iso_manifest.pool[e->path + e->dir_len] != '/'))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+// Log the results that a full scan of the image would have logged
+static void LogCachedIsoAnalysis(void)
+{
+	char fses[256] = { 0 };
+	int i;
+
+	if (img_report.cfg_path[0] != 0)
+		uprintf("  Will use '%s' for Syslinux", img_report.cfg_path);
+	if (HAS_SYSLINUX(img_report) && img_report.sl_version != 0)
+		uprintf("  Detected Syslinux version: %s%s", img_report.sl_version_str, img_report.sl_version_ext);
+	if (img_report.efi_img_path[0] != 0)
+		uprintf("  Detected EFI image: '%s'", img_report.efi_img_path);
+	for (i = 0; i < ARRAYSIZE(img_report.efi_boot_entry); i++) {
+		if (img_report.efi_boot_entry[i].path[0] != 0)
+			uprintf("  Detected EFI bootloader: '%s'", img_report.efi_boot_entry[i].path);
+	}
+	if (HAS_WINPE(img_report) && img_report.uses_minint)
+		uprintf("  Detected /minint in txtsetup.sif OsLoadOptions");
+	if (img_report.grub2_version[0] != 0)
+		uprintf("  Detected GRUB version: %s", img_report.grub2_version);
+	for (i = 0; i < ARRAYSIZE(grub_fs_name); i++) {
+		if (!(img_report.has_grub2_fs & (1 << i)))
+			continue;
+		if (fses[0] != 0)
+			static_strcat(fses, ", ");
+		static_strcat(fses, grub_fs_name[i]);
+	}
+	if (fses[0] != 0)
+		uprintf("  Supported GRUB filesystems: %s", fses);
+}
+
+// Restore the scan results for an image we have already analysed
+static BOOL LoadIsoScanCache(const char* src_iso)
+{
+	BOOL r = FALSE;
+	FILE* fd = NULL;
+	iso_cache_header hdr;
+	struct __stat64 stat;
+	uint8_t fingerprint[SHA1_HASHSIZE];
+	char path[MAX_PATH];
+	RUFUS_IMG_REPORT report;
+
+	if (!GetIsoFingerprint(src_iso, fingerprint, &stat))
+		return FALSE;
+	GetIsoCachePath(fingerprint, path, sizeof(path));
+	fd = fopenU(path, "rb");
+	if (fd == NULL)
+		return FALSE;
+	if ((fread(&hdr, sizeof(hdr), 1, fd) != 1) || (memcmp(hdr.magic, ISO_CACHE_MAGIC, sizeof(hdr.magic)) != 0) ||
+		(hdr.version != ISO_CACHE_VERSION) || (hdr.img_report_size != sizeof(RUFUS_IMG_REPORT)) ||
+		(memcmp(hdr.fingerprint, fingerprint, SHA1_HASHSIZE) != 0) ||
+		(hdr.nb_entries > UINT32_MAX) || (hdr.pool_size > UINT32_MAX) ||
+		((hdr.nb_entries != 0) && (hdr.pool_size == 0)) || (hdr.has_ldlinux_c32 > 1) ||
+		(fread(&report, sizeof(report), 1, fd) != 1) || !IsCachedImgReportValid(&report))
+		goto out;
+
+	ClearIsoManifest();
+	if (hdr.nb_entries != 0) {
+		iso_manifest.entry = malloc((size_t)hdr.nb_entries * sizeof(iso_manifest_entry));
+		iso_manifest.pool = malloc((size_t)hdr.pool_size);
+		if ((iso_manifest.entry == NULL) || (iso_manifest.pool == NULL) ||
+			(fread(iso_manifest.entry, sizeof(iso_manifest_entry), (size_t)hdr.nb_entries, fd) != hdr.nb_entries) ||
+			(fread(iso_manifest.pool, 1, (size_t)hdr.pool_size, fd) != hdr.pool_size)) {
+			ClearIsoManifest();
+			goto out;
+		}
+		iso_manifest.nb_entries = iso_manifest.max_entries = (size_t)hdr.nb_entries;
+		iso_manifest.pool_size = iso_manifest.pool_max = (size_t)hdr.pool_size;
+		if (!IsCachedIsoManifestValid()) {
+			ClearIsoManifest();
+			goto out;
+		}
+		iso_manifest.mask = (iso_extension_mask_t)hdr.manifest_mask;
+		static_strcpy(iso_manifest.iso_path, src_iso);
+		iso_manifest.iso_size = stat.st_size;
+		iso_manifest.iso_mtime = stat.st_mtime;
+		iso_manifest.valid = TRUE;
+	}
+	memcpy(&img_report, &report, sizeof(img_report));
+	total_blocks = hdr.total_blocks;
+	extra_blocks = hdr.extra_blocks;
+	has_ldlinux_c32 = (BOOL)hdr.has_ldlinux_c32;
+	uprintf("  Using cached analysis from '%s'", path);
+	LogCachedIsoAnalysis();
+	r = TRUE;
+
+out:
+	fclose(fd);
+	if (!r) {
+		uprintf("  Discarding invalid cached analysis '%s'", path);
+		DeleteFileU(path);
+	}
+	return r;
+}
+
+static void SaveIsoScanCache(const char* src_iso)
+{
+	FILE* fd = NULL;
+	iso_cache_header hdr = { 0 };
+	struct __stat64 stat;
+	char path[MAX_PATH];
+
+	if (!GetIsoFingerprint(src_iso, hdr.fingerprint, &stat))
+		return;
+	static_sprintf(path, "%s\\%s", app_data_dir, FILES_DIR);
+	IGNORE_RETVAL(_mkdirU(path));
+	static_sprintf(path, "%s\\%s\\%s", app_data_dir, FILES_DIR, ISO_CACHE_DIR);
+	IGNORE_RETVAL(_mkdirU(path));
+	TrimIsoCache();
+
+	memcpy(hdr.magic, ISO_CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = ISO_CACHE_VERSION;
+	hdr.img_report_size = sizeof(RUFUS_IMG_REPORT);
+	hdr.total_blocks = total_blocks;
+	hdr.extra_blocks = extra_blocks;
+	hdr.has_ldlinux_c32 = (uint32_t)has_ldlinux_c32;
+	if (iso_manifest.valid) {
+		hdr.manifest_mask = (uint32_t)iso_manifest.mask;
+		hdr.nb_entries = iso_manifest.nb_entries;
+		hdr.pool_size = iso_manifest.pool_size;
+	}
+
+	GetIsoCachePath(hdr.fingerprint, path, sizeof(path));
+	fd = fopenU(path, "wb");
+	if (fd == NULL)
+		return;
+	if ((fwrite(&hdr, sizeof(hdr), 1, fd) != 1) || (fwrite(&img_report, sizeof(img_report), 1, fd) != 1) ||
+		(fwrite(iso_manifest.entry, sizeof(iso_manifest_entry), (size_t)hdr.nb_entries, fd) != hdr.nb_entries) ||
+		(fwrite(iso_manifest.pool, 1, (size_t)hdr.pool_size, fd) != hdr.pool_size)) {
+		uprintf("  Could not save ISO analysis to '%s'", path);
+		fclose(fd);
+		DeleteFileU(path);
+		return;
+	}
+	fclose(fd);
+}
+
+// Returns 0 on success, >0 on error, <0 to ignore current dir
+static int iso_extract_files(iso9660_t* p_iso, const char *psz_path)
+{
+	BOOL is_symlink;
 	int length, r = 1;
-	char psz_fullpath[MAX_PATH], *psz_basename = NULL, *psz_sanpath = NULL;
-	char tmp[128], target_path[256];
+	char psz_fullpath[MAX_PATH], *psz_basename = NULL;
 	const char *psz_iso_name = &psz_fullpath[strlen(psz_extract_dir)];
 	_Static_assert(ISO_BUFFER_SIZE % ISO_BLOCKSIZE == 0,
 		"ISO_BUFFER_SIZE is not a multiple of ISO_BLOCKSIZE");
@@ -790,9 +1698,6 @@ static int iso_extract_files(iso9660_t* p_iso, const char *psz_path)
 	CdioListNode_t* p_entnode;
 	iso9660_stat_t *p_statbuf;
 	CdioISO9660FileList_t* p_entlist = NULL;
-	size_t i, j, nb;
-	lsn_t lsn;
-	int64_t file_length;
 
 	if ((p_iso == NULL) || (psz_path == NULL) || (buf == NULL)) {
 		safe_free(buf);
@@ -815,7 +1720,6 @@ static int iso_extract_files(iso9660_t* p_iso, const char *psz_path)
 	_CDIO_LIST_FOREACH(p_entnode, p_entlist) {
 		if (ErrorStatus) goto out;
 		p_statbuf = (iso9660_stat_t*) _cdio_list_node_data(p_entnode);
-		free_p_statbuf = FALSE;
 		if (scan_only && (p_statbuf->rr.b3_rock == yep) && enable_rockridge) {
 			if (p_statbuf->rr.u_su_fields & ISO_ROCK_SUF_PL) {
 				if (!img_report.has_deep_directories)
@@ -852,185 +1756,25 @@ static int iso_extract_files(iso9660_t* p_iso, const char *psz_path)
 		} else {
 			iso9660_name_translate_ext(p_statbuf->filename, psz_basename, joliet_level);
 		}
+		if (scan_only)
+			AddIsoManifestEntry(psz_path, psz_iso_name, p_statbuf, is_symlink);
 		if (p_statbuf->type == _STAT_DIR) {
-			if (!scan_only) {
-				psz_sanpath = sanitize_filename(psz_fullpath, &is_identical);
-				IGNORE_RETVAL(_mkdirU(psz_sanpath));
-				if (preserve_timestamps) {
-					LPFILETIME ft = to_filetime(mktime(&p_statbuf->tm));
-					set_directory_timestamp(psz_sanpath, ft, ft, ft);
-				}
-				safe_free(psz_sanpath);
-			}
+			if (!scan_only)
+				iso_create_dir(psz_fullpath, &p_statbuf->tm);
 			r = iso_extract_files(p_iso, psz_iso_name);
 			if (r > 0)
 				goto out;
 			if (r < 0)	// Stop processing current dir
 				break;
-		} else {
-			file_length = p_statbuf->total_size;
-			if (check_iso_props(psz_path, file_length, psz_basename, psz_fullpath, &props)) {
-				if (is_symlink && (file_length == 0)) {
-					// Add symlink duplicated files to total_size at scantime
-					if ((strcmp(psz_path, "/firmware") == 0)) {
-						static_sprintf(target_path, "%s/%s", psz_path, p_statbuf->rr.psz_symlink);
-						iso9660_stat_t* p_statbuf2 = iso9660_ifs_stat_translate(p_iso, target_path);
-						if (p_statbuf2 != NULL) {
-							extra_blocks += (p_statbuf2->total_size + ISO_BLOCKSIZE - 1) / ISO_BLOCKSIZE;
-							iso9660_stat_free(p_statbuf2);
-						}
-					} else if ((strcmp(p_statbuf->filename, "live") == 0) &&
-						(strcmp(p_statbuf->rr.psz_symlink, "casper") == 0)) {
-						// Mint LMDE requires working symbolic links and therefore requires the use of NTFS
-						img_report.needs_ntfs = TRUE;
-					}
-				}
-				continue;
-			}
-			if (!is_symlink)
-				print_extracted_file(psz_fullpath, file_length);
-			for (i = 0; i < NB_OLD_C32; i++) {
-				if (props.is_old_c32[i] && use_own_c32[i]) {
-					static_sprintf(tmp, "%s/syslinux-%s/%s", FILES_DIR, embedded_sl_version_str[0], old_c32_name[i]);
-					if (CopyFileU(tmp, psz_fullpath, FALSE)) {
-						uprintf("  Replaced with local version %s", IsFileInDB(tmp)?"✓":"✗");
-						break;
-					}
-					uprintf("  Could not replace file: %s", WindowsErrorString());
-				}
-			}
-			if (i < NB_OLD_C32)
-				continue;
-			psz_sanpath = sanitize_filename(psz_fullpath, &is_identical);
-			if (!is_identical)
-				uprintf("  File name sanitized to '%s'", psz_sanpath);
-			create_file = TRUE;
-			if (is_symlink) {
-				if (fs_type == FS_NTFS) {
-					// Replicate symlinks if NTFS is being used
-					static_sprintf(target_path, "%s/%s", psz_path, p_statbuf->rr.psz_symlink);
-					iso9660_stat_t* p_statbuf2 = iso9660_ifs_stat_translate(p_iso, target_path);
-					if (p_statbuf2 != NULL) {
-						to_windows_path(psz_fullpath);
-						to_windows_path(p_statbuf->rr.psz_symlink);
-						uprintf("Symlinking: %s%s ➔ %s", psz_fullpath,
-							(p_statbuf2->type == _STAT_DIR) ? "\\" : "", p_statbuf->rr.psz_symlink);
-						if (!CreateSymbolicLinkU(psz_fullpath, p_statbuf->rr.psz_symlink,
-							(p_statbuf2->type == _STAT_DIR) ? SYMBOLIC_LINK_FLAG_DIRECTORY : 0))
-							uprintf("  Could not create symlink: %s", WindowsErrorString());
-						to_unix_path(p_statbuf->rr.psz_symlink);
-						to_unix_path(psz_fullpath);
-						iso9660_stat_free(p_statbuf2);
-						create_file = FALSE;
-					}
-				} else if (file_length == 0) {
-					if ((safe_stricmp(p_statbuf->filename, "syslinux") == 0) &&
-						// Special handling for ISOs that have a syslinux → isolinux symbolic link (e.g. Knoppix)
-						(safe_stricmp(p_statbuf->rr.psz_symlink, "isolinux") == 0)) {
-						static_strcpy(symlinked_syslinux, psz_fullpath);
-						print_extracted_file(psz_fullpath, file_length);
-						uprintf("  Found Rock Ridge symbolic link to '%s'", p_statbuf->rr.psz_symlink);
-					} else if (strcmp(psz_path, "/firmware") == 0) {
-						// Special handling for ISOs that use symlinks for /firmware/ (e.g. Debian non-free)
-						// TODO: Do we want to do this for all file symlinks?
-						static_sprintf(target_path, "%s/%s", psz_path, p_statbuf->rr.psz_symlink);
-						p_statbuf = iso9660_ifs_stat_translate(p_iso, target_path);
-						if (p_statbuf != NULL) {
-							// The original p_statbuf will be freed automatically, but not
-							// the new one so we need to force an explicit free.
-							free_p_statbuf = TRUE;
-							file_length = p_statbuf->total_size;
-							print_extracted_file(psz_fullpath, file_length);
-							uprintf("  Duplicated from '%s'", target_path);
-						} else {
-							uprintf("Could not resolve Rock Ridge Symlink - ABORTING!");
-							goto out;
-						}
-					} else {
-						print_extracted_file(psz_fullpath, safe_strlen(p_statbuf->rr.psz_symlink));
-						uprintf("  Ignoring Rock Ridge symbolic link to '%s'", p_statbuf->rr.psz_symlink);
-					}
-				} else {
-					uuprintf("Unexpected symlink length: %d", file_length);
-					create_file = FALSE;
-				}
-			}
-			if (create_file) {
-				file_handle = CreatePreallocatedFile(psz_sanpath, GENERIC_READ | GENERIC_WRITE,
-					FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, file_length);
-				if (file_handle == INVALID_HANDLE_VALUE) {
-					err = GetLastError();
-					uprintf("  Unable to create file: %s", WindowsErrorString());
-					if (((err == ERROR_ACCESS_DENIED) || (err == ERROR_INVALID_HANDLE)) &&
-						(safe_strcmp(&psz_sanpath[3], autorun_name) == 0))
-						uprintf(stupid_antivirus);
-					else
-						goto out;
-				} else if (is_symlink) {
-					// Create a text file that contains the target link
-					ISO_BLOCKING(r = WriteFileWithRetry(file_handle, p_statbuf->rr.psz_symlink,
-						(DWORD)safe_strlen(p_statbuf->rr.psz_symlink), &wr_size, WRITE_RETRIES));
-					if (!r) {
-						uprintf("  Error writing file: %s", WindowsErrorString());
-						goto out;
-					}
-				} else {
-					if (fd_md5sum != NULL)
-						hash_init[HASH_MD5](&ctx);
-					for (i = 0; file_length > 0; i += nb) {
-						if (ErrorStatus)
-							goto out;
-						lsn = p_statbuf->lsn + (lsn_t)i;
-						nb = (size_t)MIN(ISO_BUFFER_SIZE / ISO_BLOCKSIZE, (file_length + ISO_BLOCKSIZE - 1) / ISO_BLOCKSIZE);
-						if (iso9660_iso_seek_read(p_iso, buf, lsn, (long)nb) != (nb * ISO_BLOCKSIZE)) {
-							uprintf("  Error reading ISO9660 file %s at LSN %lu",
-								psz_iso_name, (long unsigned int)lsn);
-							goto out;
-						}
-						buf_size = (DWORD)MIN(file_length, ISO_BUFFER_SIZE);
-						if (fd_md5sum != NULL)
-							hash_write[HASH_MD5](&ctx, buf, buf_size);
-						ISO_BLOCKING(r = WriteFileWithRetry(file_handle, buf, buf_size, &wr_size, WRITE_RETRIES));
-						if (!r || wr_size != buf_size) {
-							uprintf("  Error writing file: %s", r ? "Short write detected" : WindowsErrorString());
-							goto out;
-						}
-						file_length -= wr_size;
-						nb_blocks += nb;
-						if (nb_blocks - last_nb_blocks >= PROGRESS_THRESHOLD) {
-							UpdateProgressWithInfo(OP_FILE_COPY, MSG_231, nb_blocks, total_blocks +
-								((fs_type != FS_NTFS) ? extra_blocks : 0));
-							last_nb_blocks = nb_blocks;
-						}
-					}
-					if (fd_md5sum != NULL) {
-						hash_final[HASH_MD5](&ctx);
-						for (j = 0; j < MD5_HASHSIZE; j++)
-							fprintf(fd_md5sum, "%02x", ctx.buf[j]);
-						fprintf(fd_md5sum, "  ./%s\n", &psz_fullpath[3]);
-					}
-				}
-				if (preserve_timestamps) {
-					LPFILETIME ft = to_filetime(mktime(&p_statbuf->tm));
-					if (!SetFileTime(file_handle, ft, ft, ft))
-						uprintf("  Could not set timestamp: %s", WindowsErrorString());
-				}
-			}
-			if (free_p_statbuf)
-				iso9660_stat_free(p_statbuf);
-			ISO_BLOCKING(safe_closehandle(file_handle));
-			if (props.is_cfg || props.is_conf)
-				fix_config(psz_sanpath, psz_path, psz_basename, &props);
-			safe_free(psz_sanpath);
+		} else if (iso_extract_file(p_iso, psz_path, psz_fullpath, psz_basename, p_statbuf, is_symlink, buf)) {
+			goto out;
 		}
 	}
 	r = 0;
 
 out:
-	ISO_BLOCKING(safe_closehandle(file_handle));
 	if (p_entlist != NULL)
 		iso9660_filelist_free(p_entlist);
-	safe_free(psz_sanpath);
 	safe_free(buf);
 	return r;
 }
@@ -1044,26 +1788,25 @@ void GetGrubVersion(char* buf, size_t buf_size, const char* source)
 	// On the other hand, boy do they want to leech of FSF/GNU developed software, while
 	// not having it mention GNU anywhere. See:
 	// https://src.fedoraproject.org/rpms/grub2/blob/rawhide/f/0024-Don-t-say-GNU-Linux-in-generated-menus.patch
-	const char* grub_version_str[] = { "GRUB  version %s", "GRUB version %s" };
-	const char* grub_debug_is_enabled_str = "grub_debug_is_enabled";
+	// NB: The last entry is not a version string but a marker for Fedora's GRUB patches
+	const char* grub_str[] = { "GRUB  version %s", "GRUB version %s", "grub_debug_is_enabled" };
 	const size_t max_string_size = 32;	// The strings above *MUST* be no longer than this value
 	char grub_version[192] = { 0 };
-	size_t i, j;
+	size_t pos, k;
 	BOOL has_grub_debug_is_enabled = FALSE;
+	PatternScan ps;
 
 	// Make sure we don't overflow our buffer
-	if (buf_size > max_string_size) {
-		for (i = 0; i < buf_size - max_string_size; i++) {
-			for (j = 0; j < ARRAYSIZE(grub_version_str); j++) {
-				if (memcmp(&buf[i], grub_version_str[j], strlen(grub_version_str[j])) == 0) {
-					// For CentOS, who decided to add a '\n' after "GRUB  version %s"
-					if (buf[i + strlen(grub_version_str[j]) + 1] == '\0')
-						i++;
-					static_strcpy(grub_version, &buf[i + strlen(grub_version_str[j]) + 1]);
-				}
-			}
-			if (memcmp(&buf[i], grub_debug_is_enabled_str, strlen(grub_debug_is_enabled_str)) == 0)
+	if ((buf_size > max_string_size) && PatternScanInit(&ps, buf, buf_size, grub_str, ARRAYSIZE(grub_str))) {
+		while ((pos = PatternScanNext(&ps, &k)) < buf_size - max_string_size) {
+			if (k == ARRAYSIZE(grub_str) - 1) {
 				has_grub_debug_is_enabled = TRUE;
+				continue;
+			}
+			// For CentOS, who decided to add a '\n' after "GRUB  version %s"
+			if (buf[pos + strlen(grub_str[k]) + 1] == '\0')
+				pos++;
+			static_strcpy(grub_version, &buf[pos + strlen(grub_str[k]) + 1]);
 		}
 	}
 
@@ -1130,15 +1873,18 @@ void GetGrubFs(char* buf, size_t buf_size)
 {
 	const char* grub_fshelp_str = "fshelp";
 	const size_t max_string_size = 32;
-	size_t i;
-
-	if (buf_size > max_string_size) {
-		for (i = 0; i < buf_size - max_string_size; i++) {
-			if (memcmp(&buf[i], grub_fshelp_str, strlen(grub_fshelp_str) + 1) == 0) {
-				if (buf[i + strlen(grub_fshelp_str) + 1] != 0 && strlen(&buf[i + strlen(grub_fshelp_str) + 1]) < 12) {
-					StrArrayAddUnique(&grub_filesystems, &buf[i + strlen(grub_fshelp_str) + 1], TRUE);
-				}
-			}
+	size_t pos;
+	char* fs;
+	PatternScan ps;
+
+	if ((buf_size > max_string_size) && PatternScanInit(&ps, buf, buf_size, &grub_fshelp_str, 1)) {
+		while ((pos = PatternScanNext(&ps, NULL)) < buf_size - max_string_size) {
+			// We want the NUL terminated "fshelp" string that precedes the filesystem name
+			if (buf[pos + strlen(grub_fshelp_str)] != 0)
+				continue;
+			fs = &buf[pos + strlen(grub_fshelp_str) + 1];
+			if (fs[0] != 0 && strlen(fs) < 12)
+				StrArrayAddUnique(&grub_filesystems, fs, TRUE);
 		}
 	}
 }
@@ -1157,19 +1903,19 @@ void GetEfiBootInfo(char* buf, size_t buf_size, const char* source)
 		{ "systemd-boot", "#### LoaderInfo: systemd-boot " },
 	};
 	const size_t max_string_size = 64;
+	const char* search_string[ARRAYSIZE(boot_info)];
 	size_t i, j, k;
-
-	if (buf_size > max_string_size) {
-		for (i = 0; i < buf_size - max_string_size; i++) {
-			for (j = 0; j < ARRAYSIZE(boot_info); j++) {
-				if (memcmp(&buf[i], boot_info[j].search_string, strlen(boot_info[j].search_string)) == 0) {
-					i += strlen(boot_info[j].search_string);
-					for (k = 0; k < 32 && i + k < buf_size - 1 && !isspace(buf[i + k]); k++);
-					buf[i + k] = '\0';
-					uprintf("  Detected %s version: %s (from '%s')", boot_info[j].label, &buf[i], source);
-					return;
-				}
-			}
+	PatternScan ps;
+
+	for (j = 0; j < ARRAYSIZE(boot_info); j++)
+		search_string[j] = boot_info[j].search_string;
+	if ((buf_size > max_string_size) && PatternScanInit(&ps, buf, buf_size, search_string, ARRAYSIZE(search_string))) {
+		i = PatternScanNext(&ps, &j);
+		if (i < buf_size - max_string_size) {
+			i += strlen(boot_info[j].search_string);
+			for (k = 0; k < 32 && i + k < buf_size - 1 && !isspace(buf[i + k]); k++);
+			buf[i + k] = '\0';
+			uprintf("  Detected %s version: %s (from '%s')", boot_info[j].label, &buf[i], source);
 		}
 	}
 }
@@ -1205,6 +1951,11 @@ BOOL ExtractISO(const char* src_iso, const char* dest_dir, BOOL scan)
 		total_blocks = 0;
 		extra_blocks = 0;
 		has_ldlinux_c32 = FALSE;
+		ClearIsoManifest();
+		if (LoadIsoScanCache(src_iso)) {
+			SendMessage(hMainDialog, UM_PROGRESS_EXIT, 0, 0);
+			return TRUE;
+		}
 		// String array of all isolinux/syslinux locations
 		StrArrayCreate(&config_path, 8);
 		StrArrayCreate(&isolinux_path, 8);
@@ -1223,6 +1974,8 @@ BOOL ExtractISO(const char* src_iso, const char* dest_dir, BOOL scan)
 		iso_blocking_status = 0;
 		symlinked_syslinux[0] = 0;
 		StrArrayClear(&modified_files);
+		if (!iso_map_open(&iso_map, src_iso))
+			uprintf("Could not map image - Using buffered copy");
 		if (validate_md5sum) {
 			md5sum_totalbytes = 0;
 			// If there isn't an already existing md5sum.txt create one
@@ -1233,7 +1986,7 @@ BOOL ExtractISO(const char* src_iso, const char* dest_dir, BOOL scan)
 					uprintf("WARNING: Could not create '%s'", md5sum_name[0]);
 			} else {
 				md5sum_size = ReadISOFileToBuffer(src_iso, md5sum_name[0], (uint8_t**)&md5sum_data);
-				md5sum_pos = md5sum_data;
+				parse_md5sum();
 			}
 		}
 	}
@@ -1291,12 +2044,38 @@ try_iso:
 		else
 			uprintf("%sThis image will not be extracted using any ISO extensions", spacing);
 	}
-	r = iso_extract_files(p_iso, "");
+	if (scan_only) {
+		// Record the layout of the image, so that extraction doesn't have to go through it again
+		iso_manifest.valid = TRUE;
+		r = iso_extract_files(p_iso, "");
+		// The scan runs with Joliet disabled, so the names we recorded only apply if the
+		// extraction is also going to run without Joliet (see the mask selection above).
+		if (enable_joliet && enable_rockridge && !img_report.has_long_filename &&
+			(img_report.has_symlinks != SYMLINKS_RR))
+			ClearIsoManifest();
+		if ((r == 0) && (iso_manifest.valid) && (!img_report.has_deep_directories)) {
+			struct __stat64 stat;
+			if (_stat64U(src_iso, &stat) == 0) {
+				static_strcpy(iso_manifest.iso_path, src_iso);
+				iso_manifest.iso_size = stat.st_size;
+				iso_manifest.iso_mtime = stat.st_mtime;
+				iso_manifest.mask = iso_extension_mask;
+			} else {
+				ClearIsoManifest();
+			}
+		} else {
+			ClearIsoManifest();
+		}
+	} else if (IsIsoManifestUsable(src_iso, iso_extension_mask)) {
+		uprintf("Using the %d entries recorded during the ISO analysis", (int)iso_manifest.nb_entries);
+		r = iso_extract_manifest(p_iso);
+	} else {
+		r = iso_extract_files(p_iso, "");
+	}
 
 out:
 	iso_blocking_status = -1;
 	if (scan_only) {
-		const char* fs_name[] = { "fat", "exfat", "ntfs" };
 		struct __stat64 stat;
 		char fses[256] = { 0 };
 		// Find if there is a mismatch between the ISO size, as reported by the PVD, and the actual file size
@@ -1447,8 +2226,8 @@ out:
 			if (i != 0)
 				static_strcat(fses, ", ");
 			static_strcat(fses, grub_filesystems.String[i]);
-			for (j = 0; j < ARRAYSIZE(fs_name); j++)
-				if (stricmp(grub_filesystems.String[i], fs_name[j]) == 0)
+			for (j = 0; j < ARRAYSIZE(grub_fs_name); j++)
+				if (stricmp(grub_filesystems.String[i], grub_fs_name[j]) == 0)
 					img_report.has_grub2_fs |= (1 << j);
 		}
 		if (*fses)
@@ -1457,6 +2236,8 @@ out:
 		StrArrayDestroy(&config_path);
 		StrArrayDestroy(&isolinux_path);
 		StrArrayDestroy(&grub_filesystems);
+		if ((r == 0) && (ErrorStatus == 0))
+			SaveIsoScanCache(src_iso);
 		SendMessage(hMainDialog, UM_PROGRESS_EXIT, 0, 0);
 	} else {
 		// Solus and other ISOs only provide EFI boot files in a FAT efi.img
@@ -1554,11 +2335,19 @@ out:
 		if (fd_md5sum != NULL) {
 			uprintf("Created: %s\\%s (%s)", dest_dir, md5sum_name[0], SizeToHumanReadable(ftell(fd_md5sum), FALSE, FALSE));
 			fclose(fd_md5sum);
+			fd_md5sum = NULL;
 		} else if (md5sum_data != NULL) {
+			if (md5sum_mismatches != 0)
+				uprintf("WARNING: %d extracted file(s) do not match %s", md5sum_mismatches, md5sum_name[0]);
+			safe_free(md5sum_table);
+			md5sum_table_size = 0;
 			safe_free(md5sum_data);
 			md5sum_size = 0;
 		}
+		// Must come last, as the above may still add files to the extracted directories
+		apply_directory_timestamps(r == 0);
 	}
+	iso_map_close(&iso_map);
 	iso9660_close(p_iso);
 	udf_close(p_udf);
 	if ((r != 0) && (ErrorStatus == 0))
@@ -1578,6 +2367,9 @@ int64_t ExtractISOFile(const char* iso, const char* iso_file, const char* dest_f
 	udf_dirent_t *p_udf_root = NULL, *p_udf_file = NULL;
 	iso9660_stat_t *p_statbuf = NULL;
 	lsn_t lsn;
+	uint32_t start, end;
+	uint64_t offset;
+	iso_map_t map = { INVALID_HANDLE_VALUE, NULL, NULL, 0, 0, 0 };
 	HANDLE file_handle = INVALID_HANDLE_VALUE;
 
 	file_handle = CreateFileU(dest_file, GENERIC_READ | GENERIC_WRITE,
@@ -1603,6 +2395,15 @@ int64_t ExtractISOFile(const char* iso, const char* iso_file, const char* dest_f
 		goto out;
 	}
 	file_length = udf_get_file_length(p_udf_file);
+	if (udf_get_lba(&p_udf_file->fe, &start, &end) &&
+		((uint64_t)(end - start + 1) * UDF_BLOCKSIZE >= (uint64_t)file_length) && iso_map_open(&map, iso)) {
+		offset = (uint64_t)(p_udf_file->i_part_start + start) * UDF_BLOCKSIZE;
+		if (iso_map_can_copy(&map, offset, file_length)) {
+			if (iso_map_write(&map, file_handle, offset, file_length, FALSE))
+				r = file_length;
+			goto out;
+		}
+	}
 	while (file_length > 0) {
 		memset(buf, 0, UDF_BLOCKSIZE);
 		read_size = udf_read_block(p_udf_file, buf, 1);
@@ -1636,6 +2437,12 @@ try_iso:
 	}
 
 	file_length = p_statbuf->total_size;
+	offset = (uint64_t)p_statbuf->lsn * ISO_BLOCKSIZE;
+	if (iso_map_open(&map, iso) && iso_map_can_copy(&map, offset, file_length)) {
+		if (iso_map_write(&map, file_handle, offset, file_length, FALSE))
+			r = file_length;
+		goto out;
+	}
 	for (i = 0; file_length > 0; i++) {
 		memset(buf, 0, ISO_BLOCKSIZE);
 		lsn = p_statbuf->lsn + (lsn_t)i;
@@ -1654,6 +2461,7 @@ try_iso:
 
 out:
 	safe_closehandle(file_handle);
+	iso_map_close(&map);
 	if (r == 0)
 		DeleteFileU(dest_file);
 	iso9660_stat_free(p_statbuf);
@@ -1758,6 +2566,94 @@ out:
 	return ret;
 }
 
+// Read size bytes at offset from a file located on an ISO image, without reading the whole
+// file. NB: Like wimlib's ISO reader, this assumes that the file's blocks are contiguous.
+// Returns the number of bytes read, which may be less than size at the end of the file.
+uint32_t ReadISOFileRange(const char* iso, const char* iso_file, uint64_t offset, uint32_t size, uint8_t* buf)
+{
+	int64_t file_length;
+	uint32_t ret = 0, nblocks;
+	uint64_t start;
+	uint8_t* tmp = NULL;
+	iso9660_t* p_iso = NULL;
+	udf_t* p_udf = NULL;
+	udf_dirent_t *p_udf_root = NULL, *p_udf_file = NULL;
+	iso9660_stat_t* p_statbuf = NULL;
+
+	cdio_loglevel_default = CDIO_LOG_WARN;
+
+	// ISO_BLOCKSIZE == UDF_BLOCKSIZE, so we can compute the block range upfront
+	start = offset - (offset % ISO_BLOCKSIZE);
+
+	// First try to open as UDF - fallback to ISO if it failed
+	p_udf = udf_open(iso);
+	if (p_udf == NULL)
+		goto try_iso;
+	p_udf_root = udf_get_root(p_udf, true, 0);
+	if (p_udf_root == NULL) {
+		uprintf("Could not locate UDF root directory");
+		goto out;
+	}
+	p_udf_file = udf_fopen(p_udf_root, iso_file);
+	if (!p_udf_file) {
+		uprintf("Could not locate file %s in ISO image", iso_file);
+		goto out;
+	}
+	file_length = udf_get_file_length(p_udf_file);
+	if (offset >= (uint64_t)file_length)
+		goto out;
+	size = (uint32_t)min(size, (uint64_t)file_length - offset);
+	nblocks = (uint32_t)((offset + size - start + UDF_BLOCKSIZE - 1) / UDF_BLOCKSIZE);
+	tmp = malloc((size_t)nblocks * UDF_BLOCKSIZE);
+	if (tmp == NULL)
+		goto out;
+	if (!udf_setpos(p_udf_file, start) ||
+		udf_read_block(p_udf_file, tmp, nblocks) < (ssize_t)(offset + size - start)) {
+		uprintf("Error reading UDF file %s", iso_file);
+		goto out;
+	}
+	memcpy(buf, &tmp[offset - start], size);
+	ret = size;
+	goto out;
+
+try_iso:
+	p_iso = iso9660_open_ext(iso, ISO_EXTENSION_MASK);
+	if (p_iso == NULL) {
+		uprintf("Unable to open image '%s'", iso);
+		goto out;
+	}
+	p_statbuf = iso9660_ifs_stat_translate(p_iso, iso_file);
+	if (p_statbuf == NULL) {
+		uprintf("Could not get ISO-9660 file information for file %s", iso_file);
+		goto out;
+	}
+	file_length = p_statbuf->total_size;
+	if (offset >= (uint64_t)file_length)
+		goto out;
+	size = (uint32_t)min(size, (uint64_t)file_length - offset);
+	nblocks = (uint32_t)((offset + size - start + ISO_BLOCKSIZE - 1) / ISO_BLOCKSIZE);
+	tmp = malloc((size_t)nblocks * ISO_BLOCKSIZE);
+	if (tmp == NULL)
+		goto out;
+	if (iso9660_iso_seek_read(p_iso, tmp, p_statbuf->lsn + (lsn_t)(start / ISO_BLOCKSIZE), nblocks) !=
+		(long)nblocks * ISO_BLOCKSIZE) {
+		uprintf("Error reading ISO file %s", iso_file);
+		goto out;
+	}
+	memcpy(buf, &tmp[offset - start], size);
+	ret = size;
+
+out:
+	free(tmp);
+	iso9660_stat_free(p_statbuf);
+	udf_dirent_free(p_udf_root);
+	udf_dirent_free(p_udf_file);
+	iso9660_close(p_iso);
+	udf_close(p_udf);
+	cdio_loglevel_default = usb_debug ? CDIO_LOG_INFO : CDIO_LOG_WARN;
+	return ret;
+}
+
 #define ISO_NB_BLOCKS 16
 typedef struct {
 	iso9660_t*      p_iso;
@@ -1974,9 +2870,8 @@ BOOL DumpFatDir(const char* path, int32_t cluster)
 						break;
 					}
 					written += size;
+					// No need to flush the libfat cache here, as it is LRU-bounded
 					s = libfat_nextsector(lf_fs, s);
-					// Trust me, you *REALLY* want to invoke libfat_flush() here
-					libfat_flush(lf_fs);
 				}
 				safe_closehandle(handle);
 				if (props.is_conf)
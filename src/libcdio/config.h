@@ -1,4 +1,5 @@
-/* config.h for libcdio (used by both MinGW and MSVC) */
+/* config.h for libcdio (used by both MinGW and MSVC, as well as by the native
+   tools from res/ that are built against the vendored libcdio on other hosts) */
 
 #if defined(_MSC_VER)
 /* Disable: warning C4996: The POSIX name for this item is deprecated. */
@@ -32,7 +33,9 @@
 /* Define to 1 if you have the `lseek64' function. */
 #define HAVE_LSEEK64 1
 /* The equivalent of lseek64 on MSVC is _lseeki64 */
+#if defined(_WIN32)
 #define lseek64 _lseeki64
+#endif
 
 /* Define to 1 if you have the `fseeko' function. */
 /* #undef HAVE_FSEEKO */
@@ -48,8 +51,15 @@
 /* Define to 1 if you have the `ftruncate' function. */
 #define HAVE_FTRUNCATE 1
 
+/* Define to 1 if you have the `gmtime_r' function. */
+#if !defined(_WIN32)
+#define HAVE_GMTIME_R 1
+#endif
+
 /* Define if you have the iconv() function and it works. */
-/* #undef HAVE_ICONV */
+#if !defined(_WIN32)
+#define HAVE_ICONV 1
+#endif
 
 /* Define this if you want to use the 2020 version of the libcdio API. */
 #define DO_NOT_WANT_COMPATIBILITY /**/
@@ -67,6 +77,11 @@
 /* Define to 1 if you have the <limits.h> header file. */
 #define HAVE_LIMITS_H 1
 
+/* Define to 1 if you have the `localtime_r' function. */
+#if !defined(_WIN32)
+#define HAVE_LOCALTIME_R 1
+#endif
+
 /* Define to 1 if you have the `lstat' function. */
 /* #undef HAVE_LSTAT */
 
@@ -95,7 +110,9 @@
 /* #undef HAVE_SETEGID */
 
 /* Define to 1 if you have the `setenv' function. */
-/* #undef HAVE_SETENV */
+#if !defined(_WIN32)
+#define HAVE_SETENV 1
+#endif
 
 /* Define to 1 if you have the `seteuid' function. */
 /* #undef HAVE_SETEUID */
@@ -131,7 +148,9 @@
 /* Define to 1 if you have the `strdup' function. */
 #define HAVE_STRDUP 1
 /* The equivalent of strdup on MSVC is _strdup */
+#if defined(_WIN32)
 #define strdup _strdup
+#endif
 
 /* Define to 1 if you have the <strings.h> header file. */
 /* #undef HAVE_STRINGS_H */
@@ -140,7 +159,7 @@
 #define HAVE_STRING_H 1
 
 /* Define to 1 if you have the `strndup' function. */
-#if defined(__MINGW32__)
+#if defined(__MINGW32__) || !defined(_WIN32)
 #define HAVE_STRNDUP 1
 #endif
 
@@ -163,10 +182,19 @@
 #define HAVE_SYS_TYPES_H 1
 
 /* Define this <sys/stat.h> defines S_ISLNK() */
-/* #undef HAVE_S_ISLNK */
+#if !defined(_WIN32)
+#define HAVE_S_ISLNK 1
+#endif
 
 /* Define this <sys/stat.h> defines S_ISSOCK() */
-/* #undef HAVE_S_ISSOCK */
+#if !defined(_WIN32)
+#define HAVE_S_ISSOCK 1
+#endif
+
+/* Define to 1 if you have the `timegm' function. */
+#if !defined(_WIN32)
+#define HAVE_TIMEGM 1
+#endif
 
 /* Define if you have an extern long timenzone variable. */
 #define HAVE_TIMEZONE_VAR 1
@@ -177,7 +205,9 @@
 /* Define if time.h defines extern extern char *tzname[2] variable */
 #define HAVE_TZNAME 1
 /* The equivalent of tzset on MSVC is _tzset */
+#if defined(_WIN32)
 #define tzset _tzset
+#endif
 
 /* Define to 1 if you have the `tzset' function. */
 #define HAVE_TZSET 1
@@ -186,7 +216,9 @@
 #define HAVE_UNISTD_H 1 /* provided in MSVC/missing if needed */
 
 /* Define to 1 if you have the `unsetenv' function. */
-/* #undef HAVE_UNSETENV */
+#if !defined(_WIN32)
+#define HAVE_UNSETENV 1
+#endif
 
 /* Define to 1 if you have the `usleep' function. */
 /* #undef HAVE_USLEEP */
@@ -197,14 +229,18 @@
 /* Define 1 if you have MinGW CD-ROM support */
 /* #undef HAVE_WIN32_CDROM */
 
+#if defined(_WIN32)
 /* Define to 1 if you have the <windows.h> header file. */
 #define HAVE_WINDOWS_H 1
 
 /* Define to 1 if you have the `_stati64' function. */
 #define HAVE__STATI64 1
+#endif
 
 /* Define as const if the declaration of iconv() needs const. */
-/* #undef ICONV_CONST  */
+#if !defined(_WIN32)
+#define ICONV_CONST
+#endif
 
 /* Is set when libcdio's config.h has been included. Applications wishing to
    sue their own config.h values (such as set by the application's configure
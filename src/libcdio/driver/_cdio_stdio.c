@@ -47,22 +47,14 @@
 #include "_cdio_stdio.h"
 #include "cdio_assert.h"
 
-/* On 32 bit platforms, fseek can only access streams of 2 GB or less.
-   Prefer fseeko/fseeko64, that take a 64 bit offset when LFS is enabled */
-#if defined(HAVE_FSEEKO64) && defined(_FILE_OFFSET_BITS) && (_FILE_OFFSET_BITS == 64)
-#define CDIO_FSEEK fseeko64
-#elif defined(HAVE_FSEEKO)
-#define CDIO_FSEEK fseeko
-#else
-#define CDIO_FSEEK fseek
-#endif
-
-/* Windows' fopen is not UTF-8 compliant, so we use our own */
 #if defined(_WIN32)
+#include <windows.h>
 #include <cdio/utf8.h>
-#define CDIO_FOPEN fopen_utf8
 #else
-#define CDIO_FOPEN fopen
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#include <pthread.h>
 #endif
 
 /* Use _stati64 if needed, on platforms that don't have transparent LFS support */
@@ -86,30 +78,74 @@ static inline int _stati64_utf8(const char *path, struct _stati64 *buffer) {
 #define CDIO_STAT_CALL stat
 #endif
 
-#define _STRINGIFY(a) #a
-#define STRINGIFY(a) _STRINGIFY(a)
-
-#define CDIO_STDIO_BUFSIZE (128*1024)
+/* Size of the readahead window used for sequential accesses */
+#define CDIO_STDIO_READAHEAD (1024*1024)
+/* Define a max buffer size of 1 GB for _stdio_read */
+#define CDIO_STDIO_MAX_COUNT 0x40000000
 
+/*
+  All reads are positional (ReadFile with an explicit offset on Windows,
+  pread(2) elsewhere), so that, once the stream is open, several threads
+  can read from the same image through cdio_stream_pread() without having
+  to share a file position. The only state that is shared between readers
+  is the readahead window, which is protected by a lock.
+*/
 typedef struct {
   char *pathname;
-  FILE *fd;
-  char *fd_buf;
+#if defined(_WIN32)
+  HANDLE h;
+  CRITICAL_SECTION lock;
+#else
+  int fd;
+  pthread_mutex_t lock;
+#endif
   off_t st_size; /* used only for source */
+  off_t pos;     /* position for the (non thread-safe) seek/read interface */
+  uint8_t *ra_buf;
+  off_t ra_start;
+  size_t ra_len;
+  off_t last_end; /* end of the previous read, to detect sequential accesses */
 } _UserData;
 
+#if defined(_WIN32)
+#define _stdio_lock(ud)   EnterCriticalSection(&(ud)->lock)
+#define _stdio_unlock(ud) LeaveCriticalSection(&(ud)->lock)
+#else
+#define _stdio_lock(ud)   pthread_mutex_lock(&(ud)->lock)
+#define _stdio_unlock(ud) pthread_mutex_unlock(&(ud)->lock)
+#endif
+
 static int
 _stdio_open (void *user_data)
 {
   _UserData *const ud = user_data;
+#if defined(_WIN32)
+  wchar_t* wpath = cdio_utf8_to_wchar(ud->pathname);
 
-  if ((ud->fd = CDIO_FOPEN (ud->pathname, "rb")))
-    {
-      ud->fd_buf = calloc (1, CDIO_STDIO_BUFSIZE);
-      setvbuf (ud->fd, ud->fd_buf, _IOFBF, CDIO_STDIO_BUFSIZE);
-    }
+  /* Same sharing mode as fopen(), and let the OS know we mostly read sequentially */
+  ud->h = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                      NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  cdio_free(wpath);
+  if (ud->h == INVALID_HANDLE_VALUE) {
+    ud->h = NULL;
+    return 1;
+  }
+  InitializeCriticalSection(&ud->lock);
+#else
+  ud->fd = open (ud->pathname, O_RDONLY);
+  if (ud->fd < 0)
+    return 1;
+#if defined(POSIX_FADV_SEQUENTIAL)
+  posix_fadvise (ud->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  pthread_mutex_init (&ud->lock, NULL);
+#endif
+  ud->pos = 0;
+  ud->ra_len = 0;
+  ud->last_end = -1;
+  ud->ra_buf = malloc (CDIO_STDIO_READAHEAD);
 
-  return (ud->fd == NULL);
+  return 0;
 }
 
 static int
@@ -117,13 +153,25 @@ _stdio_close(void *user_data)
 {
   _UserData *const ud = user_data;
 
-  if (fclose (ud->fd))
-    cdio_error ("fclose (): %s", strerror (errno));
-
-  ud->fd = NULL;
+#if defined(_WIN32)
+  if (ud->h == NULL)
+    return 0;
+  if (!CloseHandle (ud->h))
+    cdio_error ("CloseHandle (): error %lu", GetLastError ());
+  ud->h = NULL;
+  DeleteCriticalSection (&ud->lock);
+#else
+  if (ud->fd < 0)
+    return 0;
+  if (close (ud->fd))
+    cdio_error ("close (): %s", strerror (errno));
+  ud->fd = -1;
+  pthread_mutex_destroy (&ud->lock);
+#endif
 
-  free (ud->fd_buf);
-  ud->fd_buf = NULL;
+  free (ud->ra_buf);
+  ud->ra_buf = NULL;
+  ud->ra_len = 0;
 
   return 0;
 }
@@ -136,23 +184,101 @@ _stdio_free(void *user_data)
   if (ud->pathname)
     free(ud->pathname);
 
-  if (ud->fd) /* should be NULL anyway... */
-    _stdio_close(user_data);
+  _stdio_close(user_data); /* should be closed anyway... */
 
   free(ud);
 }
 
 /*!
-  Like fseek/fseeko(3) and in fact may be the same.
+  Read count bytes at offset, retrying on short reads.
+  Returns the number of bytes read, which is only smaller than count on
+  error or end-of-file.
+*/
+static ssize_t
+_stdio_read_at(_UserData *ud, void *buf, size_t count, off_t offset)
+{
+  size_t total = 0;
 
-  This  function sets the file position indicator for the stream
-  pointed to by stream.  The new position, measured in bytes, is obtained
-  by  adding offset bytes to the position specified by whence.  If whence
-  is set to SEEK_SET, SEEK_CUR, or SEEK_END, the offset  is  relative  to
-  the  start of the file, the current position indicator, or end-of-file,
-  respectively.  A successful call to the fseek function clears the end-
-  of-file indicator for the stream and undoes any effects of the
-  ungetc(3) function on the same stream.
+  while (total < count) {
+#if defined(_WIN32)
+    OVERLAPPED ov = { 0 };
+    DWORD rs = 0;
+    uint64_t pos = (uint64_t)offset + total;
+
+    ov.Offset = (DWORD)pos;
+    ov.OffsetHigh = (DWORD)(pos >> 32);
+    if (!ReadFile (ud->h, (uint8_t *)buf + total, (DWORD)(count - total), &rs, &ov)) {
+      if (GetLastError () != ERROR_HANDLE_EOF)
+        cdio_error ("ReadFile (): error %lu", GetLastError ());
+      break;
+    }
+#else
+    ssize_t rs = pread (ud->fd, (uint8_t *)buf + total, count - total, offset + total);
+
+    if (rs < 0) {
+      if (errno == EINTR)
+        continue;
+      cdio_error ("pread (): %s", strerror (errno));
+      break;
+    }
+#endif
+    if (rs == 0) {
+      cdio_debug ("read (): EOF encountered");
+      break;
+    }
+    total += rs;
+  }
+
+  return (ssize_t)total;
+}
+
+/*!
+  Like pread(2). Reads that continue where the previous one stopped are
+  served from a readahead window, so that sequential accesses through a
+  small buffer only result in one system call per CDIO_STDIO_READAHEAD.
+
+  This function may be called concurrently from multiple threads.
+*/
+static ssize_t
+_stdio_pread(void *user_data, void *buf, size_t count, off_t offset)
+{
+  _UserData *const ud = user_data;
+  ssize_t ret;
+
+  if (count > CDIO_STDIO_MAX_COUNT) {
+      cdio_error("Requested count exceeds maximum allowed value.\n");
+      return 0;
+  }
+  if (offset < 0)
+    return 0;
+
+  _stdio_lock(ud);
+  if ((ud->ra_len != 0) && (offset >= ud->ra_start) &&
+      ((off_t)(offset + count) <= (off_t)(ud->ra_start + ud->ra_len))) {
+    memcpy (buf, &ud->ra_buf[offset - ud->ra_start], count);
+    ud->last_end = offset + count;
+    _stdio_unlock(ud);
+    return (ssize_t)count;
+  }
+  if ((offset == ud->last_end) && (count < CDIO_STDIO_READAHEAD) && (ud->ra_buf != NULL)) {
+    ret = _stdio_read_at (ud, ud->ra_buf, CDIO_STDIO_READAHEAD, offset);
+    ud->ra_start = offset;
+    ud->ra_len = (ret > 0) ? (size_t)ret : 0;
+    ret = (ssize_t)((count < ud->ra_len) ? count : ud->ra_len);
+    memcpy (buf, ud->ra_buf, ret);
+    ud->last_end = offset + ret;
+    _stdio_unlock(ud);
+    return ret;
+  }
+  ud->last_end = offset + count;
+  _stdio_unlock(ud);
+
+  return _stdio_read_at (ud, buf, count, offset);
+}
+
+/*!
+  Like fseek/fseeko(3), except that this only updates the position that
+  is used by _stdio_read().
 
   @return upon successful completion, DRIVER_OP_SUCCESS, else,
   DRIVER_OP_ERROR is returned and the global variable errno is set to
@@ -162,21 +288,30 @@ static int
 _stdio_seek(void *p_user_data, off_t i_offset, int whence)
 {
   _UserData *const ud = p_user_data;
-  int ret;
-#if !defined(HAVE_FSEEKO) && !defined(HAVE_FSEEKO64)
-  /* Detect if off_t is lossy-truncated to long to avoid data corruption */
-  if ( (sizeof(off_t) > sizeof(long)) && (i_offset != (off_t)((long)i_offset)) ) {
-    cdio_error ( STRINGIFY(CDIO_FSEEK) " (): lossy truncation detected!");
-    errno = EFBIG;
-    return DRIVER_OP_ERROR;
+  off_t pos;
+
+  switch (whence) {
+  case SEEK_SET:
+    pos = i_offset;
+    break;
+  case SEEK_CUR:
+    pos = ud->pos + i_offset;
+    break;
+  case SEEK_END:
+    pos = ud->st_size + i_offset;
+    break;
+  default:
+    pos = -1;
+    break;
   }
-#endif
-
-  if ( (ret=CDIO_FSEEK (ud->fd, i_offset, whence)) ) {
-    cdio_error ( STRINGIFY(CDIO_FSEEK) " (): %s", strerror (errno));
+  if (pos < 0) {
+    cdio_error ("seek (): %s", strerror (EINVAL));
+    errno = EINVAL;
+    return DRIVER_OP_ERROR;
   }
+  ud->pos = pos;
 
-  return ret;
+  return DRIVER_OP_SUCCESS;
 }
 
 static off_t
@@ -188,52 +323,21 @@ _stdio_stat(void *p_user_data)
 }
 
 /*!
-  Like fread(3) and in fact is about the same.
-
-  DESCRIPTION:
-  The function fread reads nmemb elements of data, each size bytes long,
-  from the stream pointed to by stream, storing them at the location
-  given by ptr.
+  Like read(2), from the position set by _stdio_seek().
 
   RETURN VALUE:
-  return the number of items successfully read or written (i.e.,
-  not the number of characters).  If an error occurs, or the
-  end-of-file is reached, the return value is a short item count
-  (or zero).
-
-  We do not distinguish between end-of-file and error, and callers
-  must use feof(3) and ferror(3) to determine which occurred.
+  return the number of bytes successfully read. If an error occurs, or
+  the end-of-file is reached, the return value is a short count (or zero).
   */
 static ssize_t
 _stdio_read(void *user_data, void *buf, size_t count)
 {
   _UserData *const ud = user_data;
-  long read_count;
-
-  // Define a max buffer size of 1 GB for _stdio_read
-  const size_t MAX_ALLOWED_COUNT = 0x40000000;
-  if (count > MAX_ALLOWED_COUNT) {
-      cdio_error("Requested count exceeds maximum allowed value.\n");
-      return 0;
-  }
+  ssize_t read_count;
 
-  read_count = fread(buf, 1, count, ud->fd);
-
-  if (read_count != count)
-    { /* fixme -- ferror/feof */
-      if (feof (ud->fd))
-        {
-          cdio_debug ("fread (): EOF encountered");
-          clearerr (ud->fd);
-        }
-      else if (ferror (ud->fd))
-        {
-          cdio_error ("fread (): %s", strerror (errno));
-          clearerr (ud->fd);
-        }
-      else
-        cdio_debug ("fread (): short read and no EOF?!?");
-    }
+  read_count = _stdio_pread(user_data, buf, count, ud->pos);
+  if (read_count > 0)
+    ud->pos += read_count;
 
   return read_count;
 }
@@ -251,7 +355,7 @@ CdioDataSource_t *
 cdio_stdio_new(const char pathname[])
 {
   CdioDataSource_t *new_obj = NULL;
-  cdio_stream_io_functions funcs = { NULL, NULL, NULL, NULL, NULL, NULL };
+  cdio_stream_io_functions funcs = { NULL, NULL, NULL, NULL, NULL, NULL, NULL };
   _UserData *ud = NULL;
   struct CDIO_STAT_STRUCT statbuf;
   char* pathdup;
@@ -277,6 +381,9 @@ cdio_stdio_new(const char pathname[])
 
   ud->pathname = pathdup;
   ud->st_size  = statbuf.st_size; /* let's hope it doesn't change... */
+#if !defined(_WIN32)
+  ud->fd = -1;
+#endif
 
   funcs.open   = _stdio_open;
   funcs.seek   = _stdio_seek;
@@ -284,6 +391,7 @@ cdio_stdio_new(const char pathname[])
   funcs.read   = _stdio_read;
   funcs.close  = _stdio_close;
   funcs.free   = _stdio_free;
+  funcs.pread  = _stdio_pread;
 
   new_obj = cdio_stream_new(ud, &funcs);
 
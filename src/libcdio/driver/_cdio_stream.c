@@ -160,6 +160,31 @@ cdio_stream_read(CdioDataSource_t* p_obj, void *ptr, size_t size, size_t nmemb)
   return read_bytes;
 }
 
+/**
+  Like pread(2): read size*nmemb bytes at offset, without using or
+  altering the stream position, so that, once the stream is open, this
+  can be called concurrently if the data source supports it.
+
+  RETURN VALUE:
+  return the number of bytes successfully read, which is only smaller
+  than size*nmemb on error or end-of-file.
+*/
+ssize_t
+cdio_stream_pread(CdioDataSource_t* p_obj, void *ptr, size_t size, size_t nmemb,
+                  off_t offset)
+{
+  if (!p_obj) return 0;
+  if (!_cdio_stream_open_if_necessary(p_obj)) return 0;
+  if (offset < 0) return 0;
+
+  if (p_obj->op.pread == NULL) {
+    if (cdio_stream_seek(p_obj, offset, SEEK_SET) != 0) return 0;
+    return cdio_stream_read(p_obj, ptr, size, nmemb);
+  }
+
+  return (p_obj->op.pread)(p_obj->user_data, ptr, size*nmemb, offset);
+}
+
 /**
   Like 3 fseek and in fact may be the same.
 
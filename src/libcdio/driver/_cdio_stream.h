@@ -42,6 +42,9 @@ extern "C" {
   typedef int(*cdio_data_close_t)(void *user_data);
   
   typedef void(*cdio_data_free_t)(void *user_data);
+
+  typedef ssize_t(*cdio_data_pread_t)(void *user_data, void *buf,
+                                      size_t count, off_t offset);
   
   
   /* abstract data source */
@@ -53,6 +56,7 @@ extern "C" {
     cdio_data_read_t read;
     cdio_data_close_t close;
     cdio_data_free_t free;
+    cdio_data_pread_t pread; /* optional */
   } cdio_stream_io_functions;
   
   /**
@@ -90,6 +94,20 @@ extern "C" {
   ssize_t cdio_stream_read(CdioDataSource_t* p_obj, void *ptr, size_t i_size, 
                            size_t nmemb);
   
+  /**
+     Like pread(2): read i_size*nmemb bytes at i_offset, without using or
+     altering the stream position. Provided that the stream has already
+     been opened, this can be called from multiple threads at once if the
+     data source implements positional reads. Otherwise, this falls back
+     to cdio_stream_seek() followed by cdio_stream_read().
+
+     RETURN VALUE:
+     return the number of bytes successfully read, which is only smaller
+     than i_size*nmemb on error or end-of-file.
+  */
+  ssize_t cdio_stream_pread(CdioDataSource_t* p_obj, void *ptr, size_t i_size,
+                            size_t nmemb, off_t i_offset);
+
   /** 
     Like fseek(3)/fseeko(3) and in fact may be the same.
 
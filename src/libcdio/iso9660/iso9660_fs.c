@@ -772,16 +772,14 @@ iso9660_seek_read_framesize (const iso9660_t *p_iso, void *ptr,
 			     lsn_t start, long int size,
 			     uint16_t i_framesize)
 {
-  long int ret;
   int64_t i_byte_offset;
 
   if (!p_iso) return 0;
   i_byte_offset = (start * (int64_t)(p_iso->i_framesize))
     + p_iso->i_fuzzy_offset + p_iso->i_datastart;
 
-  ret = cdio_stream_seek (p_iso->stream, i_byte_offset, SEEK_SET);
-  if (ret!=0) return 0;
-  return cdio_stream_read (p_iso->stream, ptr, i_framesize, size);
+  /* Positional read, so that the image can be read from multiple threads */
+  return cdio_stream_pread (p_iso->stream, ptr, i_framesize, size, i_byte_offset);
 }
 
 /*!
@@ -130,11 +130,18 @@ offset_to_lba(const udf_dirent_t *p_udf_dirent, off_t i_offset,
     break;
   case ICBTAG_STRATEGY_TYPE_4:
     {
-      off_t icblen = 0;
+      off_t icblen = 0, i_start = i_offset;
       uint64_t lsector;
       int ad_offset, ad_num = 0;
       uint16_t addr_ilk = uint16_from_le(p_icb_tag->flags&ICBTAG_FLAG_AD_MASK);
 
+      /* For sequential reads, resume from the extent we used last rather
+         than walk the allocation descriptors from the start of the file. */
+      if (p_udf->p_ad_fe == p_udf_fe && i_offset >= p_udf->i_ad_start) {
+	ad_num = p_udf->i_ad_num;
+	i_offset -= p_udf->i_ad_start;
+      }
+
       switch (addr_ilk) {
       case ICBTAG_FLAG_AD_SHORT:
 	{
@@ -207,6 +214,10 @@ offset_to_lba(const udf_dirent_t *p_udf_dirent, off_t i_offset,
 	return CDIO_INVALID_LBA;
       }
 
+      p_udf->p_ad_fe = p_udf_fe;
+      p_udf->i_ad_num = ad_num - 1;
+      p_udf->i_ad_start = i_start - i_offset;
+
       *pi_lba = (lba_t)lsector + p_udf->i_part_start;
       if (*pi_lba < 0) {
 	cdio_warn("Negative LBA value");
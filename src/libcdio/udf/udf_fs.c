@@ -259,6 +259,7 @@ udf_fopen(udf_dirent_t *p_udf_root, const char *psz_name)
 
     /* file position must be reset when accessing a new file */
     p_udf_root->p_udf->i_position = 0;
+    p_udf_root->p_udf->p_ad_fe = NULL;
 
     strncpy(tokenline, psz_name, udf_MAX_PATHLEN-1);
     tokenline[udf_MAX_PATHLEN-1] = '\0';
@@ -322,6 +323,7 @@ udf_new_dirent(udf_file_entry_t *p_udf_fe, udf_t *p_udf,
   p_udf_dirent->p_udf        = p_udf;
   p_udf_dirent->i_part_start = p_udf->i_part_start;
   p_udf_dirent->dir_left     = uint64_from_le(p_udf_fe->info_len);
+  p_udf->p_ad_fe             = NULL;
 
   memcpy(&(p_udf_dirent->fe), p_udf_fe,
 	 sizeof(udf_file_entry_t));
@@ -338,14 +340,13 @@ driver_return_code_t
 udf_read_sectors (const udf_t *p_udf, void *ptr, lsn_t i_start,
 		 long i_blocks)
 {
-  driver_return_code_t ret;
   long i_read;
   off_t i_byte_offset;
 
   if (!p_udf) return 0;
   /* Without the cast, i_start * UDF_BLOCKSIZE may be evaluated as 32 bit */
   i_byte_offset = ((off_t)i_start) * UDF_BLOCKSIZE;
-  /* Since we're using SEEK_SET, the value must be positive */
+  /* Since this is an absolute offset, the value must be positive */
   if (i_byte_offset < 0) {
     if (sizeof(off_t) <= 4)	/* probably missing LFS */
       cdio_warn("Large File Support is required to access streams of 2 GB or more");
@@ -353,9 +354,8 @@ udf_read_sectors (const udf_t *p_udf, void *ptr, lsn_t i_start,
   }
 
   if (p_udf->b_stream) {
-    ret = cdio_stream_seek (p_udf->stream, i_byte_offset, SEEK_SET);
-    if (DRIVER_OP_SUCCESS != ret) return ret;
-    i_read = cdio_stream_read (p_udf->stream, ptr, UDF_BLOCKSIZE, i_blocks);
+    i_read = cdio_stream_pread (p_udf->stream, ptr, UDF_BLOCKSIZE, i_blocks,
+                                i_byte_offset);
     if (i_read) return DRIVER_OP_SUCCESS;
     return DRIVER_OP_ERROR;
   } else {
@@ -364,6 +364,87 @@ udf_read_sectors (const udf_t *p_udf, void *ptr, lsn_t i_start,
   }
 }
 
+/* Size of a File Identifier Descriptor, including padding */
+#define udf_FID_SIZE(p_fid) \
+  (4 * ((sizeof(*(p_fid)) + (p_fid)->u.i_imp_use + (p_fid)->i_file_id + 3) / 4))
+
+/*!
+  Read the File Entry located at i_lba (relative to the partition start)
+  through the ICB cache. If p_udf_dirent is provided and the File Entry
+  isn't cached, the ICBs of the File Identifier Descriptors that follow
+  the current one are also read in the same call, for as long as they
+  are consecutive, which is how mastering tools usually lay them out.
+*/
+static driver_return_code_t
+udf_read_icb(udf_t *p_udf, udf_file_entry_t *p_udf_fe, uint32_t i_lba,
+	     const udf_dirent_t *p_udf_dirent)
+{
+  const uint32_t i_abs_lba = p_udf->i_part_start + i_lba;
+  udf_icb_cache_entry_t *p_entry;
+  udf_file_entry_t *p_buf;
+  driver_return_code_t ret;
+  long i, i_blocks = 1;
+
+  if (!p_udf->icb_cache)
+    p_udf->icb_cache = calloc(UDF_ICB_CACHE_SIZE, sizeof(udf_icb_cache_entry_t));
+  if (!p_udf->icb_cache)
+    return udf_read_sectors(p_udf, p_udf_fe, i_abs_lba, 1);
+
+  p_entry = &p_udf->icb_cache[i_abs_lba & (UDF_ICB_CACHE_SIZE - 1)];
+  if (p_entry->b_valid && p_entry->i_lba == i_abs_lba) {
+    memcpy(p_udf_fe, &p_entry->fe, sizeof(udf_file_entry_t));
+    return DRIVER_OP_SUCCESS;
+  }
+
+  /* Find out how many of the next FIDs point to consecutive ICBs */
+  if (p_udf_dirent && p_udf_dirent->fid && p_udf_dirent->sector) {
+    const uint8_t *p_end = p_udf_dirent->sector + UDF_BLOCKSIZE *
+      (p_udf_dirent->i_loc_end - p_udf_dirent->i_loc + 1);
+    const uint8_t *p = (const uint8_t *)p_udf_dirent->fid
+      + udf_FID_SIZE(p_udf_dirent->fid);
+    uint64_t i_left = p_udf_dirent->dir_left;
+
+    while (i_blocks < UDF_ICB_BATCH_SIZE && i_left >= sizeof(udf_fileid_desc_t)
+	   && p + sizeof(udf_fileid_desc_t) <= p_end) {
+      const udf_fileid_desc_t *p_fid = (const udf_fileid_desc_t *)p;
+      const uint32_t i_size = udf_FID_SIZE(p_fid);
+
+      if (udf_checktag(&p_fid->tag, TAGID_FID) || i_size > i_left
+	  || uint32_from_le(p_fid->icb.loc.lba) != i_lba + i_blocks)
+	break;
+      i_blocks++;
+      p += i_size;
+      i_left -= i_size;
+    }
+  }
+
+  if (i_blocks == 1) {
+    ret = udf_read_sectors(p_udf, p_udf_fe, i_abs_lba, 1);
+    if (DRIVER_OP_SUCCESS == ret) {
+      p_entry->i_lba = i_abs_lba;
+      p_entry->b_valid = true;
+      memcpy(&p_entry->fe, p_udf_fe, sizeof(udf_file_entry_t));
+    }
+    return ret;
+  }
+
+  p_buf = (udf_file_entry_t *) malloc(i_blocks * UDF_BLOCKSIZE);
+  if (!p_buf)
+    return udf_read_sectors(p_udf, p_udf_fe, i_abs_lba, 1);
+  ret = udf_read_sectors(p_udf, p_buf, i_abs_lba, i_blocks);
+  if (DRIVER_OP_SUCCESS == ret) {
+    for (i = 0; i < i_blocks; i++) {
+      p_entry = &p_udf->icb_cache[(i_abs_lba + i) & (UDF_ICB_CACHE_SIZE - 1)];
+      p_entry->i_lba = i_abs_lba + (uint32_t)i;
+      p_entry->b_valid = true;
+      memcpy(&p_entry->fe, &p_buf[i], sizeof(udf_file_entry_t));
+    }
+    memcpy(p_udf_fe, &p_buf[0], sizeof(udf_file_entry_t));
+  }
+  free(p_buf);
+  return ret;
+}
+
 /*!
   Open an UDF for reading. Maybe in the future we will have
   a mode. NULL is returned on error.
@@ -655,6 +736,7 @@ udf_close (udf_t *p_udf)
   } else {
     cdio_destroy(p_udf->cdio);
   }
+  free_and_null(p_udf->icb_cache);
 
   /* Get rid of root directory if allocated. */
 
@@ -669,9 +751,9 @@ udf_opendir(const udf_dirent_t *p_udf_dirent)
     udf_t *p_udf = p_udf_dirent->p_udf;
     udf_file_entry_t udf_fe;
 
+    /* This File Entry was read by udf_readdir(), so it should be cached */
     driver_return_code_t i_ret =
-      udf_read_sectors(p_udf, &udf_fe, p_udf->i_part_start
-		       + p_udf_dirent->fid->icb.loc.lba, 1);
+      udf_read_icb(p_udf, &udf_fe, p_udf_dirent->fid->icb.loc.lba, NULL);
 
     if (DRIVER_OP_SUCCESS == i_ret
 	&& !udf_checktag(&udf_fe.tag, TAGID_FILE_ENTRY)) {
@@ -700,13 +782,12 @@ udf_readdir(udf_dirent_t *p_udf_dirent)
   /* file position must be reset when accessing a new file */
   p_udf = p_udf_dirent->p_udf;
   p_udf->i_position = 0;
+  p_udf->p_ad_fe = NULL;
 
   if (p_udf_dirent->fid) {
     /* advance to next File Identifier Descriptor */
     /* FIXME: need to advance file entry (fe) as well.  */
-    uint32_t ofs = 4 *
-      ((sizeof(*(p_udf_dirent->fid)) + p_udf_dirent->fid->u.i_imp_use
-	+ p_udf_dirent->fid->i_file_id + 3) / 4);
+    uint32_t ofs = udf_FID_SIZE(p_udf_dirent->fid);
 
     p_udf_dirent->fid =
       (udf_fileid_desc_t *)((uint8_t *)p_udf_dirent->fid + ofs);
@@ -731,9 +812,7 @@ udf_readdir(udf_dirent_t *p_udf_dirent)
 
   if (p_udf_dirent->fid && !udf_checktag(&(p_udf_dirent->fid->tag), TAGID_FID))
     {
-      uint32_t ofs =
-	4 * ((sizeof(*p_udf_dirent->fid) + p_udf_dirent->fid->u.i_imp_use
-	      + p_udf_dirent->fid->i_file_id + 3) / 4);
+      uint32_t ofs = udf_FID_SIZE(p_udf_dirent->fid);
 
       p_udf_dirent->dir_left -= ofs;
       p_udf_dirent->b_dir =
@@ -744,8 +823,8 @@ udf_readdir(udf_dirent_t *p_udf_dirent)
       {
 	const unsigned int u_len = p_udf_dirent->fid->i_file_id;
 
-	if (DRIVER_OP_SUCCESS != udf_read_sectors(p_udf, &p_udf_dirent->fe, p_udf->i_part_start
-			 + uint32_from_le(p_udf_dirent->fid->icb.loc.lba), 1)) {
+	if (DRIVER_OP_SUCCESS != udf_read_icb(p_udf, &p_udf_dirent->fe,
+			 uint32_from_le(p_udf_dirent->fid->icb.loc.lba), p_udf_dirent)) {
 		udf_dirent_free(p_udf_dirent);
 		return NULL;
 	}
@@ -32,6 +32,17 @@
 #include <cdio/udf.h>
 #include "_cdio_stdio.h"
 
+/* Number of File Entries kept in the ICB cache (must be a power of 2) */
+#define UDF_ICB_CACHE_SIZE 256
+/* Maximum number of consecutive File Entries read at once */
+#define UDF_ICB_BATCH_SIZE 32
+
+typedef struct {
+  uint32_t              i_lba;        /* absolute sector of the File Entry */
+  bool                  b_valid;
+  udf_file_entry_t      fe;
+} udf_icb_cache_entry_t;
+
 /* Implementation of opaque types */
 
 struct udf_s {
@@ -45,6 +56,11 @@ struct udf_s {
   uint32_t              i_part_start; /* start of Partition Descriptor */
   uint32_t              lvd_lba;      /* sector of Logical Volume Descriptor */
   uint32_t              fsd_offset;   /* lba of fileset descriptor */
+  udf_icb_cache_entry_t *icb_cache;   /* File Entries we read last */
+  /* Allocation descriptor used by the last read of the current file */
+  const udf_file_entry_t *p_ad_fe;    /* File Entry the cursor applies to */
+  int                   i_ad_num;     /* index of the allocation descriptor */
+  off_t                 i_ad_start;   /* file offset where its extent starts */
 };
 
 #endif /* CDIO_UDF_UDF_PRIVATE_H_ */
@@ -996,9 +996,11 @@ BOOL CALLBACK LogCallback(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
 			SendMessage(hMainDialog, WM_NEXTDLGCTL, (WPARAM)GetDlgItem(hMainDialog, IDCANCEL), TRUE);
 			return TRUE;
 		case IDC_LOG_CLEAR:
+			FlushLog();
 			SetWindowTextA(hLog, "");
 			return TRUE;
 		case IDC_LOG_SAVE:
+			FlushLog();
 			log_size = GetWindowTextLengthU(hLog);
 			if (log_size <= 0)
 				break;
@@ -2252,6 +2254,11 @@ static INT_PTR CALLBACK MainCallback(HWND hDlg, UINT message, WPARAM wParam, LPA
 	case WM_COMMAND:
 #ifdef RUFUS_TEST
 		if (LOWORD(wParam) == IDC_TEST) {
+			// Hold Shift to benchmark metadata loading instead of compression
+			if (GetKeyState(VK_SHIFT) & 0x8000)
+				BenchmarkWimMetadata();
+			else
+				BenchmarkWimCompression();
 			break;
 		}
 #endif
@@ -2305,6 +2312,7 @@ static INT_PTR CALLBACK MainCallback(HWND hDlg, UINT message, WPARAM wParam, LPA
 			}
 
 			// Save or append the current log to %LocalAppData%\Rufus\rufus.log
+			FlushLog();
 			log_size = GetWindowTextLengthU(hLog);
 			if ((!user_deleted_rufus_dir) && (log_size > 0) && ((log_buffer = (char*)malloc(log_size + 2)) != NULL)) {
 				log_size = GetDlgItemTextU(hLogDialog, IDC_LOG_EDIT, log_buffer, log_size);
@@ -3741,6 +3749,9 @@ skip_args_processing:
 	// Save instance of the application for further reference
 	hMainInstance = hInstance;
 
+	// Log messages from our worker threads asynchronously
+	StartLogThread();
+
 	// Initialize COM for folder selection
 	IGNORE_RETVAL(CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE));
 
@@ -4199,6 +4210,7 @@ extern int TestHashes(void);
 	}
 
 out:
+	StopLogThread();
 	_chdirU(cur_dir);
 	// Destroy the hogger mutex first, so that the cmdline app can exit and we can delete it
 	if (hogmutex != NULL) {
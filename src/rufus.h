@@ -214,10 +214,23 @@ extern void uprintf(const char *format, ...);
 extern void uprintfs(const char *str);
 extern void wuprintf(const wchar_t* format, ...);
 extern void uprint_progress(uint64_t cur_value, uint64_t max_value);
+extern void uprintkv(const char* event, ...);
+typedef struct log_ratelimit {
+	volatile LONG64 last;
+	volatile LONG suppressed;
+	volatile LONG registered;
+	uint32_t interval_ms;
+	struct log_ratelimit* next;
+} log_ratelimit_t;
+extern BOOL LogRateLimit(log_ratelimit_t* rl, uint32_t interval_ms);
+extern BOOL StartLogThread(void);
+extern void FlushLog(void);
+extern void StopLogThread(void);
 #define vuprintf(...) do { if (verbose) uprintf(__VA_ARGS__); } while(0)
 #define vvuprintf(...) do { if (verbose > 1) uprintf(__VA_ARGS__); } while(0)
 #define suprintf(...) do { if (!bSilent) uprintf(__VA_ARGS__); } while(0)
 #define uuprintf(...) do { if (usb_debug) uprintf(__VA_ARGS__); } while(0)
+#define ruprintf(ms, ...) do { static log_ratelimit_t _rl = { 0 }; if (LogRateLimit(&_rl, ms)) uprintf(__VA_ARGS__); } while(0)
 #define ubprintf(...) do { safe_sprintf(&ubuffer[ubuffer_pos], UBUFFER_SIZE - ubuffer_pos - 4, __VA_ARGS__); \
 	ubuffer_pos = strlen(ubuffer); ubuffer[ubuffer_pos++] = '\r'; ubuffer[ubuffer_pos++] = '\n'; \
 	ubuffer[ubuffer_pos] = 0; } while(0)
@@ -737,6 +750,20 @@ extern void StrArrayClear(StrArray* arr);
 extern void StrArrayDestroy(StrArray* arr);
 #define IsStrArrayEmpty(arr) (arr.Index == 0)
 
+/* Multi pattern buffer scanner */
+#define MAX_SCAN_PATTERNS       8
+#define PATTERN_NOT_FOUND       ((size_t)-1)
+typedef struct {
+	const char* buf;
+	size_t size;
+	size_t nb_patterns;
+	const char* pattern[MAX_SCAN_PATTERNS];
+	size_t len[MAX_SCAN_PATTERNS];
+	size_t next[MAX_SCAN_PATTERNS];	// Offset of the next match for each pattern
+} PatternScan;
+extern BOOL PatternScanInit(PatternScan* ps, const char* buf, size_t size, const char** patterns, size_t nb_patterns);
+extern size_t PatternScanNext(PatternScan* ps, size_t* index);
+
 /*
  * Globals
  */
@@ -818,6 +845,7 @@ extern BOOL ExtractISO(const char* src_iso, const char* dest_dir, BOOL scan);
 extern BOOL ExtractZip(const char* src_zip, const char* dest_dir);
 extern int64_t ExtractISOFile(const char* iso, const char* iso_file, const char* dest_file, DWORD attributes);
 extern uint32_t ReadISOFileToBuffer(const char* iso, const char* iso_file, uint8_t** buf);
+extern uint32_t ReadISOFileRange(const char* iso, const char* iso_file, uint64_t offset, uint32_t size, uint8_t* buf);
 extern BOOL CopySKUSiPolicy(const char* drive_name);
 extern BOOL HasEfiImgBootLoaders(void);
 extern BOOL DumpFatDir(const char* path, int32_t cluster);
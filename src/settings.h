@@ -48,6 +48,7 @@ extern char* ini_file;
 #define SETTING_FORCE_LARGE_FAT32_FORMAT    "ForceLargeFat32Formatting"
 #define SETTING_IGNORE_BOOT_MARKER          "IgnoreBootMarker"
 #define SETTING_INCLUDE_BETAS               "CheckForBetas"
+#define SETTING_LARGE_FAT32_IO_SIZE         "LargeFat32IoSize"
 #define SETTING_LAST_UPDATE                 "LastUpdateCheck"
 #define SETTING_LOCALE                      "Locale"
 #define SETTING_UPDATE_INTERVAL             "UpdateCheckInterval"
@@ -59,6 +60,10 @@ extern char* ini_file;
 #define SETTING_PREFERRED_SAVE_IMAGE_TYPE   "PreferredSaveImageType"
 #define SETTING_PRESERVE_TIMESTAMPS         "PreserveTimestamps"
 #define SETTING_VERBOSE_UPDATES             "VerboseUpdateCheck"
+#define SETTING_WIM_CHUNK_SIZE              "WimChunkSize"
+#define SETTING_WIM_COMPRESSION_LEVEL       "WimCompressionLevel"
+#define SETTING_WIM_COMPRESSION_THREADS     "WimCompressionThreads"
+#define SETTING_WIM_RECOMPRESS              "WimRecompress"
 #define SETTING_WUE_OPTIONS                 "WindowsUserExperienceOptions"
 
 
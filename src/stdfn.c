@@ -606,6 +606,69 @@ void StrArrayDestroy(StrArray* arr)
 		safe_free(arr->String);
 }
 
+/*
+ * Multi pattern scanner, used to look for bootloader markers in large binaries.
+ * Rather than comparing every pattern at every offset, we use memchr() on the
+ * first byte of each pattern (which the CRT vectorizes) to skip to candidates,
+ * and keep the next match of each pattern so that the buffer is only walked
+ * once per pattern, however many matches the caller iterates through.
+ */
+static size_t find_pattern(const char* buf, size_t size, size_t pos, const char* pattern, size_t len)
+{
+	const char* p;
+
+	while (pos + len <= size) {
+		p = memchr(&buf[pos], pattern[0], size - len + 1 - pos);
+		if (p == NULL)
+			break;
+		pos = p - buf;
+		if (memcmp(p, pattern, len) == 0)
+			return pos;
+		pos++;
+	}
+	return PATTERN_NOT_FOUND;
+}
+
+BOOL PatternScanInit(PatternScan* ps, const char* buf, size_t size, const char** patterns, size_t nb_patterns)
+{
+	size_t i;
+
+	if_not_assert(ps != NULL && buf != NULL && patterns != NULL && nb_patterns <= MAX_SCAN_PATTERNS)
+		return FALSE;
+	ps->buf = buf;
+	ps->size = size;
+	ps->nb_patterns = nb_patterns;
+	for (i = 0; i < nb_patterns; i++) {
+		ps->pattern[i] = patterns[i];
+		ps->len[i] = safe_strlen(patterns[i]);
+		ps->next[i] = (ps->len[i] == 0) ? PATTERN_NOT_FOUND :
+			find_pattern(buf, size, 0, patterns[i], ps->len[i]);
+	}
+	return TRUE;
+}
+
+/*
+ * Returns the offset of the next match of any of the patterns, in increasing
+ * order, or PATTERN_NOT_FOUND. If index is not NULL, it receives the index of
+ * the pattern that matched.
+ */
+size_t PatternScanNext(PatternScan* ps, size_t* index)
+{
+	size_t i, k = 0, pos;
+
+	for (i = 1; i < ps->nb_patterns; i++) {
+		if (ps->next[i] < ps->next[k])
+			k = i;
+	}
+	if (ps->nb_patterns == 0 || ps->next[k] == PATTERN_NOT_FOUND)
+		return PATTERN_NOT_FOUND;
+	pos = ps->next[k];
+	ps->next[k] = find_pattern(ps->buf, ps->size, pos + 1, ps->pattern[k], ps->len[k]);
+	if (index != NULL)
+		*index = k;
+	return pos;
+}
+
 /*
  * Retrieve the SID of the current user. The returned PSID must be freed by the caller using LocalFree()
  */
@@ -806,6 +869,7 @@ DWORD RunCommandWithProgress(const char* cmd, const char* dir, BOOL log, int msg
 	static char* output;
 	cregex_node_t* node = NULL;
 	cregex_program_t* program = NULL;
+	cregex_context_t* context = NULL;
 	char* matches[REGEX_VM_MAX_MATCHES];
 
 	si.cb = sizeof(si);
@@ -836,8 +900,14 @@ DWORD RunCommandWithProgress(const char* cmd, const char* dir, BOOL log, int msg
 			program = cregex_compile_node(node);
 			cregex_parse_free(node);
 		}
-		if (node == NULL || program == NULL)
+		// Reuse the same match context for all the output we get from the command
+		if (program != NULL)
+			context = cregex_context_create(program);
+		if (node == NULL || program == NULL || context == NULL) {
 			uprintf("Internal error: Failed to parse '%s'", pattern);
+			cregex_compile_free(program);
+			program = NULL;
+		}
 	}
 
 	if (program != NULL || log) {
@@ -869,7 +939,7 @@ DWORD RunCommandWithProgress(const char* cmd, const char* dir, BOOL log, int msg
 					if ((output != NULL) && (ReadFile(hOutputRead, output, dwAvail, &dwRead, NULL)) && (dwRead != 0)) {
 						output[dwAvail] = 0;
 						// Process a commandline progress into a percentage
-						if (program != NULL && cregex_program_run(program, output, (const char**)matches, ARRAYSIZE(matches)) > 0 &&
+						if (program != NULL && cregex_context_run(context, output, (const char**)matches, ARRAYSIZE(matches)) > 0 &&
 							matches[2] != NULL && matches[3] != NULL) {
 							// matches[2] is for the first group
 							// matches[3] is for the end of the first group
@@ -910,6 +980,7 @@ DWORD RunCommandWithProgress(const char* cmd, const char* dir, BOOL log, int msg
 	CloseHandle(pi.hThread);
 
 out:
+	cregex_context_free(context);
 	cregex_compile_free(program);
 	safe_closehandle(hOutputWrite);
 	safe_closehandle(hOutputRead);
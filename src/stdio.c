@@ -65,11 +65,293 @@ typedef struct {
 } debug_info_t;
 #pragma pack(pop)
 
+/*
+ * Asynchronous logging
+ * uprintf() and friends only format their message and append it to a lock-free
+ * ring of fixed size slots (multiple producers, single consumer, with a sequence
+ * number for each slot), which a dedicated thread then drains to the debug
+ * facility, the log window and, if it was redirected, stderr. This keeps threads
+ * that log a lot, such as the ISO extraction one, from being held up by the log
+ * edit control. Before StartLogThread() or after StopLogThread(), messages are
+ * output synchronously.
+ */
+#define LOG_SLOT_SIZE           4096
+#define LOG_RING_SIZE           256		// Must be a power of 2
+#define LOG_BATCH_SIZE          (64 * KB)
+#define LOG_FLUSH_TIMEOUT       5000
+#define LOG_RATELIMIT_CHECK     1000
+#define LOG_SUPPRESSED_MSG      "  (%d similar message%s suppressed)"
+
+typedef struct {
+	volatile LONG sequence;
+	uint32_t len;
+	char msg[LOG_SLOT_SIZE];
+} log_slot_t;
+
+static log_slot_t* log_ring = NULL;
+static volatile LONG log_head = 0, log_done = 0, log_signaled = 0, log_active = 0, log_writers = 0;
+static volatile BOOL log_exit = FALSE;
+static LONG log_tail = 0;
+static HANDLE log_thread = NULL, log_data_event = NULL, log_done_event = NULL, log_stderr = NULL;
+static log_ratelimit_t* volatile log_ratelimits = NULL;
+
+// Write a NUL terminated UTF-8 string to all the log outputs
+static void log_output(const char* str, size_t len)
+{
+	wchar_t* wstr;
+	DWORD written;
+
+	wstr = utf8_to_wchar(str);
+	if (wstr != NULL) {
+		// Send output to Windows debug facility
+		// coverity[dont_call]
+		OutputDebugStringW(wstr);
+		if ((hLog != NULL) && (hLog != INVALID_HANDLE_VALUE)) {
+			// Send output to our log Window
+			Edit_SetSel(hLog, MAX_LOG_SIZE, MAX_LOG_SIZE);
+			Edit_ReplaceSel(hLog, wstr);
+			// Make sure the message scrolls into view
+			Edit_Scroll(hLog, Edit_GetLineCount(hLog), 0);
+		}
+		free(wstr);
+	}
+	if (log_stderr != NULL)
+		WriteFile(log_stderr, str, (DWORD)len, &written, NULL);
+}
+
+// Wait (briefly) for the log thread to make some progress, or for a handle to be
+// signaled. If we are the thread that owns the log window, the log thread may be
+// waiting on us to process an edit control message, so we must keep processing
+// sent messages while we wait.
+static DWORD log_wait(HANDLE handle)
+{
+	DWORD r;
+	MSG msg;
+
+	if (handle == NULL)
+		handle = log_done_event;
+	if ((hLog != NULL) && (GetWindowThreadProcessId(hLog, NULL) == GetCurrentThreadId())) {
+		r = MsgWaitForMultipleObjects(1, &handle, FALSE, 10, QS_SENDMESSAGE);
+		if (r == WAIT_OBJECT_0 + 1)
+			PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE | PM_QS_SENDMESSAGE);
+		return r;
+	}
+	return WaitForSingleObject(handle, 10);
+}
+
+// Read the sequence of a slot with an interlocked operation, so that the content of
+// the slot is not read before it. Plain volatile reads do not provide this ordering
+// with /volatile:iso, which is the default for ARM64.
+static __inline LONG log_sequence(log_slot_t* slot)
+{
+	return InterlockedCompareExchange(&slot->sequence, 0, 0);
+}
+
+static void log_enqueue(const char* str, size_t len)
+{
+	log_slot_t* slot;
+	LONG pos, diff;
+	size_t n;
+
+	for (; len > 0; str += n, len -= n) {
+		n = min(len, LOG_SLOT_SIZE);
+		pos = log_head;
+		while (1) {
+			slot = &log_ring[pos & (LOG_RING_SIZE - 1)];
+			diff = (LONG)((DWORD)log_sequence(slot) - (DWORD)pos);
+			if (diff == 0) {
+				// Slot is free => try to claim it
+				if (InterlockedCompareExchange(&log_head, (LONG)((DWORD)pos + 1), pos) == pos)
+					break;
+			} else if (diff < 0) {
+				// The ring is full => wait for the log thread to free some slots
+				if (InterlockedExchange(&log_signaled, 1) == 0)
+					SetEvent(log_data_event);
+				log_wait(NULL);
+			}
+			pos = log_head;
+		}
+		memcpy(slot->msg, str, n);
+		slot->len = (uint32_t)n;
+		// Publish the slot to the log thread
+		InterlockedExchange(&slot->sequence, (LONG)((DWORD)pos + 1));
+	}
+	if (InterlockedExchange(&log_signaled, 1) == 0)
+		SetEvent(log_data_event);
+}
+
+// Report the messages that ruprintf() suppressed, when no message came after them
+// to do it, once their interval has elapsed or, if force is set, right away.
+static void log_report_suppressed(BOOL force)
+{
+	char buf[128];
+	log_ratelimit_t* rl;
+	LONG suppressed;
+	LONG64 now = (LONG64)GetTickCount64();
+
+	rl = InterlockedCompareExchangePointer((PVOID volatile*)&log_ratelimits, NULL, NULL);
+	for (; rl != NULL; rl = rl->next) {
+		if ((rl->suppressed == 0) || (!force && (now - rl->last < (LONG64)rl->interval_ms)))
+			continue;
+		suppressed = InterlockedExchange(&rl->suppressed, 0);
+		if (suppressed != 0) {
+			static_sprintf(buf, LOG_SUPPRESSED_MSG "\r\n", suppressed, (suppressed == 1) ? "" : "s");
+			log_output(buf, strlen(buf));
+		}
+	}
+}
+
+static DWORD WINAPI LogThread(LPVOID param)
+{
+	static char batch[LOG_BATCH_SIZE + 1];
+	log_slot_t* slot;
+	size_t pos;
+	BOOL exiting;
+
+	while (1) {
+		if (WaitForSingleObject(log_data_event, LOG_RATELIMIT_CHECK) == WAIT_TIMEOUT) {
+			log_report_suppressed(FALSE);
+			continue;
+		}
+		exiting = log_exit;
+		InterlockedExchange(&log_signaled, 0);
+		// Coalesce as many messages as we can, so that we only update the log
+		// window once per batch rather than once per message.
+		do {
+			pos = 0;
+			while (1) {
+				slot = &log_ring[log_tail & (LOG_RING_SIZE - 1)];
+				if ((log_sequence(slot) != (LONG)((DWORD)log_tail + 1)) || (pos + slot->len > LOG_BATCH_SIZE))
+					break;
+				memcpy(&batch[pos], slot->msg, slot->len);
+				pos += slot->len;
+				// Hand the slot back to the producers for the next round
+				InterlockedExchange(&slot->sequence, (LONG)((DWORD)log_tail + LOG_RING_SIZE));
+				log_tail = (LONG)((DWORD)log_tail + 1);
+			}
+			if (pos != 0) {
+				batch[pos] = 0;
+				log_output(batch, pos);
+			}
+			InterlockedExchange(&log_done, log_tail);
+			SetEvent(log_done_event);
+		} while (pos != 0);
+		if (exiting)
+			break;
+	}
+	return 0;
+}
+
+BOOL StartLogThread(void)
+{
+	LONG i;
+
+	if (log_thread != NULL)
+		return TRUE;
+	log_ring = (log_slot_t*)malloc(LOG_RING_SIZE * sizeof(log_slot_t));
+	log_data_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+	log_done_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (log_ring == NULL || log_data_event == NULL || log_done_event == NULL)
+		goto out;
+	for (i = 0; i < LOG_RING_SIZE; i++)
+		log_ring[i].sequence = i;
+	log_head = 0;
+	log_tail = 0;
+	log_done = 0;
+	log_exit = FALSE;
+	// Also mirror the log to stderr, if the user redirected it (e.g. 'rufus.exe 2> log.txt'),
+	// but not to a console, such as the one we attach to when started from the commandline
+	log_stderr = GetStdHandle(STD_ERROR_HANDLE);
+	if ((log_stderr == NULL) || (log_stderr == INVALID_HANDLE_VALUE) ||
+		((GetFileType(log_stderr) != FILE_TYPE_DISK) && (GetFileType(log_stderr) != FILE_TYPE_PIPE)))
+		log_stderr = NULL;
+	log_thread = CreateThread(NULL, 0, LogThread, NULL, 0, NULL);
+	if (log_thread != NULL)
+		InterlockedExchange(&log_active, 1);
+
+out:
+	if (log_thread == NULL) {
+		uprintf("Could not start log thread - Log will be synchronous");
+		safe_closehandle(log_data_event);
+		safe_closehandle(log_done_event);
+		safe_free(log_ring);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Wait for all the messages that were logged so far to have been output.
+// Must be called before reading the content of the log window.
+void FlushLog(void)
+{
+	LONG target = log_head;
+	uint64_t end_time = GetTickCount64() + LOG_FLUSH_TIMEOUT;
+
+	if (log_thread == NULL)
+		return;
+	while (((LONG)((DWORD)log_done - (DWORD)target) < 0) && (GetTickCount64() < end_time)) {
+		if (InterlockedExchange(&log_signaled, 1) == 0)
+			SetEvent(log_data_event);
+		log_wait(NULL);
+	}
+}
+
+void StopLogThread(void)
+{
+	HANDLE thread = log_thread;
+	uint64_t end_time;
+	BOOL writers_done;
+
+	if (thread == NULL)
+		return;
+	FlushLog();
+	// Switch producers back to synchronous output, then wait for the ones that may
+	// still be using the ring, before we tell the log thread to exit
+	InterlockedExchange(&log_active, 0);
+	end_time = GetTickCount64() + LOG_FLUSH_TIMEOUT;
+	while ((InterlockedCompareExchange(&log_writers, 0, 0) != 0) && (GetTickCount64() < end_time)) {
+		if (InterlockedExchange(&log_signaled, 1) == 0)
+			SetEvent(log_data_event);
+		log_wait(NULL);
+	}
+	writers_done = (InterlockedCompareExchange(&log_writers, 0, 0) == 0);
+	log_exit = TRUE;
+	SetEvent(log_data_event);
+	end_time = GetTickCount64() + LOG_FLUSH_TIMEOUT;
+	while ((log_wait(thread) != WAIT_OBJECT_0) && (GetTickCount64() < end_time));
+	if (WaitForSingleObject(thread, 0) != WAIT_OBJECT_0) {
+		uprintf("Log thread did not exit - Terminating");
+		TerminateThread(thread, 1);
+	}
+	CloseHandle(thread);
+	log_thread = NULL;
+	log_report_suppressed(TRUE);
+	// Better leak the ring than free it from under a producer
+	if (!writers_done) {
+		uprintf("Log producers did not complete - Not freeing the log ring");
+		return;
+	}
+	safe_closehandle(log_data_event);
+	safe_closehandle(log_done_event);
+	safe_free(log_ring);
+}
+
+static __inline void log_message(const char* str, size_t len)
+{
+	// Register as a writer before checking whether the log thread is active, so
+	// that StopLogThread() cannot free the ring while we are using it
+	InterlockedIncrement(&log_writers);
+	if (log_active)
+		log_enqueue(str, len);
+	else
+		log_output(str, len);
+	InterlockedDecrement(&log_writers);
+}
+
 void uprintf(const char *format, ...)
 {
-	static char buf[4096];
+	char buf[LOG_SLOT_SIZE];
 	char* p = buf;
-	wchar_t* wbuf;
 	va_list args;
 	int n;
 
@@ -86,24 +368,14 @@ void uprintf(const char *format, ...)
 	*p++ = '\n';
 	*p   = '\0';
 
-	wbuf = utf8_to_wchar(buf);
-	// Send output to Windows debug facility
-	// coverity[dont_call]
-	OutputDebugStringW(wbuf);
-	if ((hLog != NULL) && (hLog != INVALID_HANDLE_VALUE)) {
-		// Send output to our log Window
-		Edit_SetSel(hLog, MAX_LOG_SIZE, MAX_LOG_SIZE);
-		Edit_ReplaceSel(hLog, wbuf);
-		// Make sure the message scrolls into view
-		Edit_Scroll(hLog, Edit_GetLineCount(hLog), 0);
-	}
-	free(wbuf);
+	log_message(buf, p - buf);
 }
 
 void wuprintf(const wchar_t* format, ...)
 {
-	static wchar_t wbuf[4096];
+	wchar_t wbuf[4096];
 	wchar_t* p = wbuf;
+	char* buf;
 	va_list args;
 	int n;
 
@@ -119,27 +391,88 @@ void wuprintf(const wchar_t* format, ...)
 		*p = L'\0';
 	}
 
-	// coverity[dont_call]
-	OutputDebugStringW(wbuf);
-	if ((hLog != NULL) && (hLog != INVALID_HANDLE_VALUE)) {
-		Edit_SetSel(hLog, MAX_LOG_SIZE, MAX_LOG_SIZE);
-		Edit_ReplaceSel(hLog, wbuf);
-		Edit_Scroll(hLog, Edit_GetLineCount(hLog), 0);
-	}
+	buf = wchar_to_utf8(wbuf);
+	if (buf != NULL)
+		log_message(buf, strlen(buf));
+	free(buf);
 }
 
 void uprintfs(const char* str)
 {
-	wchar_t* wstr;
-	wstr = utf8_to_wchar(str);
-	// coverity[dont_call]
-	OutputDebugStringW(wstr);
-	if ((hLog != NULL) && (hLog != INVALID_HANDLE_VALUE)) {
-		Edit_SetSel(hLog, MAX_LOG_SIZE, MAX_LOG_SIZE);
-		Edit_ReplaceSel(hLog, wstr);
-		Edit_Scroll(hLog, Edit_GetLineCount(hLog), 0);
+	log_message(str, strlen(str));
+}
+
+// Structured logging, that prints an "event key1=value1 key2=value2..." line, from
+// a NULL terminated list of key and value strings. Values are quoted when needed.
+void uprintkv(const char* event, ...)
+{
+	char buf[LOG_SLOT_SIZE];
+	const char *key, *val;
+	size_t i, pos, max = sizeof(buf) - 3;	// Room for CR/LF/NUL
+	BOOL quote;
+	va_list args;
+
+	for (pos = 0; (pos < max) && (event[pos] != 0); pos++)
+		buf[pos] = event[pos];
+	va_start(args, event);
+	while ((key = va_arg(args, const char*)) != NULL) {
+		val = va_arg(args, const char*);
+		if (val == NULL)
+			val = "";
+		quote = (val[0] == 0) || (strpbrk(val, " \t\"=\\") != NULL);
+		if (pos < max)
+			buf[pos++] = ' ';
+		for (i = 0; (pos < max) && (key[i] != 0); i++)
+			buf[pos++] = key[i];
+		if (pos < max)
+			buf[pos++] = '=';
+		if (quote && pos < max)
+			buf[pos++] = '"';
+		for (i = 0; (pos < max) && (val[i] != 0); i++) {
+			if (quote && (val[i] == '"' || val[i] == '\\')) {
+				if (pos + 1 >= max)
+					break;
+				buf[pos++] = '\\';
+			}
+			buf[pos++] = val[i];
+		}
+		if (quote && pos < max)
+			buf[pos++] = '"';
 	}
-	free(wstr);
+	va_end(args);
+	buf[pos++] = '\r';
+	buf[pos++] = '\n';
+	buf[pos] = '\0';
+	log_message(buf, pos);
+}
+
+// Rate limiting for the ruprintf() macro, so that a message that may be repeated
+// many times in a row (e.g. for each file of an ISO) is only logged once for each
+// interval, along with the number of messages that were suppressed in between.
+// Rate limiters that suppressed a message are registered with the log thread, so
+// that the count still gets reported if no other message comes after it.
+BOOL LogRateLimit(log_ratelimit_t* rl, uint32_t interval_ms)
+{
+	LONG64 last = rl->last, now = (LONG64)GetTickCount64();
+	LONG suppressed;
+	log_ratelimit_t* next;
+
+	if (((last != 0) && (now - last < (LONG64)interval_ms)) ||
+		(InterlockedCompareExchange64(&rl->last, now, last) != last)) {
+		if (InterlockedExchange(&rl->registered, 1) == 0) {
+			rl->interval_ms = interval_ms;
+			do {
+				next = log_ratelimits;
+				rl->next = next;
+			} while (InterlockedCompareExchangePointer((PVOID volatile*)&log_ratelimits, rl, next) != next);
+		}
+		InterlockedIncrement(&rl->suppressed);
+		return FALSE;
+	}
+	suppressed = InterlockedExchange(&rl->suppressed, 0);
+	if (suppressed != 0)
+		uprintf(LOG_SUPPRESSED_MSG, suppressed, (suppressed == 1) ? "" : "s");
+	return TRUE;
 }
 
 void uprint_progress(uint64_t cur_value, uint64_t max_value)
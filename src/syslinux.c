@@ -403,22 +403,23 @@ uint16_t GetSyslinuxVersion(char* buf, size_t buf_size, char** ext)
 	char *p = NULL;
 	unsigned long version_ul[2];
 	uint16_t version = 0;
-	const char LINUX[] = { 'L', 'I', 'N', 'U', 'X', ' ' };
+	const char* LINUX = "LINUX ";
 	static char* nullstr = "";
 	char unauthorized[] = {'<', '>', ':', '|', '*', '?', '\\', '/'};
+	PatternScan ps;
 
 	*ext = nullstr;
-	if (buf_size < 256)
+	if ((buf_size < 256) || !PatternScanInit(&ps, buf, buf_size, &LINUX, 1))
 		return 0;
 
-	// Start at 64 to avoid the short incomplete version at the beginning of ldlinux.sys
-	for (i = 64; i < buf_size - 64; i++) {
-		if (memcmp(&buf[i], LINUX, sizeof(LINUX)) == 0) {
+	while ((i = PatternScanNext(&ps, NULL)) < buf_size - 64) {
+		// Start at 64 to avoid the short incomplete version at the beginning of ldlinux.sys
+		if (i >= 64) {
 			// Check for ISO or SYS prefix
 			if (!( ((buf[i - 3] == 'I') && (buf[i - 2] == 'S') && (buf[i - 1] == 'O'))
 			    || ((buf[i - 3] == 'S') && (buf[i - 2] == 'Y') && (buf[i - 1] == 'S')) ))
 			  continue;
-			i += sizeof(LINUX);
+			i += strlen(LINUX);
 			version_ul[0] = strtoul(&buf[i], &p, 10);
 			// Our buffer is either from our internal legit syslinux (i.e. with a NUL terminated
 			// version string) or from a buffer that has been NUL-terminated through read_file(),
@@ -13,62 +13,217 @@
 /*
  * cache.c
  *
- * Simple sector cache
+ * Sector cache: sectors are looked up through a hash table, kept in LRU
+ * order, and carved out of slabs so that we don't hit the allocator for
+ * every single sector. Once LIBFAT_CACHE_MAX sectors are in use, the least
+ * recently used one gets recycled, so large FAT images no longer grow the
+ * cache (and the lookup time) without bound.
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <malloc.h>
 #include "libfatint.h"
 
+static inline unsigned int hash_sector(libfat_sector_t n)
+{
+    return (unsigned int)((n ^ (n >> 10) ^ (n >> 20)) & (LIBFAT_HASH_SIZE - 1));
+}
+
+static void lru_unlink(struct libfat_cache *c, struct libfat_sector *ls)
+{
+    if (ls->lru_prev)
+	ls->lru_prev->lru_next = ls->lru_next;
+    else
+	c->lru_head = ls->lru_next;
+    if (ls->lru_next)
+	ls->lru_next->lru_prev = ls->lru_prev;
+    else
+	c->lru_tail = ls->lru_prev;
+}
+
+static void lru_push(struct libfat_cache *c, struct libfat_sector *ls)
+{
+    ls->lru_prev = NULL;
+    ls->lru_next = c->lru_head;
+    if (c->lru_head)
+	c->lru_head->lru_prev = ls;
+    else
+	c->lru_tail = ls;
+    c->lru_head = ls;
+}
+
+static void hash_unlink(struct libfat_cache *c, struct libfat_sector *ls)
+{
+    struct libfat_sector **pp;
+
+    for (pp = &c->hash[hash_sector(ls->n)]; *pp; pp = &(*pp)->next) {
+	if (*pp == ls) {
+	    *pp = ls->next;
+	    return;
+	}
+    }
+}
+
+static struct libfat_sector *cache_lookup(struct libfat_cache *c,
+					  libfat_sector_t n)
+{
+    struct libfat_sector *ls;
+
+    for (ls = c->hash[hash_sector(n)]; ls; ls = ls->next) {
+	if (ls->n == n)
+	    return ls;
+    }
+    return NULL;
+}
+
+/*
+ * Get a free sector entry, either from the free list, a new slab or, once
+ * we've reached our budget, by evicting the least recently used sector.
+ */
+static struct libfat_sector *cache_alloc(struct libfat_cache *c)
+{
+    struct libfat_sector *ls;
+    struct libfat_slab *slab;
+    int i;
+
+    /* LIBFAT_SECTOR_SIZE is a variable, so lock the entry size on first use */
+    if (c->entry_size == 0)
+	c->entry_size = sizeof(struct libfat_sector) + LIBFAT_SECTOR_SIZE;
+
+    if (!c->free && c->count < LIBFAT_CACHE_MAX) {
+	slab = malloc(sizeof(struct libfat_slab));
+	if (slab) {
+	    slab->mem = _mm_malloc(LIBFAT_SLAB_SECTORS * c->entry_size, 16);
+	    if (slab->mem) {
+		slab->next = c->slabs;
+		c->slabs = slab;
+		for (i = LIBFAT_SLAB_SECTORS - 1; i >= 0; i--) {
+		    ls = (struct libfat_sector *)&slab->mem[i * c->entry_size];
+		    ls->next = c->free;
+		    c->free = ls;
+		}
+		c->count += LIBFAT_SLAB_SECTORS;
+	    } else {
+		free(slab);
+	    }
+	}
+    }
+
+    if (c->free) {
+	ls = c->free;
+	c->free = ls->next;
+	return ls;
+    }
+
+    /* Out of budget (or memory): recycle the least recently used sector */
+    ls = c->lru_tail;
+    if (ls) {
+	lru_unlink(c, ls);
+	hash_unlink(c, ls);
+    }
+    return ls;
+}
+
+static void cache_free(struct libfat_cache *c, struct libfat_sector *ls)
+{
+    ls->next = c->free;
+    c->free = ls;
+}
+
+static void cache_insert(struct libfat_cache *c, struct libfat_sector *ls,
+			 libfat_sector_t n)
+{
+    unsigned int h = hash_sector(n);
+
+    ls->n = n;
+    ls->next = c->hash[h];
+    c->hash[h] = ls;
+    lru_push(c, ls);
+}
+
 /*
  * NB: We need to align our sector buffers to at least the 8-byte mark, as some Windows
  * disk devices, notably O2Micro PCI-E SD card readers, return ERROR_INVALID_PARAMETER
  * when attempting to use ReadFile() against a non 8-byte aligned buffer.
  * For good measure, we'll go further and align our buffers on a 16-byte boundary.
  * Also, since struct libfat_sector's data[0] is our buffer, this means we must BOTH
- * align that member in the struct declaration, and use aligned malloc/free.
+ * align that member in the struct declaration, and use aligned slab allocations.
  */
 void *libfat_get_sector(struct libfat_filesystem *fs, libfat_sector_t n)
 {
+    struct libfat_cache *c = &fs->cache;
     struct libfat_sector *ls;
+    libfat_sector_t ra;
 
-    for (ls = fs->sectors; ls; ls = ls->next) {
-	if (ls->n == n)
-	    return ls->data;	/* Found in cache */
+    ls = cache_lookup(c, n);
+    if (ls) {
+	/* Found in cache */
+	if (ls != c->lru_head) {
+	    lru_unlink(c, ls);
+	    lru_push(c, ls);
+	}
+	return ls->data;
     }
 
     /* Not found in cache */
-    ls = _mm_malloc(sizeof(struct libfat_sector) + LIBFAT_SECTOR_SIZE, 16);
-    if (!ls) {
-	libfat_flush(fs);
-	ls = _mm_malloc(sizeof(struct libfat_sector) + LIBFAT_SECTOR_SIZE, 16);
-
-	if (!ls)
-	    return NULL;	/* Can't allocate memory */
-    }
+    ls = cache_alloc(c);
+    if (!ls)
+	return NULL;		/* Can't allocate memory */
 
     if (fs->read(fs->readptr, ls->data, LIBFAT_SECTOR_SIZE, n)
 	!= LIBFAT_SECTOR_SIZE) {
-	_mm_free(ls);
+	cache_free(c, ls);
 	return NULL;		/* I/O error */
     }
+    cache_insert(c, ls, n);
 
-    ls->n = n;
-    ls->next = fs->sectors;
-    fs->sectors = ls;
+    /*
+     * If we are walking sectors sequentially (directories, FAT chains),
+     * pull the next few ones in while we're at it. Failures are ignored.
+     */
+    if (n == c->last_miss + 1) {
+	for (ra = n + 1; ra <= n + LIBFAT_READAHEAD; ra++) {
+	    struct libfat_sector *rs;
+	    if ((fs->end && ra >= fs->end) || cache_lookup(c, ra))
+		break;
+	    rs = cache_alloc(c);
+	    if (!rs)
+		break;
+	    if (fs->read(fs->readptr, rs->data, LIBFAT_SECTOR_SIZE, ra)
+		!= LIBFAT_SECTOR_SIZE) {
+		cache_free(c, rs);
+		break;
+	    }
+	    /* Keep the sector that was actually asked for most recent */
+	    cache_insert(c, rs, ra);
+	    lru_unlink(c, rs);
+	    rs->lru_prev = ls;
+	    rs->lru_next = ls->lru_next;
+	    if (ls->lru_next)
+		ls->lru_next->lru_prev = rs;
+	    else
+		c->lru_tail = rs;
+	    ls->lru_next = rs;
+	}
+	c->last_miss = ra - 1;
+    } else {
+	c->last_miss = n;
+    }
 
     return ls->data;
 }
 
 void libfat_flush(struct libfat_filesystem *fs)
 {
-    struct libfat_sector *ls, *lsnext;
-
-    lsnext = fs->sectors;
-    fs->sectors = NULL;
+    struct libfat_cache *c = &fs->cache;
+    struct libfat_slab *slab, *next;
 
-    for (ls = lsnext; ls; ls = lsnext) {
-	lsnext = ls->next;
-	_mm_free(ls);
+    for (slab = c->slabs; slab; slab = next) {
+	next = slab->next;
+	_mm_free(slab->mem);
+	free(slab);
     }
+    memset(c, 0, sizeof(*c));
+    c->last_miss = (libfat_sector_t)-1;
 }
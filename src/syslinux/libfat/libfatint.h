@@ -32,11 +32,35 @@
 
 ALIGN_START(16) struct libfat_sector {
 	libfat_sector_t n;		/* Sector number */
-	struct libfat_sector *next;	/* Next in list */
+	struct libfat_sector *next;	/* Next in hash bucket (or free list) */
+	struct libfat_sector *lru_prev;	/* More recently used */
+	struct libfat_sector *lru_next;	/* Less recently used */
 	/* data[0] MUST be aligned to at least 8 bytes - see cache.c */
 	ALIGN_START(16) char data[0] ALIGN_END(16);
 } ALIGN_END(16);
 
+/* Sector cache parameters - see cache.c */
+#define LIBFAT_HASH_SIZE	1024	/* Must be a power of 2 */
+#define LIBFAT_SLAB_SECTORS	64	/* Sectors allocated at once */
+#define LIBFAT_CACHE_MAX	4096	/* Max cached sectors (2 MB) */
+#define LIBFAT_READAHEAD	8	/* Sectors read ahead on sequential access */
+
+struct libfat_slab {
+	struct libfat_slab *next;
+	char *mem;
+};
+
+struct libfat_cache {
+	struct libfat_sector *hash[LIBFAT_HASH_SIZE];
+	struct libfat_sector *lru_head;	/* Most recently used */
+	struct libfat_sector *lru_tail;	/* Least recently used */
+	struct libfat_sector *free;
+	struct libfat_slab *slabs;
+	unsigned int count;		/* Sectors allocated from the slabs */
+	size_t entry_size;		/* Size of a slab entry */
+	libfat_sector_t last_miss;
+};
+
 enum fat_type {
     FAT12,
     FAT16,
@@ -58,7 +82,7 @@ struct libfat_filesystem {
     libfat_sector_t data;	/* Start of data area */
     libfat_sector_t end;	/* End of filesystem */
 
-    struct libfat_sector *sectors;
+    struct libfat_cache cache;
 };
 
 #endif /* LIBFATINT_H */
@@ -18,6 +18,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "libfatint.h"
 #include "ulint.h"
 
@@ -31,11 +32,12 @@ libfat_open(int (*readfunc) (intptr_t, void *, size_t, libfat_sector_t),
     uint32_t sectors, fatsize, minfatsize, rootdirsize;
     uint32_t nclusters;
 
-    fs = malloc(sizeof(struct libfat_filesystem));
+    /* Zeroed, so that fs->end is 0 (no bound) for readahead until we know it */
+    fs = calloc(1, sizeof(struct libfat_filesystem));
     if (!fs)
 	goto barf;
 
-    fs->sectors = NULL;
+    fs->cache.last_miss = (libfat_sector_t)-1;
     fs->read = readfunc;
     fs->readptr = readptr;
 
@@ -105,8 +107,10 @@ libfat_open(int (*readfunc) (intptr_t, void *, size_t, libfat_sector_t),
     return fs;			/* All good */
 
 barf:
-    if (fs)
+    if (fs) {
+	libfat_flush(fs);
 	free(fs);
+    }
     return NULL;
 }
 
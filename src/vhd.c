@@ -31,6 +31,7 @@
 #include <io.h>
 #include <rpc.h>
 #include <time.h>
+#include <sys/stat.h>
 
 #include "rufus.h"
 #include "ui.h"
@@ -56,6 +57,8 @@ static char physical_path[128] = "";
 static int progress_op = OP_FILE_COPY, progress_msg = MSG_267;
 static HANDLE mounted_handle = INVALID_HANDLE_VALUE;
 static struct wimlib_progress_info_split last_split_progress;
+static wim_info_cache_entry wim_info_cache[4] = { 0 };
+static int wim_info_cache_next = 0;
 
 typedef struct {
 	const char* ext;
@@ -274,25 +277,142 @@ static enum wimlib_progress_status WimProgressFunc(enum wimlib_progress_msg msg_
 	return WIMLIB_PROGRESS_STATUS_CONTINUE;
 }
 
+// Read a range of a WIM file, which may reside on an ISO if using the "image.iso|/path" syntax.
+static BOOL ReadWimRange(const char* image, uint64_t offset, uint32_t size, uint8_t* buf)
+{
+	BOOL r = FALSE;
+	DWORD rb;
+	HANDLE h;
+	LARGE_INTEGER li;
+	char *iso_path, *sep;
+
+	sep = strchr(image, '|');
+	if (sep != NULL) {
+		iso_path = safe_strdup(image);
+		if (iso_path == NULL)
+			return FALSE;
+		iso_path[sep - image] = 0;
+		r = (ReadISOFileRange(iso_path, &iso_path[sep - image + 1], offset, size, buf) == size);
+		free(iso_path);
+		return r;
+	}
+
+	h = CreateFileU(image, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (h == INVALID_HANDLE_VALUE)
+		return FALSE;
+	li.QuadPart = offset;
+	r = SetFilePointerEx(h, li, NULL, FILE_BEGIN) && ReadFile(h, buf, size, &rb, NULL) && (rb == size);
+	CloseHandle(h);
+	return r;
+}
+
+// Look up the cached header/XML data for a WIM, or read it with a couple of seek reads.
+// Unlike wimlib_open_wim(), this doesn't load the blob table, which can be large for ESDs,
+// and the results are cached by (container path, size, mtime) so that reselecting the
+// same ISO doesn't go back to the media.
+static wim_info_cache_entry* GetWimInfo(const char* image)
+{
+	int i;
+	char *p, *container, path[MAX_PATH];
+	struct __stat64 st = { 0 };
+	wim_header_disk hdr;
+	wim_info_cache_entry* e = NULL;
+
+	if (image == NULL)
+		return NULL;
+
+	// Callers may or may not have a leading separator in the path of a WIM that resides on an ISO
+	// ("image.iso|sources\install.wim" vs "image.iso|\sources\install.wim"), so add one if needed.
+	p = strchr(image, '|');
+	if (p != NULL && p[1] != '\\' && p[1] != '/')
+		static_sprintf(path, "%.*s|\\%s", (int)(p - image), image, &p[1]);
+	else
+		static_strcpy(path, image);
+
+	container = safe_strdup(path);
+	if (container == NULL)
+		return NULL;
+	p = strchr(container, '|');
+	if (p != NULL)
+		*p = 0;
+	i = _stat64U(container, &st);
+	free(container);
+	if (i != 0)
+		return NULL;
+
+	for (i = 0; i < ARRAYSIZE(wim_info_cache); i++) {
+		e = &wim_info_cache[i];
+		if (e->path != NULL && strcmp(e->path, path) == 0 &&
+			e->size == st.st_size && e->mtime == st.st_mtime)
+			return e;
+	}
+
+	if (!ReadWimRange(path, 0, sizeof(hdr), (uint8_t*)&hdr))
+		return NULL;
+	if ((memcmp(hdr.magic, WIM_MAGIC, 8) != 0 && memcmp(hdr.magic, PWM_MAGIC, 8) != 0) ||
+		hdr.hdr_size < sizeof(hdr)) {
+		uprintf("'%s' is not a WIM image", image);
+		return NULL;
+	}
+
+	// Recycle the oldest cache slot
+	e = &wim_info_cache[wim_info_cache_next];
+	wim_info_cache_next = (wim_info_cache_next + 1) % ARRAYSIZE(wim_info_cache);
+	safe_free(e->path);
+	safe_free(e->xml);
+	memset(e, 0, sizeof(*e));
+
+	e->version = hdr.wim_version;
+	// The XML data is always stored uncompressed, as UTF-16LE
+	e->xml_len = (uint32_t)(hdr.xml_data_reshdr.size_in_wim & 0x00ffffffffffffffULL);
+	if (e->xml_len != 0 && e->xml_len <= WIM_MAX_XML_SIZE &&
+		!((hdr.xml_data_reshdr.size_in_wim >> 56) & WIM_RESHDR_FLAG_COMPRESSED)) {
+		e->xml = malloc(e->xml_len + sizeof(wchar_t));
+		if (e->xml == NULL || !ReadWimRange(path, hdr.xml_data_reshdr.offset_in_wim, e->xml_len, e->xml)) {
+			uprintf("Could not read WIM XML data from '%s'", image);
+			safe_free(e->xml);
+			e->xml_len = 0;
+		} else {
+			e->xml[e->xml_len] = 0;
+			e->xml[e->xml_len + 1] = 0;
+		}
+	} else {
+		e->xml_len = 0;
+	}
+	e->path = safe_strdup(path);
+	e->size = st.st_size;
+	e->mtime = st.st_mtime;
+	return e;
+}
+
 // Return the WIM version of an image
 uint32_t GetWimVersion(const char* image)
 {
-	int r;
-	WIMStruct* wim;
-	struct wimlib_wim_info info;
+	wim_info_cache_entry* e = GetWimInfo(image);
 
-	if (image == NULL)
+	if (e == NULL) {
+		uprintf("WARNING: Could not get WIM version");
 		return 0;
-
-	r = wimlib_open_wimU(image, 0, &wim);
-	if (r == 0) {
-		r = wimlib_get_wim_info(wim, &info);
-		wimlib_free(wim);
-		if (r == 0)
-			return info.wim_version;
 	}
-	uprintf("WARNING: Could not get WIM version: Error %d", r);
-	return 0;
+	return e->version;
+}
+
+// Return an allocated copy of the XML data of a WIM image, in the same UTF-16LE format as
+// wimlib_get_xml_data(). The caller must free() the returned buffer.
+BOOL GetWimXmlData(const char* image, void** xml, size_t* xml_len)
+{
+	wim_info_cache_entry* e = GetWimInfo(image);
+
+	*xml = NULL;
+	*xml_len = 0;
+	if (e == NULL || e->xml == NULL)
+		return FALSE;
+	*xml = malloc(e->xml_len + sizeof(wchar_t));
+	if (*xml == NULL)
+		return FALSE;
+	memcpy(*xml, e->xml, e->xml_len + sizeof(wchar_t));
+	*xml_len = e->xml_len;
+	return TRUE;
 }
 
 // Extract a file from a WIM image. Returns the allocated path of the extracted file or NULL on error.
@@ -332,10 +452,42 @@ out:
 	return (r == 0);
 }
 
-// Split an install.wim for FAT32 limits
+// Apply the user's compression profile, if any, to a WIM we are about to split, and
+// return the write flags to use. By default, the split parts reuse the compressed data
+// of the source as is, so the profile only applies when recompression was explicitly
+// requested. Values that are not set keep wimlib's defaults, i.e. one thread per CPU,
+// the source chunk size and level 50. LZX levels up to 34 use hash chains with a lazy
+// parser, which is several times faster than the binary tree matchfinder and near-
+// optimal parser used above that, at the cost of a few % in ratio.
+static int ApplyWimCompressionProfile(WIMStruct* wim)
+{
+	int32_t threads = ReadSetting32(SETTING_WIM_COMPRESSION_THREADS);
+	int32_t chunk_size = ReadSetting32(SETTING_WIM_CHUNK_SIZE);
+	int32_t level = ReadSetting32(SETTING_WIM_COMPRESSION_LEVEL);
+
+	if (!ReadSettingBool(SETTING_WIM_RECOMPRESS)) {
+		if (threads > 0 || chunk_size > 0 || level > 0)
+			uprintf("Ignoring WIM compression profile, as %s is not set", SETTING_WIM_RECOMPRESS);
+		return 0;
+	}
+	if (threads > 0)
+		wimlib_set_output_num_threads(wim, (unsigned)threads);
+	if (chunk_size > 0 && wimlib_set_output_chunk_size(wim, (uint32_t)chunk_size) != 0)
+		uprintf("Ignoring invalid WIM chunk size %d", chunk_size);
+	if (level > 0 && wimlib_set_output_compression_level(wim, (unsigned)level) != 0)
+		uprintf("Ignoring invalid WIM compression level %d", level);
+	uprintf("Recompressing WIM with profile: %d thread(s), chunk size %d, level %d",
+		threads, chunk_size, level);
+	return WIMLIB_WRITE_FLAG_RECOMPRESS;
+}
+
+// Split an install.wim for FAT32 limits. The source can be an "image.iso|/path/install.wim"
+// reference, in which case the WIM is streamed straight from the ISO and its resources are
+// copied raw into the .swm parts, without any intermediate copy or recompression.
 BOOL WimSplitFile(const char* src, const char* dst)
 {
-	int r = 1;
+	int r = 1, flags;
+	uint64_t start, duration;
 	WIMStruct* wim;
 
 	if ((src == NULL) || (dst == NULL))
@@ -345,8 +497,15 @@ BOOL WimSplitFile(const char* src, const char* dst)
 	wimlib_set_print_errors(true);
 	r = wimlib_open_wimU(src, 0, &wim);
 	if (r == 0) {
+		flags = ApplyWimCompressionProfile(wim);
 		wimlib_register_progress_function(wim, WimProgressFunc, NULL);
-		r = wimlib_splitU(wim, dst, 4094ULL * MB, WIMLIB_WRITE_FLAG_FSYNC);
+		start = GetTickCount64();
+		r = wimlib_splitU(wim, dst, 4094ULL * MB, WIMLIB_WRITE_FLAG_FSYNC | flags);
+		duration = GetTickCount64() - start;
+		// Report the throughput, so that compression profiles can be compared
+		if (r == 0 && duration > 0)
+			uprintf("Split %s in %.1f s (%.1f MB/s)", SizeToHumanReadable(last_split_progress.total_bytes, TRUE, FALSE),
+				duration / 1000.0, (double)last_split_progress.total_bytes * 1000.0 / (double)duration / MB);
 		wimlib_free(wim);
 	}
 	wimlib_global_cleanup();
@@ -355,6 +514,129 @@ out:
 	return (r == 0);
 }
 
+#if defined(RUFUS_TEST)
+#define TEST_WIM_PATH               "C:\\tmp\\install.wim"
+#define TEST_SWM_BASE               "C:\\tmp\\bench"
+
+// Compare the size and throughput of splitting TEST_WIM_PATH as is against
+// recompressing it with different chunk sizes and compression levels.
+void BenchmarkWimCompression(void)
+{
+	// A chunk size of 0 means a raw copy of the source resources
+	const struct { uint32_t chunk_size; unsigned level; } profiles[] = {
+		{ 0, 0 }, { 32768, 20 }, { 32768, 34 }, { 32768, 50 }, { 32768, 100 },
+		{ 131072, 34 }, { 131072, 50 }, { 1048576, 50 },
+	};
+	char part[MAX_PATH];
+	int i, j, r;
+	uint64_t start, duration, src_size, out_size;
+	struct __stat64 stat;
+	WIMStruct* wim;
+
+	if (_stat64U(TEST_WIM_PATH, &stat) != 0 || stat.st_size == 0) {
+		uprintf("WIM benchmark: Could not access '%s'", TEST_WIM_PATH);
+		return;
+	}
+	src_size = stat.st_size;
+	wimlib_global_init(0);
+	wimlib_set_print_errors(true);
+	for (i = 0; i < ARRAYSIZE(profiles); i++) {
+		r = wimlib_open_wimU(TEST_WIM_PATH, 0, &wim);
+		if (r != 0)
+			break;
+		if (profiles[i].chunk_size != 0) {
+			wimlib_set_output_chunk_size(wim, profiles[i].chunk_size);
+			wimlib_set_output_compression_level(wim, profiles[i].level);
+		}
+		start = GetTickCount64();
+		r = wimlib_splitU(wim, TEST_SWM_BASE ".swm", 4094ULL * MB,
+			(profiles[i].chunk_size != 0) ? WIMLIB_WRITE_FLAG_RECOMPRESS : 0);
+		duration = GetTickCount64() - start;
+		wimlib_free(wim);
+		// Add up the size of the parts, as named by wimlib, and remove them
+		out_size = 0;
+		for (j = 1; ; j++) {
+			if (j == 1)
+				static_strcpy(part, TEST_SWM_BASE ".swm");
+			else
+				static_sprintf(part, TEST_SWM_BASE "%d.swm", j);
+			if (_stat64U(part, &stat) != 0)
+				break;
+			out_size += stat.st_size;
+			DeleteFileU(part);
+		}
+		if (r != 0)
+			break;
+		uprintf("WIM benchmark: chunk %7d, level %3d: %0.2f s, %0.1f MB/s, %0.1f%% of source",
+			profiles[i].chunk_size, profiles[i].level, duration / 1000.0f,
+			(double)src_size * 1000.0 / (double)max(duration, 1) / MB,
+			100.0f * out_size / src_size);
+	}
+	if (r != 0)
+		uprintf("WIM benchmark: Could not split '%s': Wimlib error %d", TEST_WIM_PATH, r);
+	wimlib_global_cleanup();
+}
+
+static uint64_t bench_nb_allocs;
+
+static void* bench_malloc(size_t size)
+{
+	bench_nb_allocs++;
+	return malloc(size);
+}
+
+static void* bench_realloc(void* ptr, size_t size)
+{
+	bench_nb_allocs++;
+	return realloc(ptr, size);
+}
+
+static int bench_iterate_cb(const struct wimlib_dir_entry* dentry, void* ctx)
+{
+	return 0;
+}
+
+// Report how long it takes, and how many allocations it takes, to load then free
+// the metadata (i.e. the directory tree) of every image from TEST_WIM_PATH.
+void BenchmarkWimMetadata(void)
+{
+	int i, r;
+	uint64_t start, duration;
+	struct wimlib_wim_info info;
+	WIMStruct* wim;
+
+	wimlib_global_init(0);
+	wimlib_set_print_errors(true);
+	wimlib_set_memory_allocator(bench_malloc, NULL, bench_realloc);
+	r = wimlib_open_wimU(TEST_WIM_PATH, 0, &wim);
+	if (r != 0)
+		goto out;
+	wimlib_get_wim_info(wim, &info);
+	for (i = 1; i <= (int)info.image_count; i++) {
+		bench_nb_allocs = 0;
+		start = GetTickCount64();
+		// Looking up the root of the image is enough to have wimlib load its metadata
+		r = wimlib_iterate_dir_tree(wim, i, WIMLIB_WIM_ROOT_PATH, 0, bench_iterate_cb, NULL);
+		duration = GetTickCount64() - start;
+		if (r != 0)
+			break;
+		uprintf("WIM benchmark: image %d metadata loaded in %0.3f s (%lld allocations)",
+			i, duration / 1000.0f, bench_nb_allocs);
+	}
+	start = GetTickCount64();
+	wimlib_free(wim);
+	duration = GetTickCount64() - start;
+	if (r == 0)
+		uprintf("WIM benchmark: metadata for %d image(s) freed in %0.3f s", info.image_count, duration / 1000.0f);
+
+out:
+	if (r != 0)
+		uprintf("WIM benchmark: Could not load the metadata of '%s': Wimlib error %d", TEST_WIM_PATH, r);
+	wimlib_set_memory_allocator(NULL, NULL, NULL);
+	wimlib_global_cleanup();
+}
+#endif
+
 BOOL WimApplyImage(const char* image, int index, const char* dst)
 {
 	int r = 1;
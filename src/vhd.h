@@ -79,6 +79,47 @@ typedef struct
 	};
 } STOPGAP_CREATE_VIRTUAL_DISK_PARAMETERS;
 
+#define WIM_MAGIC                   "MSWIM\0\0\0"
+#define PWM_MAGIC                   "WLPWM\0\0\0"
+#define WIM_RESHDR_FLAG_COMPRESSED  0x04
+#define WIM_MAX_XML_SIZE            (16 * MB)
+
+#pragma pack(push, 1)
+typedef struct {
+	uint64_t size_in_wim;		// 56-bit size + 8-bit flags
+	uint64_t offset_in_wim;
+	uint64_t uncompressed_size;
+} wim_reshdr_disk;
+
+// On-disk WIM header (see wimlib/header.h)
+typedef struct {
+	uint8_t magic[8];
+	uint32_t hdr_size;
+	uint32_t wim_version;
+	uint32_t wim_flags;
+	uint32_t chunk_size;
+	uint8_t guid[16];
+	uint16_t part_number;
+	uint16_t total_parts;
+	uint32_t image_count;
+	wim_reshdr_disk blob_table_reshdr;
+	wim_reshdr_disk xml_data_reshdr;
+	wim_reshdr_disk boot_metadata_reshdr;
+	uint32_t boot_idx;
+	wim_reshdr_disk integrity_table_reshdr;
+	uint8_t unused[60];
+} wim_header_disk;
+#pragma pack(pop)
+
+typedef struct {
+	char* path;
+	int64_t size;
+	int64_t mtime;
+	uint32_t version;
+	uint32_t xml_len;
+	uint8_t* xml;
+} wim_info_cache_entry;
+
 // From https://docs.microsoft.com/en-us/previous-versions/msdn10/dd834960(v=msdn.10)
 // as well as https://msfn.org/board/topic/150700-wimgapi-wimmountimage-progressbar/
 enum WIMMessage {
@@ -104,9 +145,14 @@ enum WIMMessage {
 };
 
 extern uint32_t GetWimVersion(const char* image);
+extern BOOL GetWimXmlData(const char* image, void** xml, size_t* xml_len);
 extern BOOL WimExtractFile(const char* wim_image, int index, const char* src, const char* dst);
 extern BOOL WimApplyImage(const char* image, int index, const char* dst);
 extern BOOL WimSplitFile(const char* src, const char* dst);
+#if defined(RUFUS_TEST)
+extern void BenchmarkWimCompression(void);
+extern void BenchmarkWimMetadata(void);
+#endif
 extern int8_t IsBootableImage(const char* path);
 extern char* VhdMountImageAndGetSize(const char* path, uint64_t* disksize);
 #define VhdMountImage(path) VhdMountImageAndGetSize(path, NULL)
@@ -48,34 +48,71 @@
 #include "wimlib/win32.h"
 #include "wimlib/write.h"
 
-/* A hash table mapping SHA-1 message digests to blob descriptors  */
+/*
+ * A slot in the blob table.  The first 8 bytes of the blob's SHA-1 message
+ * digest are kept inline, so that probing only has to touch the slot array
+ * until a likely match is found.
+ */
+struct blob_table_slot {
+	u64 hash_prefix;
+	struct blob_descriptor *blob;
+};
+
+/* Marks a slot whose blob was unlinked.  Lookups probe past it; inserts may
+ * reuse it.  */
+#define BLOB_TABLE_TOMBSTONE	((struct blob_descriptor *)1)
+
+/*
+ * A hash table mapping SHA-1 message digests to blob descriptors.
+ *
+ * This uses open addressing with linear probing.  The table is kept at most
+ * 3/4 full, counting tombstones, and is rebuilt when it gets fuller than that.
+ * Unlinked blobs leave a tombstone rather than causing other entries to move,
+ * so that for_blob_in_table() visitors can safely unlink the current blob.
+ */
 struct blob_table {
-	struct hlist_head *array;
+	struct blob_table_slot *slots;
 	size_t num_blobs;
+	size_t num_tombstones;
 	size_t mask; /* capacity - 1; capacity is a power of 2  */
 };
 
+static inline u64
+blob_hash_prefix(const u8 *hash)
+{
+	return load_u64_unaligned(hash);
+}
+
+/* Return the number of slots needed to hold @num_blobs blobs without going
+ * above the maximum load factor.  */
+static size_t
+blob_table_capacity_for(size_t num_blobs)
+{
+	return roundup_pow_of_2(max(num_blobs + num_blobs / 3 + 1, (size_t)16));
+}
+
 struct blob_table *
 new_blob_table(size_t capacity)
 {
 	struct blob_table *table;
-	struct hlist_head *array;
+	struct blob_table_slot *slots;
 
-	capacity = roundup_pow_of_2(capacity);
+	capacity = blob_table_capacity_for(capacity);
 
 	table = MALLOC(sizeof(struct blob_table));
 	if (table == NULL)
 		goto oom;
 
-	array = CALLOC(capacity, sizeof(array[0]));
-	if (array == NULL) {
+	slots = CALLOC(capacity, sizeof(slots[0]));
+	if (slots == NULL) {
 		FREE(table);
 		goto oom;
 	}
 
 	table->num_blobs = 0;
+	table->num_tombstones = 0;
 	table->mask = capacity - 1;
-	table->array = array;
+	table->slots = slots;
 	return table;
 
 oom:
@@ -96,7 +133,7 @@ free_blob_table(struct blob_table *table)
 {
 	if (table) {
 		for_blob_in_table(table, do_free_blob_descriptor, NULL);
-		FREE(table->array);
+		FREE(table->slots);
 		FREE(table);
 	}
 }
@@ -299,55 +336,93 @@ blob_decrement_num_opened_fds(struct blob_descriptor *blob)
 #endif
 
 static void
-blob_table_insert_raw(struct blob_table *table, struct blob_descriptor *blob)
+blob_table_insert_raw(struct blob_table_slot *slots, size_t mask,
+		      struct blob_descriptor *blob, u64 hash_prefix)
 {
-	size_t i = blob->hash_short & table->mask;
+	size_t i = hash_prefix & mask;
 
-	hlist_add_head(&blob->hash_list, &table->array[i]);
+	while (slots[i].blob != NULL)
+		i = (i + 1) & mask;
+	slots[i].hash_prefix = hash_prefix;
+	slots[i].blob = blob;
 }
 
-static void
-enlarge_blob_table(struct blob_table *table)
+/* Rebuild the blob table with room for at least one more blob, dropping any
+ * tombstones.  The capacity only grows if the live blobs need it.  */
+static int
+rebuild_blob_table(struct blob_table *table)
 {
-	size_t old_capacity, new_capacity;
-	struct hlist_head *old_array, *new_array;
-	struct blob_descriptor *blob;
-	struct hlist_node *tmp;
-	size_t i;
+	size_t old_capacity = table->mask + 1;
+	size_t new_capacity = blob_table_capacity_for(table->num_blobs + 1);
+	struct blob_table_slot *old_slots = table->slots;
+	struct blob_table_slot *new_slots;
+
+	new_capacity = max(new_capacity, old_capacity);
+	new_slots = CALLOC(new_capacity, sizeof(new_slots[0]));
+	if (new_slots == NULL)
+		return WIMLIB_ERR_NOMEM;
 
-	old_capacity = table->mask + 1;
-	new_capacity = old_capacity * 2;
-	new_array = CALLOC(new_capacity, sizeof(struct hlist_head));
-	if (new_array == NULL)
-		return;
-	old_array = table->array;
-	table->array = new_array;
-	table->mask = new_capacity - 1;
+	for (size_t i = 0; i < old_capacity; i++) {
+		struct blob_descriptor *blob = old_slots[i].blob;
 
-	for (i = 0; i < old_capacity; i++)
-		hlist_for_each_entry_safe(blob, tmp, &old_array[i], hash_list)
-			blob_table_insert_raw(table, blob);
-	FREE(old_array);
+		if (blob != NULL && blob != BLOB_TABLE_TOMBSTONE)
+			blob_table_insert_raw(new_slots, new_capacity - 1, blob,
+					      old_slots[i].hash_prefix);
+	}
+	table->slots = new_slots;
+	table->mask = new_capacity - 1;
+	table->num_tombstones = 0;
+	FREE(old_slots);
+	return 0;
 }
 
 /* Insert a blob descriptor into the blob table.  */
 void
 blob_table_insert(struct blob_table *table, struct blob_descriptor *blob)
 {
-	blob_table_insert_raw(table, blob);
-	if (table->num_blobs++ > table->mask)
-		enlarge_blob_table(table);
+	const u64 hash_prefix = blob_hash_prefix(blob->hash);
+	size_t capacity = table->mask + 1;
+	size_t i;
+
+	if ((table->num_blobs + table->num_tombstones + 1) * 4 > capacity * 3) {
+		/* If this fails, we can keep going as long as an empty slot
+		 * remains to terminate probing; probe sequences just get
+		 * longer.  */
+		if (rebuild_blob_table(table) != 0)
+			wimlib_assert(table->num_blobs + table->num_tombstones + 1
+				      < capacity);
+	}
+
+	/* Reuse the first tombstone on the probe sequence, if any.  */
+	for (i = hash_prefix & table->mask;
+	     table->slots[i].blob != NULL &&
+	     table->slots[i].blob != BLOB_TABLE_TOMBSTONE;
+	     i = (i + 1) & table->mask)
+		;
+	if (table->slots[i].blob == BLOB_TABLE_TOMBSTONE)
+		table->num_tombstones--;
+	table->slots[i].hash_prefix = hash_prefix;
+	table->slots[i].blob = blob;
+	table->num_blobs++;
 }
 
 /* Unlinks a blob descriptor from the blob table; does not free it.  */
 void
 blob_table_unlink(struct blob_table *table, struct blob_descriptor *blob)
 {
+	size_t i;
+
 	wimlib_assert(!blob->unhashed);
 	wimlib_assert(table->num_blobs != 0);
 
-	hlist_del(&blob->hash_list);
+	for (i = blob_hash_prefix(blob->hash) & table->mask;
+	     table->slots[i].blob != blob;
+	     i = (i + 1) & table->mask)
+		wimlib_assert(table->slots[i].blob != NULL);
+
+	table->slots[i].blob = BLOB_TABLE_TOMBSTONE;
 	table->num_blobs--;
+	table->num_tombstones++;
 }
 
 /* Given a SHA-1 message digest, return the corresponding blob descriptor from
@@ -355,13 +430,19 @@ blob_table_unlink(struct blob_table *table, struct blob_descriptor *blob)
 struct blob_descriptor *
 lookup_blob(const struct blob_table *table, const u8 *hash)
 {
+	const u64 hash_prefix = blob_hash_prefix(hash);
+	const struct blob_table_slot *slot;
 	size_t i;
-	struct blob_descriptor *blob;
 
-	i = load_size_t_unaligned(hash) & table->mask;
-	hlist_for_each_entry(blob, &table->array[i], hash_list)
-		if (hashes_equal(hash, blob->hash))
-			return blob;
+	for (i = hash_prefix & table->mask;
+	     (slot = &table->slots[i])->blob != NULL;
+	     i = (i + 1) & table->mask)
+	{
+		if (slot->hash_prefix == hash_prefix &&
+		    slot->blob != BLOB_TABLE_TOMBSTONE &&
+		    hashes_equal(hash, slot->blob->hash))
+			return slot->blob;
+	}
 	return NULL;
 }
 
@@ -371,18 +452,16 @@ int
 for_blob_in_table(struct blob_table *table,
 		  int (*visitor)(struct blob_descriptor *, void *), void *arg)
 {
-	struct blob_descriptor *blob;
-	struct hlist_node *tmp;
 	int ret;
 
 	for (size_t i = 0; i <= table->mask; i++) {
-		hlist_for_each_entry_safe(blob, tmp, &table->array[i],
-					  hash_list)
-		{
-			ret = visitor(blob, arg);
-			if (ret)
-				return ret;
-		}
+		struct blob_descriptor *blob = table->slots[i].blob;
+
+		if (blob == NULL || blob == BLOB_TABLE_TOMBSTONE)
+			continue;
+		ret = visitor(blob, arg);
+		if (ret)
+			return ret;
 	}
 	return 0;
 }
@@ -964,7 +964,8 @@ free_dentry(struct wim_dentry *dentry)
 		FREE(dentry->d_name);
 		FREE(dentry->d_short_name);
 		FREE(dentry->d_full_path);
-		FREE(dentry);
+		if (!dentry->d_in_arena)
+			FREE(dentry);
 	}
 }
 
@@ -1322,11 +1323,110 @@ setup_inode_streams(const u8 *p, const u8 *end, struct wim_inode *inode,
 	return 0;
 }
 
+/*
+ * A dentry arena holds the dentries and inodes of a dentry tree read from a
+ * metadata resource.  An image can easily have 100,000 of each, so rather than
+ * allocating them one by one, they are carved out of large blocks that are all
+ * released together once the image's metadata is unloaded.  free_dentry() and
+ * free_inode() skip the structures they find to be in an arena, but still free
+ * the names and other data hanging off them, which are allocated normally.
+ */
+
+#define DENTRY_ARENA_BLOCK_SIZE		((size_t)1 << 20)
+#define DENTRY_ARENA_ALIGNMENT		16
+
+struct dentry_arena_block {
+	struct dentry_arena_block *next;
+	size_t used;
+	u8 data[];
+};
+
+struct dentry_arena {
+	struct dentry_arena_block *blocks;
+};
+
+struct dentry_arena *
+new_dentry_arena(void)
+{
+	return CALLOC(1, sizeof(struct dentry_arena));
+}
+
+void
+free_dentry_arena(struct dentry_arena *arena)
+{
+	if (arena) {
+		struct dentry_arena_block *block, *next;
+
+		for (block = arena->blocks; block; block = next) {
+			next = block->next;
+			FREE(block);
+		}
+		FREE(arena);
+	}
+}
+
+/* Allocate @size zeroed bytes from a dentry arena.  */
+static void *
+dentry_arena_alloc(struct dentry_arena *arena, size_t size)
+{
+	struct dentry_arena_block *block = arena->blocks;
+	uintptr_t p;
+
+	wimlib_assert(size + DENTRY_ARENA_ALIGNMENT <= DENTRY_ARENA_BLOCK_SIZE);
+
+	if (block) {
+		p = ALIGN((uintptr_t)&block->data[block->used],
+			  DENTRY_ARENA_ALIGNMENT);
+		if (p + size <= (uintptr_t)&block->data[DENTRY_ARENA_BLOCK_SIZE]) {
+			block->used = p + size - (uintptr_t)block->data;
+			return (void *)p;
+		}
+	}
+
+	block = CALLOC(1, sizeof(*block) + DENTRY_ARENA_BLOCK_SIZE);
+	if (!block)
+		return NULL;
+	block->next = arena->blocks;
+	arena->blocks = block;
+	p = ALIGN((uintptr_t)block->data, DENTRY_ARENA_ALIGNMENT);
+	block->used = p + size - (uintptr_t)block->data;
+	return (void *)p;
+}
+
+/* Like new_dentry_with_new_inode() with no name and no timestamps, but take
+ * the dentry and inode from @arena if it is not NULL.  */
+static int
+new_dentry_with_new_inode_in_arena(struct dentry_arena *arena,
+				   struct wim_dentry **dentry_ret)
+{
+	struct wim_dentry *dentry;
+	struct wim_inode *inode;
+
+	if (!arena)
+		return new_dentry_with_new_inode(NULL, false, dentry_ret);
+
+	dentry = dentry_arena_alloc(arena, sizeof(struct wim_dentry));
+	if (!dentry)
+		return WIMLIB_ERR_NOMEM;
+	dentry->d_in_arena = 1;
+	dentry->d_parent = dentry;
+
+	inode = dentry_arena_alloc(arena, sizeof(struct wim_inode));
+	if (!inode)
+		return WIMLIB_ERR_NOMEM;
+	inode->i_in_arena = 1;
+	init_inode(inode, dentry, false);
+
+	*dentry_ret = dentry;
+	return 0;
+}
+
 /* Read a dentry, including all extra stream entries that follow it, from an
  * uncompressed metadata resource buffer.  */
 static int
 read_dentry(const u8 * restrict buf, size_t buf_len,
-	    u64 *offset_p, struct wim_dentry **dentry_ret)
+	    u64 *offset_p, struct wim_dentry **dentry_ret,
+	    struct dentry_arena *arena)
 {
 	u64 offset = *offset_p;
 	u64 length;
@@ -1373,7 +1473,7 @@ read_dentry(const u8 * restrict buf, size_t buf_len,
 		return WIMLIB_ERR_INVALID_METADATA_RESOURCE;
 
 	/* Allocate new dentry structure, along with a preliminary inode.  */
-	ret = new_dentry_with_new_inode(NULL, false, &dentry);
+	ret = new_dentry_with_new_inode_in_arena(arena, &dentry);
 	if (ret)
 		return ret;
 
@@ -1531,7 +1631,8 @@ should_ignore_dentry(struct wim_dentry *dir, const struct wim_dentry *dentry)
 
 static int
 read_dentry_tree_recursive(const u8 * restrict buf, size_t buf_len,
-			   struct wim_dentry * restrict dir, unsigned depth)
+			   struct wim_dentry * restrict dir, unsigned depth,
+			   struct dentry_arena *arena)
 {
 	u64 cur_offset = dir->d_subdir_offset;
 
@@ -1547,7 +1648,7 @@ read_dentry_tree_recursive(const u8 * restrict buf, size_t buf_len,
 		int ret;
 
 		/* Read next child of @dir.  */
-		ret = read_dentry(buf, buf_len, &cur_offset, &child);
+		ret = read_dentry(buf, buf_len, &cur_offset, &child, arena);
 		if (ret)
 			return ret;
 
@@ -1582,7 +1683,8 @@ read_dentry_tree_recursive(const u8 * restrict buf, size_t buf_len,
 				ret = read_dentry_tree_recursive(buf,
 								 buf_len,
 								 child,
-								 depth + 1);
+								 depth + 1,
+								 arena);
 				if (ret)
 					return ret;
 			} else {
@@ -1611,6 +1713,10 @@ read_dentry_tree_recursive(const u8 * restrict buf, size_t buf_len,
  *	this location.  The former case only occurs in the unexpected case that
  *	the tree began with an end-of-directory entry.
  *
+ * @arena:
+ *	If not NULL, the dentry arena to allocate the dentries and inodes from.
+ *	It must outlive the tree.
+ *
  * Return values:
  *	WIMLIB_ERR_SUCCESS (0)
  *	WIMLIB_ERR_INVALID_METADATA_RESOURCE
@@ -1618,12 +1724,13 @@ read_dentry_tree_recursive(const u8 * restrict buf, size_t buf_len,
  */
 int
 read_dentry_tree(const u8 *buf, size_t buf_len,
-		 u64 root_offset, struct wim_dentry **root_ret)
+		 u64 root_offset, struct wim_dentry **root_ret,
+		 struct dentry_arena *arena)
 {
 	int ret;
 	struct wim_dentry *root;
 
-	ret = read_dentry(buf, buf_len, &root_offset, &root);
+	ret = read_dentry(buf, buf_len, &root_offset, &root, arena);
 	if (ret)
 		return ret;
 
@@ -1643,7 +1750,8 @@ read_dentry_tree(const u8 *buf, size_t buf_len,
 		}
 
 		if (likely(root->d_subdir_offset != 0)) {
-			ret = read_dentry_tree_recursive(buf, buf_len, root, 0);
+			ret = read_dentry_tree_recursive(buf, buf_len, root, 0,
+							 arena);
 			if (ret)
 				goto err_free_dentry_tree;
 		}
@@ -25,6 +25,7 @@
 #endif
 
 #include <errno.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "wimlib/error.h"
@@ -134,8 +135,6 @@ iso_pread(struct filedes* fd, void* buf, size_t count, off_t offset)
 	}
 
 	while (count >= ISO_BLOCKSIZE) {
-		ret = iso9660_iso_seek_read(fd->p_iso, _buf,
-			lsn_offset % ISO_BLOCKSIZE, 1);
 		ret = iso9660_iso_seek_read(fd->p_iso, buf, lsn_offset, count / ISO_BLOCKSIZE);
 		if (unlikely(ret <= 0)) {
 			errno = EINVAL;
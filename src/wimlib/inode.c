@@ -44,16 +44,11 @@
  */
 const utf16lechar NO_STREAM_NAME[1];
 
-/* Allocate a new inode and associate the specified dentry with it.  */
-struct wim_inode *
-new_inode(struct wim_dentry *dentry, bool set_timestamps)
+/* Initialize a zeroed inode and associate the specified dentry with it.  */
+void
+init_inode(struct wim_inode *inode, struct wim_dentry *dentry,
+	   bool set_timestamps)
 {
-	struct wim_inode *inode;
-
-	inode = CALLOC(1, sizeof(struct wim_inode));
-	if (!inode)
-		return NULL;
-
 	inode->i_security_id = -1;
 	/*inode->i_nlink = 0;*/
 	inode->i_rp_flags = WIM_RP_FLAG_NOT_FIXED;
@@ -66,6 +61,18 @@ new_inode(struct wim_dentry *dentry, bool set_timestamps)
 		inode->i_last_write_time = now;
 	}
 	d_associate(dentry, inode);
+}
+
+/* Allocate a new inode and associate the specified dentry with it.  */
+struct wim_inode *
+new_inode(struct wim_dentry *dentry, bool set_timestamps)
+{
+	struct wim_inode *inode;
+
+	inode = CALLOC(1, sizeof(struct wim_inode));
+	if (!inode)
+		return NULL;
+	init_inode(inode, dentry, set_timestamps);
 	return inode;
 }
 
@@ -87,7 +94,8 @@ free_inode(struct wim_inode *inode)
 		FREE(inode->i_extra);
 	if (!hlist_unhashed(&inode->i_hlist_node))
 		hlist_del(&inode->i_hlist_node);
-	FREE(inode);
+	if (!inode->i_in_arena)
+		FREE(inode);
 }
 
 static inline void
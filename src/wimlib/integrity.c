@@ -32,9 +32,13 @@
 #include "wimlib/error.h"
 #include "wimlib/file_io.h"
 #include "wimlib/integrity.h"
+#include "wimlib/list.h"
 #include "wimlib/progress.h"
 #include "wimlib/resource.h"
 #include "wimlib/sha1.h"
+#include "wimlib/threads.h"
+#include "wimlib/timestamp.h"
+#include "wimlib/util.h"
 #include "wimlib/wim.h"
 #include "wimlib/write.h"
 
@@ -86,6 +90,256 @@ calculate_chunk_sha1(struct filedes *in_fd, size_t this_chunk_size,
 	return 0;
 }
 
+/*
+ * Parallel chunk hashing
+ *
+ * The integrity-checked region is read one chunk at a time, in order, into a
+ * small ring of chunk-sized buffers, and each buffer is handed to a pool of
+ * threads that compute its SHA-1 message digest.  Reading thus overlaps
+ * hashing, and hashing scales with the number of cores.  Results are delivered
+ * to the caller in chunk order, on the calling thread.  Reads go through
+ * full_pread() so that this also works for WIMs located inside ISO images.
+ */
+
+/* Upper bound on the memory used by the chunk buffers  */
+#define INTEGRITY_MAX_BUFFER_MEMORY	((size_t)128 << 20)
+
+struct integrity_chunk {
+	struct list_head list;
+	u8 *buf;
+	size_t size;
+	bool done;
+	u8 sha1_md[SHA1_HASH_SIZE];
+};
+
+struct integrity_hasher {
+	struct mutex lock;
+	struct condvar chunk_avail_cond;
+	struct condvar chunk_done_cond;
+	struct list_head pending_chunks;
+	bool terminating;
+	struct thread *threads;
+	unsigned num_threads;
+};
+
+/* Called, in order, for each chunk.  @sha1_md is NULL if @want_chunk returned
+ * false for the chunk.  */
+typedef int (*integrity_chunk_done_t)(u32 i, const u8 *sha1_md,
+				      size_t size, void *ctx);
+typedef bool (*integrity_want_chunk_t)(u32 i, size_t size, void *ctx);
+
+static void *
+integrity_hasher_thread_proc(void *arg)
+{
+	struct integrity_hasher *h = arg;
+	struct integrity_chunk *chunk;
+
+	mutex_lock(&h->lock);
+	for (;;) {
+		while (list_empty(&h->pending_chunks) && !h->terminating)
+			condvar_wait(&h->chunk_avail_cond, &h->lock);
+		if (h->terminating)
+			break;
+		chunk = list_entry(h->pending_chunks.next,
+				   struct integrity_chunk, list);
+		list_del(&chunk->list);
+		mutex_unlock(&h->lock);
+
+		sha1(chunk->buf, chunk->size, chunk->sha1_md);
+
+		mutex_lock(&h->lock);
+		chunk->done = true;
+		condvar_broadcast(&h->chunk_done_cond);
+	}
+	mutex_unlock(&h->lock);
+	return NULL;
+}
+
+static void
+integrity_hasher_stop(struct integrity_hasher *h)
+{
+	mutex_lock(&h->lock);
+	h->terminating = true;
+	condvar_broadcast(&h->chunk_avail_cond);
+	mutex_unlock(&h->lock);
+	for (unsigned i = 0; i < h->num_threads; i++)
+		thread_join(&h->threads[i]);
+	FREE(h->threads);
+	condvar_destroy(&h->chunk_done_cond);
+	condvar_destroy(&h->chunk_avail_cond);
+	mutex_destroy(&h->lock);
+}
+
+static bool
+integrity_hasher_start(struct integrity_hasher *h, unsigned num_threads)
+{
+	memset(h, 0, sizeof(*h));
+	if (!mutex_init(&h->lock))
+		return false;
+	if (!condvar_init(&h->chunk_avail_cond)) {
+		mutex_destroy(&h->lock);
+		return false;
+	}
+	if (!condvar_init(&h->chunk_done_cond)) {
+		condvar_destroy(&h->chunk_avail_cond);
+		mutex_destroy(&h->lock);
+		return false;
+	}
+	INIT_LIST_HEAD(&h->pending_chunks);
+	h->threads = CALLOC(num_threads, sizeof(h->threads[0]));
+	if (h->threads) {
+		for (; h->num_threads < num_threads; h->num_threads++)
+			if (!thread_create(&h->threads[h->num_threads],
+					   integrity_hasher_thread_proc, h))
+				break;
+	}
+	if (h->num_threads == 0) {
+		integrity_hasher_stop(h);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Hash @num_chunks chunks of @chunk_size bytes (the last one being
+ * @last_chunk_size bytes) starting at @offset in @in_fd, calling @chunk_done
+ * for each one in order.  Chunks for which @want_chunk returns false are not
+ * read.
+ */
+static int
+hash_integrity_chunks(struct filedes *in_fd, u64 offset, u32 num_chunks,
+		      size_t chunk_size, size_t last_chunk_size,
+		      integrity_want_chunk_t want_chunk,
+		      integrity_chunk_done_t chunk_done, void *ctx)
+{
+	struct integrity_hasher h;
+	struct integrity_chunk *chunks = NULL;
+	unsigned num_threads = get_available_cpus();
+	size_t num_slots;
+	u32 next_read = 0, next_done = 0;
+	int ret = 0;
+
+	num_slots = min((size_t)num_threads + 2,
+			max(INTEGRITY_MAX_BUFFER_MEMORY / chunk_size, (size_t)1));
+	num_slots = min(num_slots, (size_t)num_chunks);
+
+	if (num_threads > 1 && num_slots > 1) {
+		chunks = CALLOC(num_slots, sizeof(chunks[0]));
+		for (size_t j = 0; chunks && j < num_slots; j++) {
+			chunks[j].buf = MALLOC(chunk_size);
+			if (!chunks[j].buf) {
+				for (size_t k = 0; k < j; k++)
+					FREE(chunks[k].buf);
+				FREE(chunks);
+				chunks = NULL;
+			}
+		}
+		if (chunks && !integrity_hasher_start(&h, num_threads)) {
+			for (size_t j = 0; j < num_slots; j++)
+				FREE(chunks[j].buf);
+			FREE(chunks);
+			chunks = NULL;
+		}
+	}
+
+	if (!chunks) {
+		/* Single-threaded, with a small buffer.  */
+		for (u32 i = 0; i < num_chunks; i++) {
+			size_t size = (i == num_chunks - 1) ? last_chunk_size :
+							      chunk_size;
+			u8 sha1_md[SHA1_HASH_SIZE];
+			bool want = want_chunk(i, size, ctx);
+
+			if (want) {
+				ret = calculate_chunk_sha1(in_fd, size, offset,
+							   sha1_md);
+				if (ret)
+					return ret;
+			}
+			ret = chunk_done(i, want ? sha1_md : NULL, size, ctx);
+			if (ret)
+				return ret;
+			offset += size;
+		}
+		return 0;
+	}
+
+	while (next_done < num_chunks) {
+		struct integrity_chunk *chunk;
+
+		/* Read ahead as long as there is a free buffer.  */
+		if (next_read < num_chunks && next_read - next_done < num_slots) {
+			chunk = &chunks[next_read % num_slots];
+			chunk->size = (next_read == num_chunks - 1) ?
+					last_chunk_size : chunk_size;
+			chunk->done = true;
+			if (want_chunk(next_read, chunk->size, ctx)) {
+				ret = full_pread(in_fd, chunk->buf, chunk->size,
+						 offset);
+				if (ret) {
+					ERROR_WITH_ERRNO("Read error while calculating "
+							 "integrity checksums");
+					break;
+				}
+				mutex_lock(&h.lock);
+				chunk->done = false;
+				list_add_tail(&chunk->list, &h.pending_chunks);
+				condvar_signal(&h.chunk_avail_cond);
+				mutex_unlock(&h.lock);
+			} else {
+				chunk->size = 0;
+			}
+			offset += (next_read == num_chunks - 1) ?
+					last_chunk_size : chunk_size;
+			next_read++;
+		}
+
+		/* Deliver finished chunks in order; block only when there is
+		 * nothing left to read ahead.  */
+		for (;;) {
+			bool must_wait = (next_read == num_chunks ||
+					  next_read - next_done == num_slots);
+			chunk = &chunks[next_done % num_slots];
+
+			mutex_lock(&h.lock);
+			while (!chunk->done && must_wait)
+				condvar_wait(&h.chunk_done_cond, &h.lock);
+			bool done = chunk->done;
+			mutex_unlock(&h.lock);
+			if (!done)
+				break;
+
+			ret = chunk_done(next_done,
+					 chunk->size ? chunk->sha1_md : NULL,
+					 (next_done == num_chunks - 1) ?
+						last_chunk_size : chunk_size,
+					 ctx);
+			if (ret)
+				goto out;
+			if (++next_done == next_read)
+				break;
+		}
+	}
+out:
+	integrity_hasher_stop(&h);
+	for (size_t j = 0; j < num_slots; j++)
+		FREE(chunks[j].buf);
+	FREE(chunks);
+	return ret;
+}
+
+/* Update the throughput field of @progress, given the start time of the
+ * operation as a WIM timestamp (100 ns units).  */
+static void
+update_integrity_throughput(union wimlib_progress_info *progress, u64 start_time)
+{
+	u64 elapsed = now_as_wim_timestamp() - start_time;
+
+	if (elapsed > 0)
+		progress->integrity.bytes_per_sec =
+			progress->integrity.completed_bytes * 10000000 / elapsed;
+}
+
 
 /*
  * read_integrity_table: -  Reads the integrity table from a WIM file.
@@ -143,6 +397,49 @@ read_integrity_table(WIMStruct *wim, u64 num_checked_bytes,
 	return 0;
 }
 
+struct calc_integrity_ctx {
+	struct integrity_table *new_table;
+	const struct integrity_table *old_table;
+	u32 old_num_chunks;
+	size_t old_last_chunk_size;
+	size_t chunk_size;
+	union wimlib_progress_info progress;
+	wimlib_progress_func_t progfunc;
+	void *progctx;
+	u64 start_time;
+};
+
+/* Returns false if the SHA1 message digest of chunk @i can be taken from the
+ * old integrity table.  */
+static bool
+calc_want_chunk(u32 i, size_t size, void *_ctx)
+{
+	struct calc_integrity_ctx *ctx = _ctx;
+
+	return !(ctx->old_table &&
+		 ((size == ctx->chunk_size && i < ctx->old_num_chunks - 1) ||
+		  (i == ctx->old_num_chunks - 1 &&
+		   size == ctx->old_last_chunk_size)));
+}
+
+static int
+calc_chunk_done(u32 i, const u8 *sha1_md, size_t size, void *_ctx)
+{
+	struct calc_integrity_ctx *ctx = _ctx;
+
+	if (sha1_md)
+		copy_hash(ctx->new_table->sha1sums[i], sha1_md);
+	else
+		copy_hash(ctx->new_table->sha1sums[i],
+			  ctx->old_table->sha1sums[i]);
+
+	ctx->progress.integrity.completed_chunks++;
+	ctx->progress.integrity.completed_bytes += size;
+	update_integrity_throughput(&ctx->progress, ctx->start_time);
+	return call_progress(ctx->progfunc, WIMLIB_PROGRESS_MSG_CALC_INTEGRITY,
+			     &ctx->progress, ctx->progctx);
+}
+
 /*
  * calculate_integrity_table():
  *
@@ -216,50 +513,35 @@ calculate_integrity_table(struct filedes *in_fd,
 	new_table->size = new_table_size;
 	new_table->chunk_size = chunk_size;
 
-	u64 offset = WIM_HEADER_DISK_SIZE;
-	union wimlib_progress_info progress;
-
-	progress.integrity.total_bytes      = new_check_bytes;
-	progress.integrity.total_chunks     = new_num_chunks;
-	progress.integrity.completed_chunks = 0;
-	progress.integrity.completed_bytes  = 0;
-	progress.integrity.chunk_size       = chunk_size;
-	progress.integrity.filename         = NULL;
+	struct calc_integrity_ctx ctx = {
+		.new_table		= new_table,
+		.old_table		= old_table,
+		.old_num_chunks		= old_num_chunks,
+		.old_last_chunk_size	= old_last_chunk_size,
+		.chunk_size		= chunk_size,
+		.progfunc		= progfunc,
+		.progctx		= progctx,
+		.start_time		= now_as_wim_timestamp(),
+	};
+
+	ctx.progress.integrity.total_bytes      = new_check_bytes;
+	ctx.progress.integrity.total_chunks     = new_num_chunks;
+	ctx.progress.integrity.completed_chunks = 0;
+	ctx.progress.integrity.completed_bytes  = 0;
+	ctx.progress.integrity.chunk_size       = chunk_size;
+	ctx.progress.integrity.filename         = NULL;
+	ctx.progress.integrity.bytes_per_sec    = 0;
 
 	ret = call_progress(progfunc, WIMLIB_PROGRESS_MSG_CALC_INTEGRITY,
-			    &progress, progctx);
+			    &ctx.progress, progctx);
 	if (ret)
 		goto out_free_new_table;
 
-	for (u32 i = 0; i < new_num_chunks; i++) {
-		size_t this_chunk_size;
-		if (i == new_num_chunks - 1)
-			this_chunk_size = new_last_chunk_size;
-		else
-			this_chunk_size = chunk_size;
-		if (old_table &&
-		    ((this_chunk_size == chunk_size && i < old_num_chunks - 1) ||
-		      (i == old_num_chunks - 1 && this_chunk_size == old_last_chunk_size)))
-		{
-			/* Can use SHA1 message digest from old integrity table
-			 * */
-			copy_hash(new_table->sha1sums[i], old_table->sha1sums[i]);
-		} else {
-			/* Calculate the SHA1 message digest of this chunk */
-			ret = calculate_chunk_sha1(in_fd, this_chunk_size,
-						   offset, new_table->sha1sums[i]);
-			if (ret)
-				goto out_free_new_table;
-		}
-		offset += this_chunk_size;
-
-		progress.integrity.completed_chunks++;
-		progress.integrity.completed_bytes += this_chunk_size;
-		ret = call_progress(progfunc, WIMLIB_PROGRESS_MSG_CALC_INTEGRITY,
-				    &progress, progctx);
-		if (ret)
-			goto out_free_new_table;
-	}
+	ret = hash_integrity_chunks(in_fd, WIM_HEADER_DISK_SIZE, new_num_chunks,
+				    chunk_size, new_last_chunk_size,
+				    calc_want_chunk, calc_chunk_done, &ctx);
+	if (ret)
+		goto out_free_new_table;
 	*integrity_table_ret = new_table;
 	return 0;
 
@@ -334,6 +616,35 @@ write_integrity_table(WIMStruct *wim,
 	return ret;
 }
 
+struct verify_integrity_ctx {
+	const struct integrity_table *table;
+	union wimlib_progress_info progress;
+	wimlib_progress_func_t progfunc;
+	void *progctx;
+	u64 start_time;
+};
+
+static bool
+verify_want_chunk(u32 i, size_t size, void *_ctx)
+{
+	return true;
+}
+
+static int
+verify_chunk_done(u32 i, const u8 *sha1_md, size_t size, void *_ctx)
+{
+	struct verify_integrity_ctx *ctx = _ctx;
+
+	if (!hashes_equal(sha1_md, ctx->table->sha1sums[i]))
+		return WIM_INTEGRITY_NOT_OK;
+
+	ctx->progress.integrity.completed_chunks++;
+	ctx->progress.integrity.completed_bytes += size;
+	update_integrity_throughput(&ctx->progress, ctx->start_time);
+	return call_progress(ctx->progfunc, WIMLIB_PROGRESS_MSG_VERIFY_INTEGRITY,
+			     &ctx->progress, ctx->progctx);
+}
+
 /*
  * verify_integrity():
  *
@@ -362,47 +673,31 @@ verify_integrity(struct filedes *in_fd, const tchar *filename,
 		 wimlib_progress_func_t progfunc, void *progctx)
 {
 	int ret;
-	u64 offset = WIM_HEADER_DISK_SIZE;
-	u8 sha1_md[SHA1_HASH_SIZE];
-	union wimlib_progress_info progress;
-
-	progress.integrity.total_bytes      = bytes_to_check;
-	progress.integrity.total_chunks     = table->num_entries;
-	progress.integrity.completed_chunks = 0;
-	progress.integrity.completed_bytes  = 0;
-	progress.integrity.chunk_size       = table->chunk_size;
-	progress.integrity.filename         = filename;
+	struct verify_integrity_ctx ctx = {
+		.table		= table,
+		.progfunc	= progfunc,
+		.progctx	= progctx,
+		.start_time	= now_as_wim_timestamp(),
+	};
+
+	ctx.progress.integrity.total_bytes      = bytes_to_check;
+	ctx.progress.integrity.total_chunks     = table->num_entries;
+	ctx.progress.integrity.completed_chunks = 0;
+	ctx.progress.integrity.completed_bytes  = 0;
+	ctx.progress.integrity.chunk_size       = table->chunk_size;
+	ctx.progress.integrity.filename         = filename;
+	ctx.progress.integrity.bytes_per_sec    = 0;
 
 	ret = call_progress(progfunc, WIMLIB_PROGRESS_MSG_VERIFY_INTEGRITY,
-			    &progress, progctx);
+			    &ctx.progress, progctx);
 	if (ret)
 		return ret;
 
-	for (u32 i = 0; i < table->num_entries; i++) {
-		size_t this_chunk_size;
-		if (i == table->num_entries - 1)
-			this_chunk_size = MODULO_NONZERO(bytes_to_check,
-							 table->chunk_size);
-		else
-			this_chunk_size = table->chunk_size;
-
-		ret = calculate_chunk_sha1(in_fd, this_chunk_size, offset, sha1_md);
-		if (ret)
-			return ret;
-
-		if (!hashes_equal(sha1_md, table->sha1sums[i]))
-			return WIM_INTEGRITY_NOT_OK;
-
-		offset += this_chunk_size;
-		progress.integrity.completed_chunks++;
-		progress.integrity.completed_bytes += this_chunk_size;
-
-		ret = call_progress(progfunc, WIMLIB_PROGRESS_MSG_VERIFY_INTEGRITY,
-				    &progress, progctx);
-		if (ret)
-			return ret;
-	}
-	return WIM_INTEGRITY_OK;
+	return hash_integrity_chunks(in_fd, WIM_HEADER_DISK_SIZE,
+				     table->num_entries, table->chunk_size,
+				     MODULO_NONZERO(bytes_to_check,
+						    table->chunk_size),
+				     verify_want_chunk, verify_chunk_done, &ctx);
 }
 
 
@@ -75,6 +75,7 @@ read_metadata_resource(struct wim_image_metadata *imd)
 	int ret;
 	u8 hash[SHA1_HASH_SIZE];
 	struct wim_security_data *sd;
+	struct dentry_arena *arena;
 	struct wim_dentry *root;
 
 	metadata_blob = imd->metadata_blob;
@@ -119,9 +120,16 @@ read_metadata_resource(struct wim_image_metadata *imd)
 	if (ret)
 		goto out_free_buf;
 
-	ret = read_dentry_tree(buf, metadata_blob->size, sd->total_length, &root);
-	if (ret)
+	arena = new_dentry_arena();
+	if (!arena) {
+		ret = WIMLIB_ERR_NOMEM;
 		goto out_free_security_data;
+	}
+
+	ret = read_dentry_tree(buf, metadata_blob->size, sd->total_length,
+			       &root, arena);
+	if (ret)
+		goto out_free_dentry_arena;
 
 	/* We have everything we need from the buffer now.  */
 	FREE(buf);
@@ -138,11 +146,14 @@ read_metadata_resource(struct wim_image_metadata *imd)
 	/* Success; fill in the image_metadata structure.  */
 	imd->root_dentry = root;
 	imd->security_data = sd;
+	imd->dentry_arena = arena;
 	INIT_LIST_HEAD(&imd->unhashed_blobs);
 	return 0;
 
 out_free_dentry_tree:
 	free_dentry_tree(root, NULL);
+out_free_dentry_arena:
+	free_dentry_arena(arena);
 out_free_security_data:
 	free_wim_security_data(sd);
 out_free_buf:
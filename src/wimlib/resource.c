@@ -36,9 +36,11 @@
 #include "wimlib/endianness.h"
 #include "wimlib/error.h"
 #include "wimlib/file_io.h"
+#include "wimlib/list.h"
 #include "wimlib/ntfs_3g.h"
 #include "wimlib/resource.h"
 #include "wimlib/sha1.h"
+#include "wimlib/threads.h"
 #include "wimlib/wim.h"
 #include "wimlib/win32.h"
 
@@ -111,6 +113,578 @@ decompress_chunk(const void *cbuf, u32 chunk_csize, u8 *ubuf, u32 chunk_usize,
 	return WIMLIB_ERR_DECOMPRESSION;
 }
 
+/*
+ * Parallel chunk decompression
+ *
+ * For large reads from a seekable, non-pipable compressed resource, the needed
+ * chunks are grouped into batches.  The compressed data of a batch is read with
+ * as few reads as possible, then its chunks are handed to a pool of worker
+ * threads (each with its own decompressor) while the next batch is being read.
+ * The calling thread helps decompress while it waits, and then feeds the
+ * uncompressed chunks to the callback strictly in order.  Two batches are kept
+ * in flight so that I/O and the consume_chunk callback overlap decompression.
+ */
+
+/* Minimum number of chunks a read must span before using multiple threads  */
+#define PARALLEL_DECOMPRESS_MIN_CHUNKS	8
+
+/* Upper bound on the memory used by the batch buffers  */
+#define PARALLEL_DECOMPRESS_MAX_MEMORY	((u64)512 << 20)
+
+struct decompress_batch;
+
+struct decompress_job {
+	struct list_head list;
+	struct decompress_batch *batch;
+	u64 chunk_idx;
+	const u8 *cbuf;
+	u8 *ubuf;
+	u32 chunk_csize;
+	u32 chunk_usize;
+};
+
+struct decompress_batch {
+	u8 *cdata;
+	u8 *udata;
+	struct decompress_job *jobs;
+	size_t num_jobs;
+	size_t num_pending;
+	int ret;
+};
+
+struct parallel_decompressor;
+
+struct decompressor_thread_data {
+	struct thread thread;
+	struct parallel_decompressor *ctx;
+	struct wimlib_decompressor *decompressor;
+};
+
+struct parallel_decompressor {
+	int ctype;
+	u32 chunk_size;
+	struct mutex lock;
+	struct condvar job_avail_cond;
+	struct condvar job_done_cond;
+	struct list_head pending_jobs;
+	bool terminating;
+	bool recover_data;
+	struct decompressor_thread_data *thread_data;
+	unsigned num_thread_data;
+	unsigned num_started_threads;
+};
+
+/* Record completion of @job.  Must be called with ctx->lock held.  */
+static void
+complete_decompress_job(struct parallel_decompressor *ctx,
+			struct decompress_job *job, int ret)
+{
+	struct decompress_batch *batch = job->batch;
+
+	if (unlikely(ret) && !batch->ret)
+		batch->ret = ret;
+	if (--batch->num_pending == 0)
+		condvar_broadcast(&ctx->job_done_cond);
+}
+
+/* Decompress @job.  Must be called with ctx->lock held; the lock is dropped
+ * while decompressing.  */
+static void
+run_decompress_job(struct parallel_decompressor *ctx,
+		   struct decompress_job *job,
+		   struct wimlib_decompressor *decompressor)
+{
+	int ret;
+
+	list_del(&job->list);
+	mutex_unlock(&ctx->lock);
+	ret = decompress_chunk(job->cbuf, job->chunk_csize,
+			       job->ubuf, job->chunk_usize,
+			       decompressor, ctx->recover_data);
+	mutex_lock(&ctx->lock);
+	complete_decompress_job(ctx, job, ret);
+}
+
+static void *
+decompressor_thread_proc(void *arg)
+{
+	struct decompressor_thread_data *dat = arg;
+	struct parallel_decompressor *ctx = dat->ctx;
+
+	mutex_lock(&ctx->lock);
+	for (;;) {
+		while (list_empty(&ctx->pending_jobs) && !ctx->terminating)
+			condvar_wait(&ctx->job_avail_cond, &ctx->lock);
+		if (ctx->terminating)
+			break;
+		run_decompress_job(ctx,
+				   list_entry(ctx->pending_jobs.next,
+					      struct decompress_job, list),
+				   dat->decompressor);
+	}
+	mutex_unlock(&ctx->lock);
+	return NULL;
+}
+
+/* Queue the chunks of @batch that need decompressing.  */
+static void
+submit_decompress_batch(struct parallel_decompressor *ctx,
+			struct decompress_batch *batch)
+{
+	mutex_lock(&ctx->lock);
+	batch->num_pending = 0;
+	batch->ret = 0;
+	for (size_t i = 0; i < batch->num_jobs; i++) {
+		struct decompress_job *job = &batch->jobs[i];
+
+		if (job->chunk_csize == job->chunk_usize)
+			continue; /* Stored uncompressed  */
+		list_add_tail(&job->list, &ctx->pending_jobs);
+		batch->num_pending++;
+	}
+	if (batch->num_pending)
+		condvar_broadcast(&ctx->job_avail_cond);
+	mutex_unlock(&ctx->lock);
+}
+
+/* Wait until all chunks of @batch have been decompressed, helping out with any
+ * queued work in the meantime.  */
+static int
+wait_for_decompress_batch(struct parallel_decompressor *ctx,
+			  struct decompress_batch *batch,
+			  struct wimlib_decompressor *decompressor)
+{
+	int ret;
+
+	mutex_lock(&ctx->lock);
+	while (batch->num_pending) {
+		if (!list_empty(&ctx->pending_jobs))
+			run_decompress_job(ctx,
+					   list_entry(ctx->pending_jobs.next,
+						      struct decompress_job, list),
+					   decompressor);
+		else
+			condvar_wait(&ctx->job_done_cond, &ctx->lock);
+	}
+	ret = batch->ret;
+	mutex_unlock(&ctx->lock);
+	return ret;
+}
+
+static void
+parallel_decompressor_destroy(struct parallel_decompressor *ctx)
+{
+	if (!ctx)
+		return;
+
+	mutex_lock(&ctx->lock);
+	ctx->terminating = true;
+	condvar_broadcast(&ctx->job_avail_cond);
+	mutex_unlock(&ctx->lock);
+
+	for (unsigned i = 0; i < ctx->num_started_threads; i++)
+		thread_join(&ctx->thread_data[i].thread);
+
+	if (ctx->thread_data) {
+		for (unsigned i = 0; i < ctx->num_thread_data; i++)
+			wimlib_free_decompressor(ctx->thread_data[i].decompressor);
+		FREE(ctx->thread_data);
+	}
+	condvar_destroy(&ctx->job_done_cond);
+	condvar_destroy(&ctx->job_avail_cond);
+	mutex_destroy(&ctx->lock);
+	FREE(ctx);
+}
+
+/* Free the pool of decompressor threads cached for a WIM, if any.  */
+void
+free_parallel_decompressor(struct parallel_decompressor *ctx)
+{
+	parallel_decompressor_destroy(ctx);
+}
+
+/* Allocate a pool of @num_threads worker threads.  Returns 0 if at least one
+ * thread was started.  */
+static int
+new_parallel_decompressor(int ctype, u32 chunk_size, unsigned num_threads,
+			  struct parallel_decompressor **ctx_ret)
+{
+	struct parallel_decompressor *ctx;
+	int ret;
+
+	ctx = CALLOC(1, sizeof(*ctx));
+	if (!ctx)
+		return WIMLIB_ERR_NOMEM;
+	ctx->ctype = ctype;
+	ctx->chunk_size = chunk_size;
+	if (!mutex_init(&ctx->lock)) {
+		FREE(ctx);
+		return WIMLIB_ERR_NOMEM;
+	}
+	if (!condvar_init(&ctx->job_avail_cond)) {
+		mutex_destroy(&ctx->lock);
+		FREE(ctx);
+		return WIMLIB_ERR_NOMEM;
+	}
+	if (!condvar_init(&ctx->job_done_cond)) {
+		condvar_destroy(&ctx->job_avail_cond);
+		mutex_destroy(&ctx->lock);
+		FREE(ctx);
+		return WIMLIB_ERR_NOMEM;
+	}
+	INIT_LIST_HEAD(&ctx->pending_jobs);
+
+	ret = WIMLIB_ERR_NOMEM;
+	ctx->thread_data = CALLOC(num_threads, sizeof(ctx->thread_data[0]));
+	if (!ctx->thread_data)
+		goto err;
+	ctx->num_thread_data = num_threads;
+
+	for (unsigned i = 0; i < num_threads; i++) {
+		ctx->thread_data[i].ctx = ctx;
+		ret = wimlib_create_decompressor(ctype, chunk_size,
+						 &ctx->thread_data[i].decompressor);
+		if (ret)
+			goto err;
+	}
+
+	for (ctx->num_started_threads = 0;
+	     ctx->num_started_threads < num_threads;
+	     ctx->num_started_threads++)
+	{
+		if (!thread_create(&ctx->thread_data[ctx->num_started_threads].thread,
+				   decompressor_thread_proc,
+				   &ctx->thread_data[ctx->num_started_threads]))
+		{
+			ret = WIMLIB_ERR_NOMEM;
+			if (ctx->num_started_threads >= 1)
+				break;
+			goto err;
+		}
+	}
+	*ctx_ret = ctx;
+	return 0;
+
+err:
+	parallel_decompressor_destroy(ctx);
+	return ret;
+}
+
+/*
+ * Get the pool of decompressor threads for @wim, starting one if needed.  Like
+ * the cached decompressor, the pool is kept for the lifetime of the WIMStruct
+ * and only replaced when a resource needs a different compression type or
+ * chunk size (as may happen with solid resources).
+ */
+static int
+get_parallel_decompressor(WIMStruct *wim, int ctype, u32 chunk_size,
+			  unsigned num_threads,
+			  struct parallel_decompressor **ctx_ret)
+{
+	struct parallel_decompressor *ctx = wim->parallel_decompressor;
+	int ret;
+
+	if (likely(ctx && ctx->ctype == ctype && ctx->chunk_size == chunk_size)) {
+		*ctx_ret = ctx;
+		return 0;
+	}
+	wim->parallel_decompressor = NULL;
+	parallel_decompressor_destroy(ctx);
+	ret = new_parallel_decompressor(ctype, chunk_size, num_threads, &ctx);
+	if (ret)
+		return ret;
+	wim->parallel_decompressor = ctx;
+	*ctx_ret = ctx;
+	return 0;
+}
+
+/*
+ * Multi-threaded equivalent of the chunk loop of read_compressed_wim_resource(),
+ * for seekable reads of non-pipable resources.  @chunk_offsets is indexed from
+ * @read_start_chunk, and chunk i starts at file offset
+ * @chunk_data_offset + chunk_offsets[i - read_start_chunk].
+ */
+static int
+read_compressed_chunks_parallel(const struct wim_resource_descriptor *rdesc,
+				const u64 *chunk_offsets,
+				u64 chunk_data_offset,
+				u64 chunk_table_full_size,
+				u64 read_start_chunk,
+				u64 last_needed_chunk,
+				u64 num_chunks,
+				const struct data_range *ranges,
+				size_t num_ranges,
+				const struct consume_chunk_callback *cb,
+				struct wimlib_decompressor *decompressor,
+				unsigned num_threads,
+				size_t chunks_per_batch,
+				bool recover_data)
+{
+	struct filedes * const in_fd = &rdesc->wim->in_fd;
+	const u32 chunk_size = rdesc->chunk_size;
+	const u32 chunk_order = bsr32(chunk_size);
+	struct parallel_decompressor *ctx;
+	struct decompress_batch batches[2] = {};
+	unsigned cur = 0;
+	int ret;
+
+	ret = get_parallel_decompressor(rdesc->wim, rdesc->compression_type,
+					chunk_size, num_threads, &ctx);
+	if (ret)
+		return ret;
+	/* No jobs are queued between reads, so this can safely be changed  */
+	ctx->recover_data = recover_data;
+
+	ret = WIMLIB_ERR_NOMEM;
+	for (int b = 0; b < 2; b++) {
+		batches[b].cdata = MALLOC(chunks_per_batch * chunk_size);
+		batches[b].udata = MALLOC(chunks_per_batch * chunk_size);
+		batches[b].jobs = CALLOC(chunks_per_batch, sizeof(batches[b].jobs[0]));
+		if (!batches[b].cdata || !batches[b].udata || !batches[b].jobs)
+			goto out;
+	}
+
+	/* Cursor used to decide which chunks are needed when filling batches */
+	const struct data_range *scan_range = ranges;
+	/* Cursor used when feeding data to the callback */
+	const struct data_range *cur_range = ranges;
+	const struct data_range * const end_range = &ranges[num_ranges];
+	u64 cur_range_pos = cur_range->offset;
+	u64 cur_range_end = cur_range->offset + cur_range->size;
+	u64 next_chunk = read_start_chunk;
+
+	for (;;) {
+		struct decompress_batch *batch = &batches[cur ^ 1];
+		size_t cdata_used = 0;
+
+		/* Fill and submit the next batch with needed chunks only.  */
+		batch->num_jobs = 0;
+		while (next_chunk <= last_needed_chunk &&
+		       batch->num_jobs < chunks_per_batch)
+		{
+			const u64 i = next_chunk++;
+			const u64 chunk_start_offset = i << chunk_order;
+			u32 chunk_usize, chunk_csize;
+
+			if ((i == num_chunks - 1) && (rdesc->uncompressed_size & (chunk_size - 1)))
+				chunk_usize = (rdesc->uncompressed_size & (chunk_size - 1));
+			else
+				chunk_usize = chunk_size;
+
+			while (scan_range != end_range &&
+			       scan_range->offset + scan_range->size <= chunk_start_offset)
+				scan_range++;
+			if (scan_range == end_range) {
+				next_chunk = last_needed_chunk + 1;
+				break;
+			}
+			if (scan_range->offset >= chunk_start_offset + chunk_usize)
+				continue; /* Not needed  */
+
+			if (i == num_chunks - 1)
+				chunk_csize = rdesc->size_in_wim -
+					      chunk_table_full_size -
+					      chunk_offsets[i - read_start_chunk];
+			else
+				chunk_csize = chunk_offsets[i + 1 - read_start_chunk] -
+					      chunk_offsets[i - read_start_chunk];
+			if (unlikely(chunk_csize == 0 || chunk_csize > chunk_usize)) {
+				ERROR("Invalid chunk size in compressed resource!");
+				errno = EINVAL;
+				ret = WIMLIB_ERR_DECOMPRESSION;
+				goto out;
+			}
+
+			struct decompress_job *job = &batch->jobs[batch->num_jobs++];
+			job->batch = batch;
+			job->chunk_idx = i;
+			job->chunk_csize = chunk_csize;
+			job->chunk_usize = chunk_usize;
+			job->cbuf = &batch->cdata[cdata_used];
+			job->ubuf = (chunk_csize == chunk_usize) ? (u8 *)job->cbuf :
+				    &batch->udata[(batch->num_jobs - 1) << chunk_order];
+			cdata_used += chunk_csize;
+		}
+
+		/* Read the compressed data, coalescing adjacent chunks.  */
+		for (size_t j = 0; j < batch->num_jobs; ) {
+			const struct decompress_job *first = &batch->jobs[j];
+			size_t run_size = first->chunk_csize;
+
+			while (++j < batch->num_jobs &&
+			       batch->jobs[j].chunk_idx == batch->jobs[j - 1].chunk_idx + 1)
+				run_size += batch->jobs[j].chunk_csize;
+
+			ret = full_pread(in_fd, (void *)first->cbuf, run_size,
+					 chunk_data_offset +
+					 chunk_offsets[first->chunk_idx - read_start_chunk]);
+			if (unlikely(ret)) {
+				ERROR_WITH_ERRNO("Error reading data from WIM file");
+				goto out;
+			}
+		}
+		submit_decompress_batch(ctx, batch);
+
+		/* Feed the previous batch, if any, to the callback.  */
+		batch = &batches[cur];
+		ret = wait_for_decompress_batch(ctx, batch, decompressor);
+		if (unlikely(ret))
+			goto out;
+		for (size_t j = 0; j < batch->num_jobs; j++) {
+			const struct decompress_job *job = &batch->jobs[j];
+			const u64 chunk_start_offset = job->chunk_idx << chunk_order;
+			const u64 chunk_end_offset = chunk_start_offset + job->chunk_usize;
+
+			do {
+				size_t start, end, size;
+
+				start = cur_range_pos - chunk_start_offset;
+				end = min(cur_range_end, chunk_end_offset) - chunk_start_offset;
+				size = end - start;
+
+				ret = consume_chunk(cb, &job->ubuf[start], size);
+				if (unlikely(ret))
+					goto out;
+
+				cur_range_pos += size;
+				if (cur_range_pos == cur_range_end) {
+					if (++cur_range == end_range) {
+						cur_range_pos = ~0ULL;
+					} else {
+						cur_range_pos = cur_range->offset;
+						cur_range_end = cur_range->offset + cur_range->size;
+					}
+				}
+			} while (cur_range_pos < chunk_end_offset);
+		}
+
+		cur ^= 1;
+		if (batches[cur].num_jobs == 0)
+			break;
+	}
+	ret = 0;
+
+out:
+	/* The pool outlives this read, so make sure that none of its threads
+	 * still references our batches before we free them.  */
+	for (int b = 0; b < 2; b++)
+		wait_for_decompress_batch(ctx, &batches[b], decompressor);
+	for (int b = 0; b < 2; b++) {
+		FREE(batches[b].cdata);
+		FREE(batches[b].udata);
+		FREE(batches[b].jobs);
+	}
+	return ret;
+}
+
+/*
+ * Cache of decompressed chunks of solid resources
+ *
+ * Extracting a single small file from a solid (LZMS) resource, as is done for
+ * ESD files, requires decompressing the whole solid chunk that contains it,
+ * which is typically tens of MB.  Since the same chunks tend to be requested
+ * again, each WIMStruct keeps its most recently decompressed solid chunks
+ * around, up to a memory budget, until it is freed.  Entries are keyed by the
+ * location of the resource in the WIM file.
+ */
+
+/* Upper bound on the memory used by the solid chunk cache of a WIM  */
+#define SOLID_CHUNK_CACHE_MAX_MEMORY	((u64)128 << 20)
+
+struct solid_chunk_cache_entry {
+	struct list_head lru_list;
+	u64 offset_in_wim;
+	u64 size_in_wim;
+	u64 chunk_idx;
+	u32 size;
+	u8 data[];
+};
+
+static u64
+solid_chunk_cache_budget(void)
+{
+	return min(get_available_memory() / 16, SOLID_CHUNK_CACHE_MAX_MEMORY);
+}
+
+static bool
+solid_chunk_cache_entry_matches(const struct solid_chunk_cache_entry *entry,
+				const struct wim_resource_descriptor *rdesc,
+				u64 chunk_idx)
+{
+	return entry->chunk_idx == chunk_idx &&
+	       entry->offset_in_wim == rdesc->offset_in_wim &&
+	       entry->size_in_wim == rdesc->size_in_wim;
+}
+
+/* If chunk @chunk_idx of the solid resource @rdesc is cached, copy its
+ * @size bytes of uncompressed data to @buf and return true.  */
+static bool
+solid_chunk_cache_lookup(const struct wim_resource_descriptor *rdesc,
+			 u64 chunk_idx, u8 *buf, u32 size)
+{
+	struct list_head *cache = &rdesc->wim->solid_chunk_cache;
+	struct solid_chunk_cache_entry *entry;
+
+	list_for_each_entry(entry, cache, lru_list) {
+		if (solid_chunk_cache_entry_matches(entry, rdesc, chunk_idx) &&
+		    entry->size == size) {
+			memcpy(buf, entry->data, size);
+			list_move(&entry->lru_list, cache);
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Release all the chunks held by the solid chunk cache of @wim.  */
+void
+solid_chunk_cache_free(WIMStruct *wim)
+{
+	struct solid_chunk_cache_entry *entry, *tmp;
+
+	list_for_each_entry_safe(entry, tmp, &wim->solid_chunk_cache, lru_list) {
+		list_del(&entry->lru_list);
+		FREE(entry);
+	}
+	wim->solid_chunk_cache_size = 0;
+}
+
+/* Add a copy of the uncompressed data of chunk @chunk_idx of the solid resource
+ * @rdesc to the cache, evicting the least recently used chunks as needed.  */
+static void
+solid_chunk_cache_insert(const struct wim_resource_descriptor *rdesc,
+			 u64 chunk_idx, const u8 *data, u32 size)
+{
+	WIMStruct *wim = rdesc->wim;
+	struct solid_chunk_cache_entry *entry;
+	u64 budget = solid_chunk_cache_budget();
+
+	/* Don't let a single chunk take over the whole cache.  */
+	if ((u64)size > budget / 2)
+		return;
+
+	entry = MALLOC(sizeof(*entry) + size);
+	if (!entry)
+		return;
+	entry->offset_in_wim = rdesc->offset_in_wim;
+	entry->size_in_wim = rdesc->size_in_wim;
+	entry->chunk_idx = chunk_idx;
+	entry->size = size;
+	memcpy(entry->data, data, size);
+
+	while (wim->solid_chunk_cache_size + size > budget &&
+	       !list_empty(&wim->solid_chunk_cache)) {
+		struct solid_chunk_cache_entry *victim =
+			list_last_entry(&wim->solid_chunk_cache,
+					struct solid_chunk_cache_entry, lru_list);
+		list_del(&victim->lru_list);
+		wim->solid_chunk_cache_size -= victim->size;
+		FREE(victim);
+	}
+	list_add(&entry->lru_list, &wim->solid_chunk_cache);
+	wim->solid_chunk_cache_size += size;
+}
+
 /*
  * Read data from a compressed WIM resource.
  *
@@ -180,6 +754,14 @@ read_compressed_wim_resource(const struct wim_resource_descriptor * const rdesc,
 	const bool alt_chunk_table = (rdesc->flags & WIM_RESHDR_FLAG_SOLID)
 					&& !is_pipe_read;
 
+	/* Decompressed chunks of solid resources are worth caching, as their
+	 * chunks are large and usually hold many small files.  Only single
+	 * range reads, as done when extracting a few files, can benefit from
+	 * it: reads with several ranges come from read_blob_list(), which
+	 * gets all the blobs it needs from a chunk in a single pass.  */
+	const bool use_chunk_cache = alt_chunk_table && !recover_data &&
+				     num_ranges == 1;
+
 	/* Get the maximum size of uncompressed chunks in this resource, which
 	 * we require be a power of 2.  */
 	u64 cur_read_offset = rdesc->offset_in_wim;
@@ -372,6 +954,36 @@ read_compressed_wim_resource(const struct wim_resource_descriptor * const rdesc,
 			cur_read_offset += chunk_table_size;
 	}
 
+	/* If the read spans enough chunks, decompress them on multiple threads.
+	 * Pipable resources interleave chunk headers with the data and are
+	 * always handled serially.  */
+	if (!rdesc->is_pipable &&
+	    last_needed_chunk - read_start_chunk + 1 >= PARALLEL_DECOMPRESS_MIN_CHUNKS)
+	{
+		unsigned num_threads = get_available_cpus();
+		u64 max_memory = min(get_available_memory() / 8,
+				     PARALLEL_DECOMPRESS_MAX_MEMORY);
+		/* Two batches, each with a compressed and uncompressed buffer */
+		u64 chunks_per_batch = max_memory / (4 * (u64)chunk_size);
+
+		chunks_per_batch = min(chunks_per_batch, (u64)num_threads * 4);
+		if (num_threads > 1 && chunks_per_batch >= 1) {
+			num_threads = min(num_threads, 2 * chunks_per_batch);
+			ret = read_compressed_chunks_parallel(rdesc, chunk_offsets,
+							      cur_read_offset - chunk_offsets[0],
+							      chunk_table_full_size,
+							      read_start_chunk,
+							      last_needed_chunk,
+							      num_chunks,
+							      ranges, num_ranges,
+							      cb, decompressor,
+							      num_threads - 1,
+							      chunks_per_batch,
+							      recover_data);
+			goto out_cleanup;
+		}
+	}
+
 	/* Allocate buffer for holding the uncompressed data of each chunk.  */
 	if (chunk_size <= STACK_MAX) {
 		ubuf = alloca(chunk_size);
@@ -470,12 +1082,18 @@ read_compressed_wim_resource(const struct wim_resource_descriptor * const rdesc,
 			else
 				read_buf = cbuf;
 
-			ret = full_pread(in_fd,
-					 read_buf,
-					 chunk_csize,
-					 cur_read_offset);
-			if (unlikely(ret))
-				goto read_error;
+			if (read_buf == cbuf && use_chunk_cache &&
+			    solid_chunk_cache_lookup(rdesc, i, ubuf, chunk_usize))
+				read_buf = NULL;
+
+			if (read_buf) {
+				ret = full_pread(in_fd,
+						 read_buf,
+						 chunk_csize,
+						 cur_read_offset);
+				if (unlikely(ret))
+					goto read_error;
+			}
 
 			if (read_buf == cbuf) {
 				ret = decompress_chunk(cbuf, chunk_csize,
@@ -484,6 +1102,12 @@ read_compressed_wim_resource(const struct wim_resource_descriptor * const rdesc,
 						       recover_data);
 				if (unlikely(ret))
 					goto out_cleanup;
+				/* Only the first and last chunks of a range
+				 * may also hold data from other blobs.  */
+				if (use_chunk_cache &&
+				    (i == first_needed_chunk || i == last_needed_chunk))
+					solid_chunk_cache_insert(rdesc, i, ubuf,
+								 chunk_usize);
 			}
 			cur_read_offset += chunk_csize;
 
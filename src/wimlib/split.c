@@ -55,6 +55,8 @@ struct swm_info {
 	unsigned num_alloc_parts;
 	u64 total_bytes;
 	u64 max_part_size;
+	u32 out_chunk_size;
+	bool recompress;
 };
 
 static int
@@ -121,7 +123,7 @@ write_split_wim(WIMStruct *orig_wim, const tchar *swm_name,
 				     progress.split.part_name,
 				     WIMLIB_ALL_IMAGES,
 				     part_write_flags,
-				     1,
+				     orig_wim->out_num_threads,
 				     part_number,
 				     swm_info->num_parts,
 				     &swm_info->parts[part_number - 1].blob_list,
@@ -173,7 +175,14 @@ add_blob_to_swm(struct blob_descriptor *blob, void *_swm_info)
 	u64 blob_stored_size;
 	int ret;
 
-	if (blob->blob_location == BLOB_IN_WIM)
+	/* A recompressed resource has no known size until it is written, so
+	 * plan with its worst case instead: every chunk stored uncompressed,
+	 * plus a chunk table with 64-bit entries.  */
+	if (swm_info->recompress)
+		blob_stored_size = blob->size +
+			DIV_ROUND_UP(blob->size, swm_info->out_chunk_size) *
+			sizeof(u64);
+	else if (blob->blob_location == BLOB_IN_WIM)
 		blob_stored_size = blob->rdesc->size_in_wim;
 	else
 		blob_stored_size = blob->size;
@@ -205,6 +214,8 @@ wimlib_split(WIMStruct *wim, const tchar *swm_name,
 	     u64 part_size, int write_flags)
 {
 	struct swm_info swm_info;
+	int out_ctype;
+	u32 out_chunk_size;
 	unsigned i;
 	int ret;
 
@@ -230,8 +241,21 @@ wimlib_split(WIMStruct *wim, const tchar *swm_name,
 		}
 	}
 
+	/* Unless recompression was requested, the parts must keep the
+	 * compression type and chunk size of the original WIM, since these are
+	 * global to each part's header and any other setting would prevent the
+	 * original resources from being reused.  */
+	out_ctype = wim->out_compression_type;
+	out_chunk_size = wim->out_chunk_size;
+	if (!(write_flags & WIMLIB_WRITE_FLAG_RECOMPRESS)) {
+		wim->out_compression_type = wim->compression_type;
+		wim->out_chunk_size = wim->chunk_size;
+	}
+
 	memset(&swm_info, 0, sizeof(swm_info));
 	swm_info.max_part_size = part_size;
+	swm_info.out_chunk_size = wim->out_chunk_size;
+	swm_info.recompress = !!(write_flags & WIMLIB_WRITE_FLAG_RECOMPRESS);
 
 	ret = start_new_swm_part(&swm_info);
 	if (ret)
@@ -250,8 +274,14 @@ wimlib_split(WIMStruct *wim, const tchar *swm_name,
 	if (ret)
 		goto out_free_swm_info;
 
+	/* Have the parts reuse the original resources verbatim, including
+	 * uncompressed ones, rather than send any of them to the compressor.  */
+	wim->being_split = 1;
 	ret = write_split_wim(wim, swm_name, &swm_info, write_flags);
+	wim->being_split = 0;
 out_free_swm_info:
 	FREE(swm_info.parts);
+	wim->out_compression_type = out_ctype;
+	wim->out_chunk_size = out_chunk_size;
 	return ret;
 }
@@ -25,6 +25,10 @@
 #  include "config.h"
 #endif
 
+#ifndef _WIN32
+#  include <sys/time.h>
+#endif
+
 #include "wimlib.h" /* for struct wimlib_timespec */
 #include "wimlib/timestamp.h"
 
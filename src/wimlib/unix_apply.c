@@ -0,0 +1,829 @@
+/*
+ * unix_apply.c - Code to apply files from a WIM image on UNIX.
+ */
+
+/*
+ * Copyright (C) 2012-2018 Eric Biggers
+ *
+ * This file is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this file; if not, see https://www.gnu.org/licenses/.
+ */
+
+#ifndef _WIN32
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "wimlib/apply.h"
+#include "wimlib/assert.h"
+#include "wimlib/blob_table.h"
+#include "wimlib/dentry.h"
+#include "wimlib/error.h"
+#include "wimlib/file_io.h"
+#include "wimlib/reparse.h"
+#include "wimlib/threads.h"
+#include "wimlib/timestamp.h"
+#include "wimlib/unix_data.h"
+
+/*
+ * File data is written by a pool of worker threads so that writing to the
+ * target overlaps reading and decompressing the WIM.  Each chunk handed to us
+ * by the common extraction code is copied into a reference-counted buffer and
+ * queued once for every file it must be written to.  A file is closed by
+ * whichever thread drops its last reference, so files of different blobs can
+ * be in flight at the same time.  The amount of queued data and the number of
+ * open files are both bounded.
+ */
+
+/* Maximum number of writer threads  */
+#define MAX_WRITER_THREADS	16
+
+/* Maximum number of bytes of file data queued for writing  */
+#define MAX_QUEUED_BYTES	((size_t)64 << 20)
+
+/* Number of path buffers, so that a few paths can be in use at once  */
+#define NUM_PATHBUFS		2
+
+struct unix_out_file {
+	struct filedes fd;
+	/* Writes pending, plus one while the blob is still being read  */
+	unsigned refcnt;
+	/* Path, only kept for error messages  */
+	char *path;
+};
+
+struct unix_write_buf {
+	unsigned refcnt;
+	size_t size;
+	u8 data[];
+};
+
+struct unix_write_req {
+	struct list_head list;
+	struct unix_out_file *file;
+	struct unix_write_buf *buf;
+	const u8 *data;
+	size_t size;
+	u64 offset;
+};
+
+struct unix_apply_ctx {
+	/* Extract flags, the pointer to the WIMStruct, etc.  */
+	struct apply_ctx common;
+
+	/* Buffers for building extraction paths (allocated).  */
+	char *pathbufs[NUM_PATHBUFS];
+	unsigned which_pathbuf;
+
+	/* Files opened for the blob currently being extracted  */
+	struct unix_out_file *open_files[MAX_OPEN_FILES];
+	bool is_sparse_file[MAX_OPEN_FILES];
+	unsigned num_open_files;
+
+	/* Buffer for reparse data of symlinks being extracted  */
+	u8 reparse_data[REPARSE_DATA_MAX_SIZE];
+	u8 *reparse_ptr;
+
+	/* Writer thread pool  */
+	struct mutex lock;
+	struct condvar req_avail_cond;
+	struct condvar space_avail_cond;
+	struct list_head pending_reqs;
+	size_t queued_bytes;
+	unsigned files_in_flight;
+	bool terminating;
+	int write_error;
+	struct thread *threads;
+	unsigned num_threads;
+	bool pool_initialized;
+};
+
+static int
+unix_get_supported_features(const char *target,
+			    struct wim_features *supported_features)
+{
+	supported_features->sparse_files = 1;
+	supported_features->hard_links = 1;
+	supported_features->symlink_reparse_points = 1;
+	supported_features->unix_data = 1;
+	supported_features->timestamps = 1;
+	supported_features->case_sensitive_filenames = 1;
+	return 0;
+}
+
+static size_t
+unix_extraction_path_length(const struct wim_dentry *dentry,
+			    const struct unix_apply_ctx *ctx)
+{
+	size_t len = ctx->common.target_nchars;
+	const struct wim_dentry *d;
+
+	for (d = dentry; !dentry_is_root(d) && will_extract_dentry(d);
+	     d = d->d_parent)
+		len += 1 + d->d_extraction_name_nchars;
+	return len;
+}
+
+/* Build the path at which @dentry will be extracted.  The returned string
+ * remains valid until NUM_PATHBUFS more paths have been built.  */
+static const char *
+unix_build_extraction_path(const struct wim_dentry *dentry,
+			   struct unix_apply_ctx *ctx)
+{
+	char *pathbuf = ctx->pathbufs[ctx->which_pathbuf];
+	char *p = &pathbuf[unix_extraction_path_length(dentry, ctx)];
+	const struct wim_dentry *d;
+
+	ctx->which_pathbuf = (ctx->which_pathbuf + 1) % NUM_PATHBUFS;
+
+	*p = '\0';
+	for (d = dentry; !dentry_is_root(d) && will_extract_dentry(d);
+	     d = d->d_parent)
+	{
+		p -= d->d_extraction_name_nchars;
+		memcpy(p, d->d_extraction_name, d->d_extraction_name_nchars);
+		*--p = '/';
+	}
+	memcpy(pathbuf, ctx->common.target, ctx->common.target_nchars);
+	return pathbuf;
+}
+
+static int
+unix_alloc_pathbufs(const struct list_head *dentry_list,
+		    struct unix_apply_ctx *ctx, u64 *count_ret)
+{
+	const struct wim_dentry *dentry;
+	size_t max_len = ctx->common.target_nchars;
+	u64 count = 0;
+
+	list_for_each_entry(dentry, dentry_list, d_extraction_list_node) {
+		max_len = max(max_len, unix_extraction_path_length(dentry, ctx));
+		count++;
+	}
+
+	for (unsigned i = 0; i < NUM_PATHBUFS; i++) {
+		ctx->pathbufs[i] = MALLOC(max_len + 1);
+		if (!ctx->pathbufs[i])
+			return WIMLIB_ERR_NOMEM;
+	}
+	*count_ret = count;
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*
+ *                             Writer thread pool                             *
+ *----------------------------------------------------------------------------*/
+
+/* Drop a reference to @file, closing it when the last one goes away.  Must be
+ * called with ctx->lock held.  */
+static void
+unix_put_out_file(struct unix_out_file *file, struct unix_apply_ctx *ctx)
+{
+	if (--file->refcnt)
+		return;
+	if (filedes_close(&file->fd) && !ctx->write_error) {
+		ERROR_WITH_ERRNO("Error closing \"%s\"", file->path);
+		ctx->write_error = WIMLIB_ERR_WRITE;
+	}
+	FREE(file->path);
+	FREE(file);
+	ctx->files_in_flight--;
+	condvar_broadcast(&ctx->space_avail_cond);
+}
+
+/* Drop a reference to @buf.  Must be called with ctx->lock held.  */
+static void
+unix_put_write_buf(struct unix_write_buf *buf, struct unix_apply_ctx *ctx)
+{
+	if (--buf->refcnt)
+		return;
+	ctx->queued_bytes -= buf->size;
+	FREE(buf);
+	condvar_broadcast(&ctx->space_avail_cond);
+}
+
+static void *
+unix_writer_thread_proc(void *arg)
+{
+	struct unix_apply_ctx *ctx = arg;
+	struct unix_write_req *req;
+	int ret;
+
+	mutex_lock(&ctx->lock);
+	for (;;) {
+		while (list_empty(&ctx->pending_reqs) && !ctx->terminating)
+			condvar_wait(&ctx->req_avail_cond, &ctx->lock);
+		if (list_empty(&ctx->pending_reqs))
+			break;
+		req = list_entry(ctx->pending_reqs.next,
+				 struct unix_write_req, list);
+		list_del(&req->list);
+		mutex_unlock(&ctx->lock);
+
+		ret = full_pwrite(&req->file->fd, req->data, req->size,
+				  req->offset);
+
+		mutex_lock(&ctx->lock);
+		if (unlikely(ret) && !ctx->write_error) {
+			ERROR_WITH_ERRNO("Error writing data to \"%s\"",
+					 req->file->path);
+			ctx->write_error = ret;
+		}
+		unix_put_write_buf(req->buf, ctx);
+		unix_put_out_file(req->file, ctx);
+		FREE(req);
+	}
+	mutex_unlock(&ctx->lock);
+	return NULL;
+}
+
+static int
+unix_start_writer_threads(struct unix_apply_ctx *ctx)
+{
+	unsigned num_threads = min(get_available_cpus(), MAX_WRITER_THREADS);
+
+	if (!mutex_init(&ctx->lock))
+		return WIMLIB_ERR_NOMEM;
+	if (!condvar_init(&ctx->req_avail_cond)) {
+		mutex_destroy(&ctx->lock);
+		return WIMLIB_ERR_NOMEM;
+	}
+	if (!condvar_init(&ctx->space_avail_cond)) {
+		condvar_destroy(&ctx->req_avail_cond);
+		mutex_destroy(&ctx->lock);
+		return WIMLIB_ERR_NOMEM;
+	}
+	INIT_LIST_HEAD(&ctx->pending_reqs);
+	ctx->pool_initialized = true;
+
+	ctx->threads = CALLOC(max(num_threads, 1), sizeof(ctx->threads[0]));
+	if (!ctx->threads)
+		return WIMLIB_ERR_NOMEM;
+
+	for (ctx->num_threads = 0; ctx->num_threads < max(num_threads, 1);
+	     ctx->num_threads++)
+	{
+		if (!thread_create(&ctx->threads[ctx->num_threads],
+				   unix_writer_thread_proc, ctx))
+		{
+			if (ctx->num_threads >= 1)
+				break;
+			return WIMLIB_ERR_NOMEM;
+		}
+	}
+	return 0;
+}
+
+/* Wait for all queued writes to complete and all files to be closed, then
+ * stop the writer threads.  Returns the first write error, if any.  */
+static int
+unix_stop_writer_threads(struct unix_apply_ctx *ctx)
+{
+	int ret;
+
+	if (!ctx->pool_initialized)
+		return 0;
+
+	mutex_lock(&ctx->lock);
+	ctx->terminating = true;
+	condvar_broadcast(&ctx->req_avail_cond);
+	mutex_unlock(&ctx->lock);
+
+	for (unsigned i = 0; i < ctx->num_threads; i++)
+		thread_join(&ctx->threads[i]);
+	FREE(ctx->threads);
+	ctx->threads = NULL;
+	ctx->num_threads = 0;
+
+	ret = ctx->write_error;
+	condvar_destroy(&ctx->space_avail_cond);
+	condvar_destroy(&ctx->req_avail_cond);
+	mutex_destroy(&ctx->lock);
+	ctx->pool_initialized = false;
+	return ret;
+}
+
+/* Queue a write of @size bytes at @data (inside @buf) to @file.  Must be called
+ * with ctx->lock held.  */
+static int
+unix_queue_write(struct unix_out_file *file, struct unix_write_buf *buf,
+		 const u8 *data, size_t size, u64 offset,
+		 struct unix_apply_ctx *ctx)
+{
+	struct unix_write_req *req = MALLOC(sizeof(*req));
+
+	if (!req)
+		return WIMLIB_ERR_NOMEM;
+	req->file = file;
+	req->buf = buf;
+	req->data = data;
+	req->size = size;
+	req->offset = offset;
+	file->refcnt++;
+	buf->refcnt++;
+	list_add_tail(&req->list, &ctx->pending_reqs);
+	condvar_signal(&ctx->req_avail_cond);
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*
+ *                          Creating the file tree                            *
+ *----------------------------------------------------------------------------*/
+
+static int
+unix_create_directory(const struct wim_dentry *dentry,
+		      struct unix_apply_ctx *ctx)
+{
+	const char *path = unix_build_extraction_path(dentry, ctx);
+	struct stat stbuf;
+
+	if (mkdir(path, 0755) &&
+	    !(errno == EEXIST && !lstat(path, &stbuf) && S_ISDIR(stbuf.st_mode)))
+	{
+		ERROR_WITH_ERRNO("Can't create directory \"%s\"", path);
+		return WIMLIB_ERR_MKDIR;
+	}
+	return report_file_created(&ctx->common);
+}
+
+/* Create an empty regular file for the first extraction alias of each
+ * nondirectory inode, and hard link its other aliases to it.  Symbolic links
+ * are created later, once their reparse data has been read.  */
+static int
+unix_create_nondirectory(struct wim_inode *inode, struct unix_apply_ctx *ctx)
+{
+	const struct wim_dentry *first = inode_first_extraction_dentry(inode);
+	const struct wim_dentry *dentry;
+	const char *first_path;
+	int ret, fd;
+
+	first_path = unix_build_extraction_path(first, ctx);
+	if (!inode_is_symlink(inode)) {
+		fd = open(first_path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW,
+			  0644);
+		if (fd < 0) {
+			ERROR_WITH_ERRNO("Can't create regular file \"%s\"",
+					 first_path);
+			return WIMLIB_ERR_OPEN;
+		}
+		if (close(fd)) {
+			ERROR_WITH_ERRNO("Error closing \"%s\"", first_path);
+			return WIMLIB_ERR_WRITE;
+		}
+	}
+	ret = report_file_created(&ctx->common);
+	if (ret)
+		return ret;
+
+	for (dentry = first->d_next_extraction_alias; dentry;
+	     dentry = dentry->d_next_extraction_alias)
+	{
+		const char *path = unix_build_extraction_path(dentry, ctx);
+
+		/* Keep first_path valid across the buffer rotation.  */
+		first_path = unix_build_extraction_path(first, ctx);
+		if (!inode_is_symlink(inode) && link(first_path, path)) {
+			ERROR_WITH_ERRNO("Can't create hard link "
+					 "\"%s\" => \"%s\"", path, first_path);
+			return WIMLIB_ERR_LINK;
+		}
+		ret = report_file_created(&ctx->common);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int
+unix_create_file_tree(struct list_head *dentry_list,
+		      struct unix_apply_ctx *ctx)
+{
+	struct wim_dentry *dentry;
+	int ret;
+
+	list_for_each_entry(dentry, dentry_list, d_extraction_list_node) {
+		if (!inode_is_directory(dentry->d_inode))
+			continue;
+		ret = unix_create_directory(dentry, ctx);
+		if (ret)
+			return ret;
+	}
+
+	list_for_each_entry(dentry, dentry_list, d_extraction_list_node) {
+		struct wim_inode *inode = dentry->d_inode;
+
+		if (inode_is_directory(inode) ||
+		    dentry != inode_first_extraction_dentry(inode))
+			continue;
+		ret = unix_create_nondirectory(inode, ctx);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*
+ *                           Extracting file data                             *
+ *----------------------------------------------------------------------------*/
+
+/* Reserve space for a file that will be written in full, so that the parallel
+ * writers don't fragment it.  Failure is harmless.  */
+static void
+unix_preallocate(struct unix_out_file *file, u64 size)
+{
+#ifdef __linux__
+	(void)fallocate(file->fd.fd, 0, 0, size);
+#elif defined(HAVE_POSIX_FALLOCATE)
+	(void)posix_fallocate(file->fd.fd, 0, size);
+#else
+	(void)file;
+	(void)size;
+#endif
+}
+
+static int
+unix_begin_extract_blob_instance(const struct blob_descriptor *blob,
+				 const struct wim_inode *inode,
+				 struct unix_apply_ctx *ctx)
+{
+	const struct wim_dentry *first = inode_first_extraction_dentry(inode);
+	const char *path = unix_build_extraction_path(first, ctx);
+	const bool sparse = (inode->i_attributes & FILE_ATTRIBUTE_SPARSE_FILE);
+	struct unix_out_file *file;
+	int raw_fd;
+
+	wimlib_assert(ctx->num_open_files < MAX_OPEN_FILES);
+
+	raw_fd = open(path, O_WRONLY | O_NOFOLLOW);
+	if (raw_fd < 0) {
+		ERROR_WITH_ERRNO("Can't open \"%s\" for writing", path);
+		return WIMLIB_ERR_OPEN;
+	}
+
+	file = MALLOC(sizeof(*file));
+	if (file)
+		file->path = STRDUP(path);
+	if (!file || !file->path) {
+		FREE(file);
+		close(raw_fd);
+		return WIMLIB_ERR_NOMEM;
+	}
+	filedes_init(&file->fd, raw_fd);
+	file->refcnt = 1;
+
+	/* Sparse files get their final size up front so that skipped zero
+	 * regions, including any at the end, become holes.  */
+	if (sparse) {
+		if (ftruncate(raw_fd, blob->size)) {
+			ERROR_WITH_ERRNO("Can't truncate \"%s\" to %"PRIu64" "
+					 "bytes", path, blob->size);
+			close(raw_fd);
+			FREE(file->path);
+			FREE(file);
+			return WIMLIB_ERR_WRITE;
+		}
+	} else {
+		unix_preallocate(file, blob->size);
+	}
+
+	ctx->is_sparse_file[ctx->num_open_files] = sparse;
+	ctx->open_files[ctx->num_open_files++] = file;
+	return 0;
+}
+
+static int
+unix_begin_extract_blob(struct blob_descriptor *blob, void *_ctx)
+{
+	struct unix_apply_ctx *ctx = _ctx;
+	const struct blob_extraction_target *targets = blob_extraction_targets(blob);
+	unsigned num_files = 0;
+	int ret;
+
+	for (u32 i = 0; i < blob->out_refcnt; i++)
+		if (targets[i].stream->stream_type == STREAM_TYPE_DATA)
+			num_files++;
+
+	/* Don't exceed the open file limit with files still being written.  */
+	mutex_lock(&ctx->lock);
+	while (ctx->files_in_flight && ctx->files_in_flight + num_files > MAX_OPEN_FILES)
+		condvar_wait(&ctx->space_avail_cond, &ctx->lock);
+	ctx->files_in_flight += num_files;
+	ret = ctx->write_error;
+	mutex_unlock(&ctx->lock);
+	if (ret)
+		goto out_unreserve;
+
+	ctx->num_open_files = 0;
+	ctx->reparse_ptr = NULL;
+
+	for (u32 i = 0; i < blob->out_refcnt; i++) {
+		const struct wim_inode *inode = targets[i].inode;
+		const struct wim_inode_stream *strm = targets[i].stream;
+
+		if (strm->stream_type == STREAM_TYPE_REPARSE_POINT) {
+			/* Symlink  */
+			if (blob->size > REPARSE_DATA_MAX_SIZE) {
+				ERROR("Reparse data of \"%s\" has size "
+				      "%"PRIu64" bytes (exceeds %u bytes)",
+				      unix_build_extraction_path(
+					inode_first_extraction_dentry(inode), ctx),
+				      blob->size, REPARSE_DATA_MAX_SIZE);
+				ret = WIMLIB_ERR_INVALID_REPARSE_DATA;
+				goto out_close;
+			}
+			ctx->reparse_ptr = ctx->reparse_data;
+		} else {
+			wimlib_assert(strm->stream_type == STREAM_TYPE_DATA);
+			ret = unix_begin_extract_blob_instance(blob, inode, ctx);
+			if (ret)
+				goto out_close;
+		}
+	}
+	return 0;
+
+out_close:
+	mutex_lock(&ctx->lock);
+	for (unsigned i = 0; i < ctx->num_open_files; i++) {
+		unix_put_out_file(ctx->open_files[i], ctx);
+		num_files--;
+	}
+	mutex_unlock(&ctx->lock);
+	ctx->num_open_files = 0;
+out_unreserve:
+	mutex_lock(&ctx->lock);
+	ctx->files_in_flight -= num_files;
+	condvar_broadcast(&ctx->space_avail_cond);
+	mutex_unlock(&ctx->lock);
+	return ret;
+}
+
+/* Called when the next chunk of a blob has been read  */
+static int
+unix_extract_chunk(const struct blob_descriptor *blob, u64 offset,
+		   const void *chunk, size_t size, void *_ctx)
+{
+	struct unix_apply_ctx *ctx = _ctx;
+	struct unix_write_buf *buf;
+	int ret;
+
+	if (ctx->reparse_ptr) {
+		memcpy(ctx->reparse_ptr, chunk, size);
+		ctx->reparse_ptr += size;
+	}
+
+	if (!ctx->num_open_files)
+		return 0;
+
+	buf = MALLOC(sizeof(*buf) + size);
+	if (!buf)
+		return WIMLIB_ERR_NOMEM;
+	memcpy(buf->data, chunk, size);
+	buf->size = size;
+	/* Hold a reference while queueing so the writers can't free it.  */
+	buf->refcnt = 1;
+
+	mutex_lock(&ctx->lock);
+	while (ctx->queued_bytes && ctx->queued_bytes + size > MAX_QUEUED_BYTES &&
+	       !ctx->write_error)
+		condvar_wait(&ctx->space_avail_cond, &ctx->lock);
+	ctx->queued_bytes += size;
+	ret = ctx->write_error;
+
+	for (unsigned i = 0; i < ctx->num_open_files && !ret; i++) {
+		struct unix_out_file *file = ctx->open_files[i];
+		const u8 *p = buf->data;
+		const u8 * const end = p + size;
+
+		if (!ctx->is_sparse_file[i]) {
+			ret = unix_queue_write(file, buf, p, size, offset, ctx);
+			continue;
+		}
+
+		/* Skip over zero regions so they stay holes.  */
+		while (p != end && !ret) {
+			size_t len;
+			bool zeroes = detect_sparse_region(p, end - p, &len);
+
+			if (!zeroes)
+				ret = unix_queue_write(file, buf, p, len,
+						       offset + (p - buf->data),
+						       ctx);
+			p += len;
+		}
+	}
+	unix_put_write_buf(buf, ctx);
+	mutex_unlock(&ctx->lock);
+	return ret;
+}
+
+static int
+unix_create_symlink(const struct wim_inode *inode, const char *path,
+		    size_t rpdatalen, struct unix_apply_ctx *ctx)
+{
+	char target[REPARSE_POINT_MAX_SIZE];
+	struct blob_descriptor blob_override;
+	int ret;
+
+	blob_set_is_located_in_attached_buffer(&blob_override,
+					       ctx->reparse_data, rpdatalen);
+
+	ret = wim_inode_readlink(inode, target, sizeof(target) - 1,
+				 &blob_override, ctx->common.target,
+				 ctx->common.target_nchars);
+	if (unlikely(ret < 0)) {
+		errno = -ret;
+		ERROR_WITH_ERRNO("Can't read symbolic link target of \"%s\"",
+				 path);
+		return WIMLIB_ERR_READLINK;
+	}
+	target[ret] = '\0';
+
+	if (symlink(target, path)) {
+		ERROR_WITH_ERRNO("Can't create symbolic link "
+				 "\"%s\" => \"%s\"", path, target);
+		return WIMLIB_ERR_LINK;
+	}
+	return 0;
+}
+
+/* Called when a blob has been fully read (or an error occurred)  */
+static int
+unix_end_extract_blob(struct blob_descriptor *blob, int status, void *_ctx)
+{
+	struct unix_apply_ctx *ctx = _ctx;
+	int ret = status;
+
+	/* The writers close each file once its queued writes are done.  */
+	mutex_lock(&ctx->lock);
+	for (unsigned i = 0; i < ctx->num_open_files; i++)
+		unix_put_out_file(ctx->open_files[i], ctx);
+	if (!ret)
+		ret = ctx->write_error;
+	mutex_unlock(&ctx->lock);
+	ctx->num_open_files = 0;
+
+	if (ret || !ctx->reparse_ptr)
+		return ret;
+
+	/* Create the symlinks now that the reparse data is known.  */
+	const struct blob_extraction_target *targets = blob_extraction_targets(blob);
+	for (u32 i = 0; i < blob->out_refcnt; i++) {
+		const struct wim_inode *inode = targets[i].inode;
+		const struct wim_dentry *dentry;
+
+		if (targets[i].stream->stream_type != STREAM_TYPE_REPARSE_POINT)
+			continue;
+		inode_for_each_extraction_alias(dentry, inode) {
+			ret = unix_create_symlink(inode,
+						  unix_build_extraction_path(dentry, ctx),
+						  ctx->reparse_ptr - ctx->reparse_data,
+						  ctx);
+			if (ret)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*
+ *                            Applying metadata                               *
+ *----------------------------------------------------------------------------*/
+
+static int
+unix_set_metadata(const struct wim_dentry *dentry, struct unix_apply_ctx *ctx)
+{
+	const struct wim_inode *inode = dentry->d_inode;
+	const char *path = unix_build_extraction_path(dentry, ctx);
+	struct wimlib_unix_data unix_data;
+	struct timespec times[2];
+
+	if ((ctx->common.extract_flags & WIMLIB_EXTRACT_FLAG_UNIX_DATA) &&
+	    inode_get_unix_data(inode, &unix_data))
+	{
+		if (lchown(path, unix_data.uid, unix_data.gid)) {
+			WARNING_WITH_ERRNO("Can't set owner of \"%s\"", path);
+		}
+		if (!inode_is_symlink(inode) &&
+		    chmod(path, unix_data.mode & 07777))
+		{
+			ERROR_WITH_ERRNO("Can't set mode of \"%s\"", path);
+			return WIMLIB_ERR_SET_SECURITY;
+		}
+	}
+
+	times[0] = wim_timestamp_to_timespec(inode->i_last_access_time);
+	times[1] = wim_timestamp_to_timespec(inode->i_last_write_time);
+	if (utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW)) {
+		if (ctx->common.extract_flags &
+		    WIMLIB_EXTRACT_FLAG_STRICT_TIMESTAMPS)
+		{
+			ERROR_WITH_ERRNO("Can't set timestamps on \"%s\"", path);
+			return WIMLIB_ERR_SET_TIMESTAMPS;
+		}
+		WARNING_WITH_ERRNO("Can't set timestamps on \"%s\"", path);
+	}
+	return report_file_metadata_applied(&ctx->common);
+}
+
+/* Apply metadata in reverse order, so that the timestamps of directories are
+ * set after their contents have been created.  */
+static int
+unix_apply_metadata(struct list_head *dentry_list, struct unix_apply_ctx *ctx)
+{
+	const struct wim_dentry *dentry;
+	int ret;
+
+	list_for_each_entry_reverse(dentry, dentry_list, d_extraction_list_node) {
+		ret = unix_set_metadata(dentry, ctx);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int
+unix_extract(struct list_head *dentry_list, struct apply_ctx *_ctx)
+{
+	int ret;
+	struct unix_apply_ctx *ctx = (struct unix_apply_ctx *)_ctx;
+	u64 dentry_count;
+
+	ret = unix_alloc_pathbufs(dentry_list, ctx, &dentry_count);
+	if (ret)
+		goto out;
+
+	ret = start_file_structure_phase(&ctx->common, dentry_count);
+	if (ret)
+		goto out;
+
+	ret = unix_create_file_tree(dentry_list, ctx);
+	if (ret)
+		goto out;
+
+	ret = end_file_structure_phase(&ctx->common);
+	if (ret)
+		goto out;
+
+	ret = unix_start_writer_threads(ctx);
+	if (ret)
+		goto out;
+
+	struct read_blob_callbacks cbs = {
+		.begin_blob	= unix_begin_extract_blob,
+		.continue_blob	= unix_extract_chunk,
+		.end_blob	= unix_end_extract_blob,
+		.ctx		= ctx,
+	};
+	ret = extract_blob_list(&ctx->common, &cbs);
+
+	/* All data must be on disk before timestamps are set.  */
+	int ret2 = unix_stop_writer_threads(ctx);
+	if (!ret)
+		ret = ret2;
+	if (ret)
+		goto out;
+
+	ret = start_file_metadata_phase(&ctx->common, dentry_count);
+	if (ret)
+		goto out;
+
+	ret = unix_apply_metadata(dentry_list, ctx);
+	if (ret)
+		goto out;
+
+	ret = end_file_metadata_phase(&ctx->common);
+out:
+	unix_stop_writer_threads(ctx);
+	for (unsigned i = 0; i < NUM_PATHBUFS; i++)
+		FREE(ctx->pathbufs[i]);
+	return ret;
+}
+
+const struct apply_operations unix_apply_ops = {
+	.name			= "UNIX",
+	.get_supported_features = unix_get_supported_features,
+	.extract                = unix_extract,
+	.context_size           = sizeof(struct unix_apply_ctx),
+};
+
+#endif /* !_WIN32 */
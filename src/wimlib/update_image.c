@@ -742,7 +742,11 @@ get_capture_config(const tchar *config_file, struct capture_config *config,
 
 		size_t len = tstrlen(fs_source_path) +
 			     tstrlen(wimboot_cfgfile);
+#ifdef _WIN32
 		struct _stat64 st;
+#else
+		struct stat st;
+#endif
 
 		tmp_config_file = MALLOC((len + 1) * sizeof(tchar));
 		if (!tmp_config_file)
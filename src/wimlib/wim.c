@@ -39,6 +39,7 @@
 #include "wimlib/file_io.h"
 #include "wimlib/integrity.h"
 #include "wimlib/metadata.h"
+#include "wimlib/resource.h"
 #include "wimlib/security.h"
 #include "wimlib/threads.h"
 #include "wimlib/wim.h"
@@ -148,6 +149,7 @@ new_wim_struct(void)
 	wim->refcnt = 1;
 	filedes_invalidate(&wim->in_fd);
 	filedes_invalidate(&wim->out_fd);
+	INIT_LIST_HEAD(&wim->solid_chunk_cache);
 	wim->out_solid_compression_type = wim_default_solid_compression_type();
 	wim->out_solid_chunk_size = wim_default_solid_chunk_size(
 					wim->out_solid_compression_type);
@@ -203,6 +205,8 @@ unload_image_metadata(struct wim_image_metadata *imd)
 {
 	free_dentry_tree(imd->root_dentry, NULL);
 	imd->root_dentry = NULL;
+	free_dentry_arena(imd->dentry_arena);
+	imd->dentry_arena = NULL;
 	free_wim_security_data(imd->security_data);
 	imd->security_data = NULL;
 	INIT_HLIST_HEAD(&imd->inode_list);
@@ -598,6 +602,24 @@ wimlib_set_output_pack_chunk_size(WIMStruct *wim, u32 chunk_size)
 	return 0;
 }
 
+/* API function documented in wimlib.h  */
+WIMLIBAPI void
+wimlib_set_output_num_threads(WIMStruct *wim, unsigned num_threads)
+{
+	wim->out_num_threads = num_threads;
+}
+
+/* API function documented in wimlib.h  */
+WIMLIBAPI int
+wimlib_set_output_compression_level(WIMStruct *wim, unsigned compression_level)
+{
+	if (compression_level > 0xFFFFFF)
+		return WIMLIB_ERR_INVALID_PARAM;
+
+	wim->out_compression_level = compression_level;
+	return 0;
+}
+
 /* API function documented in wimlib.h  */
 WIMLIBAPI const tchar *
 wimlib_get_compression_type_string(enum wimlib_compression_type ctype)
@@ -1000,6 +1022,8 @@ wim_decrement_refcnt(WIMStruct *wim)
 	}
 #endif
 	wimlib_free_decompressor(wim->decompressor);
+	free_parallel_decompressor(wim->parallel_decompressor);
+	solid_chunk_cache_free(wim);
 	xml_free_info_struct(wim->xml_info);
 	FREE(wim->filename);
 	FREE(wim);
@@ -1044,6 +1068,13 @@ wimlib_get_version_string(void)
 	return T(PACKAGE_VERSION);
 }
 
+/* Outside of Windows, the init/cleanup mutex below uses the GCC atomic builtins */
+#ifndef _WIN32
+#define InterlockedIncrement16(p)	__sync_add_and_fetch(p, 1)
+#define InterlockedDecrement16(p)	__sync_sub_and_fetch(p, 1)
+#define Sleep(ms)			usleep((ms) * 1000)
+#endif
+
 static volatile uint16_t lib_initialization_mutex = 0;
 static bool lib_initialized = false;
 
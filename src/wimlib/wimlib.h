@@ -1106,6 +1106,10 @@ union wimlib_progress_info {
 		/** For ::WIMLIB_PROGRESS_MSG_VERIFY_INTEGRITY messages, this is
 		 * the path to the WIM file being checked.  */
 		const wimlib_tchar *filename;
+
+		/** Average number of bytes checksummed per second since the
+		 * operation began, or 0 if not yet known.  */
+		uint64_t bytes_per_sec;
 	} integrity;
 
 	/** Valid on messages ::WIMLIB_PROGRESS_MSG_SPLIT_BEGIN_PART and
@@ -4306,6 +4310,44 @@ wimlib_set_output_chunk_size(WIMStruct *wim, uint32_t chunk_size);
 WIMLIBAPI int
 wimlib_set_output_pack_chunk_size(WIMStruct *wim, uint32_t chunk_size);
 
+/**
+ * @ingroup G_writing_and_overwriting_wims
+ *
+ * Set the number of threads to use for compressing data in subsequent calls to
+ * functions that don't take an explicit thread count, such as wimlib_split().
+ * Data that is copied raw from the source WIM is never recompressed, so this
+ * only matters for data that needs to be compressed.
+ *
+ * @param wim
+ *	The ::WIMStruct for which to set the number of threads.
+ * @param num_threads
+ *	The number of threads to use, or 0 to use one thread per CPU.
+ */
+WIMLIBAPI void
+wimlib_set_output_num_threads(WIMStruct *wim, unsigned num_threads);
+
+/**
+ * @ingroup G_writing_and_overwriting_wims
+ *
+ * Set the compression level to use for data compressed while writing @p wim.
+ * Unlike wimlib_set_default_compression_level(), this only affects writes of
+ * this ::WIMStruct.  As with wimlib_set_output_num_threads(), data that is
+ * copied raw from the source WIM is never recompressed.
+ *
+ * @param wim
+ *	The ::WIMStruct for which to set the compression level.
+ * @param compression_level
+ *	The compression level, as for wimlib_create_compressor(), or 0 to use
+ *	the default level of the compression type.
+ *
+ * @return 0 on success; a ::wimlib_error_code value on failure.
+ *
+ * @retval ::WIMLIB_ERR_INVALID_PARAM
+ *	@p compression_level was greater than 0xFFFFFF.
+ */
+WIMLIBAPI int
+wimlib_set_output_compression_level(WIMStruct *wim, unsigned compression_level);
+
 /**
  * @ingroup G_writing_and_overwriting_wims
  *
@@ -4409,7 +4451,14 @@ wimlib_set_wim_info(WIMStruct *wim, const struct wimlib_wim_info *info,
  * @param write_flags
  *	Bitwise OR of relevant flags prefixed with @c WIMLIB_WRITE_FLAG.  These
  *	flags will be used to write each split WIM part.  Specify 0 here to get
- *	the default behavior.
+ *	the default behavior, where the parts keep the compression type and
+ *	chunk size of @p wim and its resources are copied without being
+ *	recompressed.  With ::WIMLIB_WRITE_FLAG_RECOMPRESS, the parts are instead
+ *	recompressed using the output settings of @p wim (see
+ *	wimlib_set_output_chunk_size() and
+ *	wimlib_set_output_compression_level()), and are planned using the
+ *	uncompressed size of each resource so that @p part_size is still
+ *	respected.
  *
  * @return 0 on success; a ::wimlib_error_code value on failure.  This function
  * may return most error codes that can be returned by wimlib_write() as well as
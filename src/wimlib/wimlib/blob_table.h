@@ -65,9 +65,6 @@ struct blob_extraction_target {
  */
 struct blob_descriptor {
 
-	/* List node for a hash bucket of the blob table  */
-	struct hlist_node hash_list;
-
 	/*
 	 * Uncompressed size of this blob.
 	 *
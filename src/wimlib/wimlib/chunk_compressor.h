@@ -65,11 +65,13 @@ struct chunk_compressor {
 
 int
 new_parallel_chunk_compressor(int out_ctype, u32 out_chunk_size,
-			      unsigned num_threads, u64 max_memory,
+			      unsigned num_threads, unsigned compression_level,
+			      u64 max_memory,
 			      struct chunk_compressor **compressor_ret);
 
 int
 new_serial_chunk_compressor(int out_ctype, u32 out_chunk_size,
+			    unsigned compression_level,
 			    struct chunk_compressor **compressor_ret);
 
 #endif /* _WIMLIB_CHUNK_COMPRESSOR_H  */
@@ -81,6 +81,10 @@ struct wim_dentry {
 	/* Used by wimlib_update_image()  */
 	u16 d_is_orphan : 1;
 
+	/* Set if this dentry was allocated from a dentry arena, in which case
+	 * it is released along with the arena rather than by free_dentry().  */
+	u16 d_in_arena : 1;
+
 	union {
 		/* The subdir offset is only used while reading and writing this
 		 * dentry.  See the corresponding field in `struct
@@ -240,9 +244,18 @@ rename_wim_path(WIMStruct *wim, const tchar *from, const tchar *to,
 		struct update_command_journal *j);
 
 
+struct dentry_arena;
+
+struct dentry_arena *
+new_dentry_arena(void);
+
+void
+free_dentry_arena(struct dentry_arena *arena);
+
 int
 read_dentry_tree(const u8 *buf, size_t buf_len,
-		 u64 root_offset, struct wim_dentry **root_ret);
+		 u64 root_offset, struct wim_dentry **root_ret,
+		 struct dentry_arena *arena);
 
 u8 *
 write_dentry_tree(struct wim_dentry *root, u8 *p);
@@ -122,7 +122,7 @@ struct wim_inode {
 	struct hlist_node i_hlist_node;
 
 	/* Number of dentries that are aliases for this inode.  */
-	u32 i_nlink : 30;
+	u32 i_nlink : 29;
 
 	/* Flag used by some code to mark this inode as visited.  It will be 0
 	 * by default, and it always must be cleared after use.  */
@@ -131,6 +131,10 @@ struct wim_inode {
 	/* Cached value  */
 	u32 i_can_externally_back : 1;
 
+	/* Set if this inode was allocated from a dentry arena, in which case
+	 * it is released along with the arena rather than by free_inode().  */
+	u32 i_in_arena : 1;
+
 	/* If not NULL, a pointer to the extra data that was read from the
 	 * dentry.  This should be a series of tagged items, each of which
 	 * represents a bit of extra metadata, such as the file's object ID.
@@ -267,6 +271,10 @@ struct wim_inode_extra {
 struct wim_inode *
 new_inode(struct wim_dentry *dentry, bool set_timestamps);
 
+void
+init_inode(struct wim_inode *inode, struct wim_dentry *dentry,
+	   bool set_timestamps);
+
 /* Iterate through each alias of the specified inode.  */
 #define inode_for_each_dentry(dentry, inode) \
 	hlist_for_each_entry((dentry), &(inode)->i_alias_list, d_alias_node)
@@ -51,6 +51,10 @@ struct wim_image_metadata {
 	 * if this image is completely empty or is not currently loaded.  */
 	struct hlist_head inode_list;
 
+	/* Arena holding the dentries and inodes that were read from the
+	 * metadata resource, or NULL if the image is not loaded from one.  */
+	struct dentry_arena *dentry_arena;
+
 	/* Linked list of 'struct blob_descriptor's for blobs that are
 	 * referenced by this image's dentry tree, but have not had their SHA-1
 	 * message digests calculated yet and therefore have not been inserted
@@ -299,6 +299,14 @@ int
 extract_blob_to_fd(struct blob_descriptor *blob, struct filedes *fd,
 		   bool recover_data);
 
+struct parallel_decompressor;
+
+void
+free_parallel_decompressor(struct parallel_decompressor *ctx);
+
+void
+solid_chunk_cache_free(WIMStruct *wim);
+
 /* Miscellaneous blob functions.  */
 
 int
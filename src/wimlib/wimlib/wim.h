@@ -113,6 +113,17 @@ struct WIMStruct {
 	u8 decompressor_ctype;
 	u32 decompressor_max_block_size;
 
+	/* Pool of decompressor threads for reads that span many chunks, or
+	 * NULL if none was started yet.  As with the cached decompressor, it
+	 * is replaced if we encounter a different compression type or chunk
+	 * size.  */
+	struct parallel_decompressor *parallel_decompressor;
+
+	/* Most recently used decompressed chunks of solid resources, and their
+	 * total size.  See resource.c.  */
+	struct list_head solid_chunk_cache;
+	u64 solid_chunk_cache_size;
+
 	/* Temporary field; use sparingly  */
 	void *private;
 
@@ -126,6 +137,9 @@ struct WIMStruct {
 	 * with WIMLIB_WRITE_FLAG_UNSAFE_COMPACT  */
 	u8 being_compacted : 1;
 
+	/* 1 if the WIM file is currently being split by wimlib_split()  */
+	u8 being_split : 1;
+
 	/* If this WIM is backed by a file, then this is the compression type
 	 * for non-solid resources in that file.  */
 	u8 compression_type;
@@ -152,6 +166,16 @@ struct WIMStruct {
 	 * wimlib_set_output_pack_chunk_size().  */
 	u32 out_solid_chunk_size;
 
+	/* Number of compressor threads for writes that don't take an explicit
+	 * thread count, such as wimlib_split(); can be set with
+	 * wimlib_set_output_num_threads().  0 means one per CPU.  */
+	unsigned out_num_threads;
+
+	/* Compression level for data compressed while writing this WIMStruct;
+	 * can be set with wimlib_set_output_compression_level().  0 means the
+	 * default level of the compression type.  */
+	unsigned out_compression_level;
+
 	/* Currently registered progress function for this WIMStruct, or NULL if
 	 * no progress function is currently registered for this WIMStruct.  */
 	wimlib_progress_func_t progfunc;
@@ -179,6 +179,15 @@ can_raw_copy(const struct blob_descriptor *blob, int write_resource_flags,
 	if (rdesc->wim->being_compacted)
 		return true;
 
+	/* When splitting, the parts must hold the same data as the original
+	 * WIM, so also reuse uncompressed non-pipable resources rather than
+	 * running them through the compressor again.  */
+	if (rdesc->wim->being_split &&
+	    !(rdesc->flags & (WIM_RESHDR_FLAG_COMPRESSED |
+			      WIM_RESHDR_FLAG_SOLID)))
+		return !rdesc->is_pipable &&
+		       !(write_resource_flags & WRITE_RESOURCE_FLAG_PIPABLE);
+
 	/* Otherwise, only reuse compressed resources.  */
 	if (out_ctype == WIMLIB_COMPRESSION_TYPE_NONE ||
 	    !(rdesc->flags & (WIM_RESHDR_FLAG_COMPRESSED |
@@ -1203,15 +1212,17 @@ find_raw_copy_blobs(struct list_head *blob_list, int write_resource_flags,
 	return num_nonraw_bytes;
 }
 
+/* Size of the buffer used to copy raw resources between WIM files  */
+#define RAW_COPY_BUFFER_SIZE	(4 << 20)
+
 /* Copy a raw compressed resource located in another WIM file to the WIM file
  * being written.  */
 static int
 write_raw_copy_resource(struct wim_resource_descriptor *in_rdesc,
-			struct filedes *out_fd)
+			struct filedes *out_fd, u8 *buf, size_t bufsize)
 {
 	u64 cur_read_offset;
 	u64 end_read_offset;
-	u8 buf[BUFFER_SIZE];
 	size_t bytes_to_read;
 	int ret;
 	struct filedes *in_fd;
@@ -1236,7 +1247,7 @@ write_raw_copy_resource(struct wim_resource_descriptor *in_rdesc,
 	if (likely(!in_rdesc->wim->being_compacted) ||
 	    in_rdesc->offset_in_wim > out_fd->offset) {
 		do {
-			bytes_to_read = min(sizeof(buf),
+			bytes_to_read = min(bufsize,
 					    end_read_offset - cur_read_offset);
 
 			ret = full_pread(in_fd, buf, bytes_to_read,
@@ -1291,7 +1302,23 @@ write_raw_copy_resources(struct list_head *raw_copy_blobs,
 			 struct write_blobs_progress_data *progress_data)
 {
 	struct blob_descriptor *blob;
-	int ret;
+	u8 stack_buf[BUFFER_SIZE];
+	u8 *buf;
+	size_t bufsize;
+	int ret = 0;
+
+	if (list_empty(raw_copy_blobs))
+		return 0;
+
+	/* Copy in large pieces, which matters when the source WIM is read
+	 * straight out of an ISO image.  Fall back to a small buffer if memory
+	 * is tight.  */
+	bufsize = RAW_COPY_BUFFER_SIZE;
+	buf = MALLOC(bufsize);
+	if (!buf) {
+		buf = stack_buf;
+		bufsize = sizeof(stack_buf);
+	}
 
 	list_for_each_entry(blob, raw_copy_blobs, write_blobs_list)
 		blob->rdesc->raw_copy_ok = 1;
@@ -1301,18 +1328,22 @@ write_raw_copy_resources(struct list_head *raw_copy_blobs,
 
 		if (blob->rdesc->raw_copy_ok) {
 			/* Write each solid resource only one time.  */
-			ret = write_raw_copy_resource(blob->rdesc, out_fd);
+			ret = write_raw_copy_resource(blob->rdesc, out_fd,
+						      buf, bufsize);
 			if (ret)
-				return ret;
+				goto out;
 			blob->rdesc->raw_copy_ok = 0;
 			compressed_size = blob->rdesc->size_in_wim;
 		}
 		ret = do_write_blobs_progress(progress_data, blob->size,
 					      compressed_size, 1, false);
 		if (ret)
-			return ret;
+			goto out;
 	}
-	return 0;
+out:
+	if (buf != stack_buf)
+		FREE(buf);
+	return ret;
 }
 
 /* Wait for and write all chunks pending in the compressor.  */
@@ -1417,6 +1448,10 @@ init_done_with_file_info(struct list_head *blob_list)
  *	threads will be chosen.  The number of threads still may be decreased
  *	from the specified value if insufficient memory is detected.
  *
+ * @compression_level
+ *	Compression level to use for data that needs to be compressed, or 0 to
+ *	use the default level of @out_ctype.
+ *
  * @blob_table
  *	If on-the-fly deduplication of unhashed blobs is desired, this parameter
  *	must be pointer to the blob table for the WIMStruct on whose behalf the
@@ -1482,6 +1517,7 @@ write_blob_list(struct list_head *blob_list,
 		int out_ctype,
 		u32 out_chunk_size,
 		unsigned num_threads,
+		unsigned compression_level,
 		struct blob_table *blob_table,
 		struct filter_context *filter_ctx,
 		wimlib_progress_func_t progfunc,
@@ -1562,7 +1598,8 @@ write_blob_list(struct list_head *blob_list,
 		if (num_nonraw_bytes > max(2000000, out_chunk_size)) {
 			ret = new_parallel_chunk_compressor(out_ctype,
 							    out_chunk_size,
-							    num_threads, 0,
+							    num_threads,
+							    compression_level, 0,
 							    &ctx.compressor);
 			if (ret > 0) {
 				WARNING("Couldn't create parallel chunk compressor: %"TS".\n"
@@ -1573,6 +1610,7 @@ write_blob_list(struct list_head *blob_list,
 
 		if (ctx.compressor == NULL) {
 			ret = new_serial_chunk_compressor(out_ctype, out_chunk_size,
+							  compression_level,
 							  &ctx.compressor);
 			if (ret)
 				goto out_destroy_context;
@@ -1693,6 +1731,7 @@ write_file_data_blobs(WIMStruct *wim,
 			       out_ctype,
 			       out_chunk_size,
 			       num_threads,
+			       wim->out_compression_level,
 			       wim->blob_table,
 			       filter_ctx,
 			       wim->progfunc,
@@ -1716,6 +1755,7 @@ write_wim_resource(struct blob_descriptor *blob,
 			       out_ctype,
 			       out_chunk_size,
 			       1,
+			       0,
 			       NULL,
 			       NULL,
 			       NULL,
@@ -474,11 +474,9 @@ static void PopulateWindowsVersionFromXml(const wchar_t* xml, size_t xml_len, in
 /// <returns>TRUE on success, FALSE if we couldn't populate the version.</returns>
 BOOL PopulateWindowsVersion(void)
 {
-	int r;
 	char wim_path[MAX_PATH] = "";
 	wchar_t* xml = NULL;
 	size_t xml_len;
-	WIMStruct* wim = NULL;
 
 	memset(&img_report.win_version, 0, sizeof(img_report.win_version));
 
@@ -488,15 +486,9 @@ BOOL PopulateWindowsVersion(void)
 		static_strcat(wim_path, &img_report.wininst_path[0][3]);
 	}
 
-	r = wimlib_open_wimU(wim_path, 0, &wim);
-	if (r != 0) {
-		uprintf("Could not open WIM: Error %d", r);
-		goto out;
-	}
-
-	r = wimlib_get_xml_data(wim, (void**)&xml, &xml_len);
-	if (r != 0) {
-		uprintf("Could not read WIM XML index: Error %d", r);
+	// Only the XML index is needed, so don't bother with a full wimlib_open_wim()
+	if (!GetWimXmlData(wim_path, (void**)&xml, &xml_len)) {
+		uprintf("Could not read WIM XML index");
 		goto out;
 	}
 
@@ -504,7 +496,6 @@ BOOL PopulateWindowsVersion(void)
 
 out:
 	free(xml);
-	wimlib_free(wim);
 
 	return ((img_report.win_version.major != 0) && (img_report.win_version.build != 0));
 }
@@ -542,10 +533,10 @@ BOOL CopySKUSiPolicy(const char* drive_name)
 /// <returns>-2 on user cancel, -1 on other error, >=0 on success.</returns>
 int SetWinToGoIndex(void)
 {
-	int i, r;
-	WIMStruct* wim = NULL;
+	int i;
 	char* install_names[MAX_WININST];
-	wchar_t wim_path[MAX_PATH] = L"", *xml = NULL;
+	char wim_path[MAX_PATH] = "";
+	wchar_t* xml = NULL;
 	size_t xml_len;
 	StrArray version_name = { 0 }, version_index = { 0 };
 	BOOL bNonStandard = FALSE;
@@ -568,21 +559,14 @@ int SetWinToGoIndex(void)
 			wininst_index = 0;
 	}
 
-	utf8_to_wchar_no_alloc(image_path, wim_path, ARRAYSIZE(wim_path));
+	static_strcpy(wim_path, image_path);
 	if (!img_report.is_windows_img) {
-		wcscat(wim_path, L"|");
-		utf8_to_wchar_no_alloc(&img_report.wininst_path[wininst_index][2],
-			&wim_path[wcslen(wim_path)], (int)ARRAYSIZE(wim_path) - wcslen(wim_path));
+		static_strcat(wim_path, "|");
+		static_strcat(wim_path, &img_report.wininst_path[wininst_index][2]);
 	}
 
-	r = wimlib_open_wim(wim_path, 0, &wim);
-	if (r != 0) {
-		uprintf("Could not open WIM: %d", r);
-		goto out;
-	}
-	r = wimlib_get_xml_data(wim, (void**)&xml, &xml_len);
-	if (r != 0) {
-		uprintf("Could not read WIM XML index: %d", r);
+	if (!GetWimXmlData(wim_path, (void**)&xml, &xml_len)) {
+		uprintf("Could not read WIM XML index");
 		goto out;
 	}
 
@@ -647,7 +631,6 @@ out:
 	StrArrayDestroy(&version_index);
 	free(xml);
 	ezxml_free(index);
-	wimlib_free(wim);
 	return wintogo_index;
 }
 